@@ -19,10 +19,20 @@
 //SOFTWARE.
 
 #include <opencv2/opencv.hpp>
+#include <cstdlib>
 #include <string>
 #include <iostream>
 #include "../LauraConvolution.h"
+#include "../LauraCounters.h"
 #include "../LauraFilters.h"
+#include "../LauraIngest.h"
+#include "../LauraJobs.h"
+#include "../LauraMemory.h"
+#include "../LauraPipeline.h"
+#include "../LauraRaw.h"
+#include "../LauraSparse.h"
+#include "../LauraTaskGraph.h"
+#include "../LauraTuner.h"
 
 using cv::Mat;
 using cv::namedWindow;
@@ -36,39 +46,89 @@ using std::endl;
 using std::string;
 using std::vector;
 
-#define EPS 1e-7
-
-Mat HarrisCornerSignal(Mat& gx, Mat& gy, int fsize1, int fsize2);
-float cornerSignal(Mat& inhood, Mat& filter, Range xidx,
-	Range yidx, void* varargs);
 void normalizeImage(Mat& img);
-Mat removeMultiDots(Mat& img, int fsize);
-float dotYield(Mat& inhood, Mat& filter, Range xidx, Range yidx,
-	void* varargs);
 void printMat(Mat& littleMat);
+void toDisplay(int rowStart, int rowEnd, void* varargs);
 
 int
 main(int argc, char** argv) {
 	//Read image from command line.
 	string fname;
-	if (argc != 2) { //user did something wrong, correct them and exit
-		cout << "Format: ./HarrisCorner [filename]." << endl;
-		return 0;
+	//--scale n (2, 4 or 8) works at 1/n of the image size.
+	int scale = 1;
+	//--budget ms picks the smoothing and working size that are
+	//expected to finish in ms.
+	float budget = 0;
+	//--tune times the ways to smooth this image size and saves
+	//the fastest (see LauraTuner); otherwise saved choices are
+	//used, or the default.
+	bool tune = false;
+	//An optional .lraw file receives the result.
+	string outname;
+	bool ok = (argc >= 2);
+	for (int a = 2; a < argc; ++a)
+	{
+		if ((string(argv[a]) == "--scale") && (a + 1 < argc))
+		{
+			scale = atoi(argv[++a]);
+			ok = ok && LauraIngest::isScale(scale);
+		}
+		else if ((string(argv[a]) == "--budget") && (a + 1 < argc))
+		{
+			budget = (float) atof(argv[++a]);
+			ok = ok && (0 < budget);
+		}
+		else if (string(argv[a]) == "--tune")
+			tune = true;
+		else if (LauraRaw::isRaw(argv[a]))
+			outname = argv[a];
+		else
+			ok = false;
 	}
-	else {
-		fname = argv[1]; //grab filename
+	if (!ok) { //user did something wrong, correct them and exit
+		cout << "Format: ./HarrisCorner [filename] [--scale n] [--budget ms] [--tune] [output.lraw]." << endl;
+		return 0;
 	}
-	Mat img = imread(fname);
+	//$LAURA_MEMORY_REPORT prints the memory each stage held.
+	LauraMemory::reportAtExit();
+	//$LAURA_COUNTERS prints the hardware counters of each stage.
+	LauraCounters::reportAtExit();
+	fname = argv[1]; //grab filename
+	//Raw (.lraw) images are mapped straight in, no decode;
+	//others are decoded straight to gray at the working size.
+	LauraIngest ingest(scale, CV_32F);
+	Mat img = ingest.loadGray(fname);
 	if (!img.data) return -1; //Snippet from opencv 2.1 doc intro to make sure it loaded properly.
 
-	//Convert to grayscale
-	cv::cvtColor(img, img, CV_RGB2GRAY);
-	//Convert to float
-	img.convertTo(img, CV_32F);
+	//In budget mode the server's pipeline runs instead, timed
+	//once in its cheapest configuration to have costs to go on.
+	if (0 < budget)
+	{
+		LauraJobs::Workspace ws;
+		LauraJobs::Params params;
+		params["budget"] = budget;
+		LauraJobs::calibrate("harris", img, ws);
+		Mat corners = LauraJobs::run("harris", img, params, ws);
+		cout << ws.budget().report() << endl;
+		if (!outname.empty())
+			LauraRaw::save(outname, corners);
+		corners.convertTo(corners, CV_8U);
+		namedWindow("thinned", CV_WINDOW_AUTOSIZE);
+		imshow("thinned", corners);
+		waitKey(0);
+		return 0;
+	}
 
 	//Gaussian smooth the image.
+	//The tuner uses the fastest way found by --tune on this machine.
 	Mat gaussian = LauraFilters::gaussian(9, 9, 1.3);
-	Mat smoothed = LauraConvolution::convolve(img, gaussian);
+	LauraTuner tuner(tune, NULL);
+	Mat smoothed;
+	{
+		LauraMemory::Stage stage("smooth");
+		LauraCounters::Stage counters("smooth", (double) img.total());
+		smoothed = tuner.convolve(img, gaussian);
+	}
 
 	//Remove the dots around the outside with grayscale morphology.
 	//From looking at equations in Wikipedia:Mathematical morphology: 
@@ -76,34 +136,62 @@ main(int argc, char** argv) {
 	//essentially the same as binary version, just uses max and min
 	//to eat in/spread out edges. This has a nice smoothing effect
 	//on the colors, too.
-	Mat rect = cv::getStructuringElement(cv::MORPH_RECT, 
-		cv::Size(9, 9));
-	cv::morphologyEx(smoothed, smoothed, cv::MORPH_OPEN, rect);
+	{
+		LauraMemory::Stage stage("opening");
+		LauraCounters::Stage counters("opening", (double) img.total());
+		smoothed = LauraConvolution::opening(smoothed, 9, 9);
+	}
 
-	//Find the gradients.
+	//Find the gradients. They are independent, so run them
+	//side by side.
 	Mat gxfilt = LauraFilters::gx3x3();
 	Mat gyfilt = LauraFilters::gy3x3();
-	Mat gx = LauraConvolution::convolve(smoothed, gxfilt);
-	Mat gy = LauraConvolution::convolve(smoothed, gyfilt);
+	Mat gx, gy;
+	{
+		LauraMemory::Stage stage("gradient");
+		LauraCounters::Stage counters("gradient", (double) img.total());
+		gx = LauraMemory::create(smoothed.rows, smoothed.cols, CV_32F);
+		gy = LauraMemory::create(smoothed.rows, smoothed.cols, CV_32F);
+		LauraTaskGraph graph(0);
+		graph.addConvolution(smoothed, gxfilt, gx, -1);
+		graph.addConvolution(smoothed, gyfilt, gy, -1);
+		graph.run(0);
+	}
 
 	//Calculate the corner signal.
-	gy = LauraConvolution::addMirroredBoundaries(gy, 2, 2, 2, 2);
-	Mat cimg = HarrisCornerSignal(gx, gy, 3, 3);
-	gy = LauraConvolution::removeBoundaries(gy, 2, 2, 2, 2);
+	Mat cimg;
+	{
+		LauraMemory::Stage stage("corner signal");
+		LauraCounters::Stage counters("corner signal", (double) img.total());
+		cimg = LauraJobs::harrisSignal(gx, gy, 3, 3);
+	}
 
 	//Nonmaxima suppression.
 	//Carry out nonmaxima suppression.
-	Mat thinned = LauraFilters::nonmaximaSuppression3x3(cimg);
-	normalizeImage(thinned);
-	thinned = LauraFilters::threshold(thinned, 50.0f);
-	thinned = removeMultiDots(thinned, 7);
+	//Flat regions have no corner signal, so their tiles are
+	//skipped.
+	Mat thinned;
+	{
+		LauraMemory::Stage stage("nonmaxima");
+		LauraCounters::Stage counters("nonmaxima", (double) img.total());
+		thinned = LauraSparse::nonmaximaSuppression3x3(cimg);
+		LauraPipeline corners(thinned);
+		thinned = corners.normalize().threshold(50.0f).run();
+		thinned = LauraJobs::removeMultiDots(thinned, 7);
+	}
+
+	//Write the result out, if asked.
+	if (!outname.empty())
+		LauraRaw::save(outname, thinned);
 
 	//Convert back to uchar for display.
-	img.convertTo(img, CV_8U);
-	smoothed.convertTo(smoothed, CV_8U);
+	//The conversions are independent of each other.
 	normalizeImage(cimg);
-	cimg.convertTo(cimg, CV_8U);
-	thinned.convertTo(thinned, CV_8U);
+	Mat* display[] = {&img, &smoothed, &cimg, &thinned};
+	LauraTaskGraph convert(0);
+	for (int k = 0; k < 4; ++k)
+		convert.addTask(toDisplay, (void*) display[k], 0, 0);
+	convert.run(0);
 
 	//Highlight the corners in red.  
 	vector<Mat> channels;
@@ -129,74 +217,11 @@ main(int argc, char** argv) {
 	return 0;
 }
 
-Mat HarrisCornerSignal(Mat& gx, Mat& gy, int fsize1, int fsize2)
-{
-	Mat filter = Mat::ones(fsize1, fsize2, gx.type());
-	void* varargs = (void*) &gy;
-	return LauraConvolution::convolutionEngine(
-		gx, filter, varargs, cornerSignal);
-}
-
-float cornerSignal(Mat& inhood, Mat& filter, Range xidx,
-	Range yidx, void* varargs) 
-{
-	Mat gxinhood = inhood;
-	//Unpackage gy and get its neighborhood
-	Mat* gy = (Mat*) varargs;
-	Mat gyinhood = (*gy)(yidx, xidx);
-
-	//Calculate A.
-	//Sum of I_x^2:
-	//dot() will unroll into a vector
-	float A11 = gxinhood.dot(gxinhood);
-	//Sum of I_xI_y:
-	float A12 = gxinhood.dot(gyinhood);
-	//Sum of I_y^2:
-	float A22 = gyinhood.dot(gyinhood);
-
-	float traceA = A11 + A22;
-	float detA = (A11*A22) - (A12*A12);
-
-	return (2*detA)/(traceA + EPS);
-}
-
 //Normalize grayscale image values to be between 0 and 255.
 void normalizeImage(Mat& img)
 {
-	double min, max;
-	cv::minMaxLoc(img, &min, &max);
-	img -= min;
-	cv::minMaxLoc(img, &min, &max);
-	img /= max;
-	img *= 255.0f;
-}
-
-//Get rid of more than one dot on each corner.
-Mat removeMultiDots(Mat& img, int fsize)
-{
-	Mat filter = Mat::ones(fsize, fsize, img.type());
-	return LauraConvolution::convolutionEngine(
-		img, filter, NULL, dotYield);
-}
-
-float dotYield(Mat& inhood, Mat& filter, Range xidx, Range yidx,
-	void* varargs)
-{
-	cv::Mat_<float> inhood_ = inhood;
-	float inhoodSum = inhood.dot(filter);
-	int i = filter.rows/2;
-	int j = filter.cols/2;
-	float p0 = inhood_(i, j);
-
-	//If there is another non-zero in the neighborhood
-	//turn this pixel off.
-	if (p0 && (inhoodSum > p0))
-	{
-		inhood_(i, j) = 0.0f; //Must do this to ensure in-place
-		return 0.0f;
-	}
-	else
-		return p0;
+	LauraPipeline pipeline(img);
+	img = pipeline.normalize().run();
 }
 
 void printMat(Mat& littleMat)
@@ -212,3 +237,11 @@ void printMat(Mat& littleMat)
 		
 	}
 }
+
+//Task that converts the image pointed to by varargs
+//to uchar for display.
+void toDisplay(int rowStart, int rowEnd, void* varargs)
+{
+	Mat* img = (Mat*) varargs;
+	img->convertTo(*img, CV_8U);
+}
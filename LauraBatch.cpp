@@ -0,0 +1,199 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "LauraBatch.h"
+#include <assert.h>
+#include <algorithm>
+using cv::Range;
+
+//Loop body for LauraBatch::run.
+class LauraBatchBody : public cv::ParallelLoopBody
+{
+	const std::vector<LauraBatch::Item>& items;
+	const std::vector<Mat>& imgs;
+	void (*func) (int k, int rowStart, int rowEnd, void* varargs);
+	void (*scratchFunc) (int k, int rowStart, int rowEnd, void* varargs,
+		void* scratch);
+	void* (*begin) (void* varargs);
+	void (*end) (void* scratch);
+	void* varargs;
+
+	void call(int k, int rowStart, int rowEnd, void* scratch) const
+	{
+		if (func)
+			(*func)(k, rowStart, rowEnd, varargs);
+		else
+			(*scratchFunc)(k, rowStart, rowEnd, varargs, scratch);
+	}
+public:
+	LauraBatchBody(const std::vector<LauraBatch::Item>& items,
+		const std::vector<Mat>& imgs,
+		void (*func) (int k, int rowStart, int rowEnd, void* varargs),
+		void (*scratchFunc) (int k, int rowStart, int rowEnd,
+			void* varargs, void* scratch),
+		void* (*begin) (void* varargs), void (*end) (void* scratch),
+		void* varargs)
+		: items(items), imgs(imgs), func(func), scratchFunc(scratchFunc),
+		  begin(begin), end(end), varargs(varargs)
+	{
+
+	}
+
+	virtual void operator()(const Range& range) const
+	{
+		for (int t = range.start; t < range.end; ++t)
+		{
+			const LauraBatch::Item& item = items[t];
+			void* scratch = begin ? (*begin)(varargs) : NULL;
+			if (item.last == item.first + 1)
+				call(item.first, item.rowStart, item.rowEnd, scratch);
+			else
+				for (int k = item.first; k < item.last; ++k)
+					call(k, 0, imgs[k].rows, scratch);
+			if (end)
+				(*end)(scratch);
+		}
+	}
+};
+
+LauraBatch::LauraBatch()
+{
+
+}
+
+LauraBatch::~LauraBatch()
+{
+
+}
+
+void
+LauraBatch::run(const std::vector<Mat>& imgs,
+	void (*func) (int k, int rowStart, int rowEnd, void* varargs),
+	void* varargs)
+{
+	std::vector<Item> items = cut(imgs);
+	if (items.empty())
+		return;
+
+	LauraBatchBody body(items, imgs, func, NULL, NULL, NULL, varargs);
+	cv::parallel_for_(Range(0, (int) items.size()), body,
+		(double) items.size());
+}
+
+void
+LauraBatch::run(const std::vector<Mat>& imgs,
+	void (*func) (int k, int rowStart, int rowEnd, void* varargs,
+		void* scratch),
+	void* (*begin) (void* varargs), void (*end) (void* scratch),
+	void* varargs)
+{
+	std::vector<Item> items = cut(imgs);
+	if (items.empty())
+		return;
+
+	LauraBatchBody body(items, imgs, NULL, func, begin, end, varargs);
+	cv::parallel_for_(Range(0, (int) items.size()), body,
+		(double) items.size());
+}
+
+std::vector<LauraBatch::Item>
+LauraBatch::cut(const std::vector<Mat>& imgs)
+{
+	std::vector<Item> items;
+	int n = (int) imgs.size();
+	int k = 0;
+	while (k < n)
+	{
+		Item item;
+		int pixels = imgs[k].rows*imgs[k].cols;
+		if (GRAIN <= pixels)
+		{
+			//Big image: bands of about GRAIN pixels.
+			int band = GRAIN/imgs[k].cols;
+			if (1 > band) band = 1;
+			for (int r0 = 0; r0 < imgs[k].rows; r0 += band)
+			{
+				item.first = k;
+				item.last = k + 1;
+				item.rowStart = r0;
+				item.rowEnd = std::min(r0 + band, imgs[k].rows);
+				items.push_back(item);
+			}
+			++k;
+			continue;
+		}
+
+		//Small images: as many as fit in GRAIN pixels.
+		item.first = k;
+		item.rowStart = 0;
+		item.rowEnd = imgs[k].rows;
+		for (++k; k < n; ++k)
+		{
+			int next = imgs[k].rows*imgs[k].cols;
+			if (GRAIN <= pixels + next)
+				break;
+			pixels += next;
+		}
+		item.last = k;
+		items.push_back(item);
+	}
+	return items;
+}
+
+std::vector<Mat>
+LauraBatch::unstack(Mat& stack, int n)
+{
+	assert(0 == stack.rows % n);
+	int rows = stack.rows/n;
+	std::vector<Mat> imgs;
+	for (int k = 0; k < n; ++k)
+		imgs.push_back(stack.rowRange(k*rows, (k + 1)*rows));
+	return imgs;
+}
+
+std::vector<Mat>
+LauraBatch::allocate(const std::vector<Mat>& imgs, int type)
+{
+	return allocate(imgs, std::vector<int>(imgs.size(), type));
+}
+
+std::vector<Mat>
+LauraBatch::allocate(const std::vector<Mat>& imgs,
+	const std::vector<int>& types)
+{
+	bool same = true;
+	for (size_t k = 1; k < imgs.size(); ++k)
+	{
+		if ((imgs[k].rows != imgs[0].rows) ||
+			(imgs[k].cols != imgs[0].cols) || (types[k] != types[0]))
+			same = false;
+	}
+
+	std::vector<Mat> ret;
+	if (same && !imgs.empty())
+	{
+		Mat stack((int) imgs.size()*imgs[0].rows, imgs[0].cols,
+			types[0]);
+		return unstack(stack, (int) imgs.size());
+	}
+	for (size_t k = 0; k < imgs.size(); ++k)
+		ret.push_back(Mat(imgs[k].rows, imgs[k].cols, types[k]));
+	return ret;
+}
@@ -0,0 +1,83 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef __LAURABATCH_H__
+#define __LAURABATCH_H__
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+using cv::Mat;
+
+//Schedules row-band work over many images at once.
+//Work is cut into items of about GRAIN pixels: big images are
+//split into bands of rows, and runs of small images are grouped
+//into one item, so a batch of thumbnails keeps every core busy
+//without paying per-call setup for each one.
+class LauraBatch
+{
+	struct Item
+	{
+		int first; //Images first to last - 1...
+		int last;
+		int rowStart; //...or rows of image first, if last == first + 1.
+		int rowEnd;
+	};
+
+	//The body that runs the items.
+	friend class LauraBatchBody;
+	//Cuts the work on imgs into items.
+	static std::vector<Item> cut(const std::vector<Mat>& imgs);
+public:
+	LauraBatch();
+	~LauraBatch();
+
+	//Pixels per work item.
+	enum { GRAIN = 1 << 16 };
+
+	//Calls func(k, rowStart, rowEnd, varargs) on bands of rows
+	//covering every row of every image imgs[k], in parallel.
+	static void run(const std::vector<Mat>& imgs,
+		void (*func) (int k, int rowStart, int rowEnd, void* varargs),
+		void* varargs);
+	//Same, with scratch space for func: begin(varargs) makes it
+	//once per work item, on the thread that runs the item, it is
+	//passed to func for each image (or band) of the item, and
+	//end(scratch) frees it. So a run of thumbnails shares one
+	//set of buffers instead of allocating its own for each.
+	static void run(const std::vector<Mat>& imgs,
+		void (*func) (int k, int rowStart, int rowEnd, void* varargs,
+			void* scratch),
+		void* (*begin) (void* varargs), void (*end) (void* scratch),
+		void* varargs);
+
+	//Headers for the n equal images stacked on top of each other
+	//in stack (n*rows x cols). No data is copied.
+	static std::vector<Mat> unstack(Mat& stack, int n);
+	//Allocates one image of type per image in imgs, the same size.
+	//If they are all the same size, they share one stacked buffer.
+	static std::vector<Mat> allocate(const std::vector<Mat>& imgs,
+		int type);
+	//Same, with image k of type types[k]. They share one buffer
+	//only if they are all the same size and type.
+	static std::vector<Mat> allocate(const std::vector<Mat>& imgs,
+		const std::vector<int>& types);
+};
+
+#endif //!defined __LAURABATCH_H__
@@ -0,0 +1,317 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "LauraBinary.h"
+#include "LauraConvolution.h"
+#include "LauraMemory.h"
+#include <assert.h>
+#include <string.h>
+
+namespace
+{
+//Bits of the 3 pixels of the column at p, top to bottom.
+inline int
+column(const uchar* p, int stride)
+{
+	return p[-stride] | (p[0] << 1) | (p[stride] << 2);
+}
+
+//img (CV_32F or CV_8U) as 0s and 1s with a one pixel border,
+//mirrored or left 0.
+Mat
+padded(Mat& img, bool mirror)
+{
+	assert((CV_32F == img.type()) || (CV_8U == img.type()));
+	int rows = img.rows;
+	int cols = img.cols;
+	Mat ret = LauraMemory::zeros(rows + 2, cols + 2, CV_8U);
+	for (int i = 0; i < rows; ++i)
+	{
+		uchar* dst = ret.ptr<uchar>(i + 1) + 1;
+		if (CV_8U == img.type())
+		{
+			const uchar* src = img.ptr<uchar>(i);
+			for (int j = 0; j < cols; ++j)
+				dst[j] = (0 != src[j]);
+		}
+		else
+		{
+			const float* src = img.ptr<float>(i);
+			for (int j = 0; j < cols; ++j)
+				dst[j] = (0 != src[j]);
+		}
+		if (mirror)
+		{
+			dst[-1] = dst[LauraConvolution::mirrorIndex(-1, cols)];
+			dst[cols] = dst[LauraConvolution::mirrorIndex(cols, cols)];
+		}
+	}
+	if (mirror)
+	{
+		ret.row(1 + LauraConvolution::mirrorIndex(-1, rows)).copyTo(
+			ret.row(0));
+		ret.row(1 + LauraConvolution::mirrorIndex(rows, rows)).copyTo(
+			ret.row(rows + 1));
+	}
+	return ret;
+}
+}
+
+LauraBinary::LauraBinary()
+{
+
+}
+
+LauraBinary::~LauraBinary()
+{
+
+}
+
+int
+LauraBinary::code(const uchar* p, int stride)
+{
+	return column(p - 1, stride) | (column(p, stride) << 3) |
+		(column(p + 1, stride) << 6);
+}
+
+void
+LauraBinary::hitAndMissTable(Mat& filter, uchar* table)
+{
+	assert((3 == filter.rows) && (3 == filter.cols));
+	Mat f;
+	filter.convertTo(f, CV_32F);
+	for (int c = 0; c < TABLE_SIZE; ++c)
+	{
+		bool hit = true;
+		for (int r = 0; r < 3; ++r)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				float e = f.ptr<float>(r)[k];
+				if ((0 != e) && (1 != e))
+					continue; //Blank.
+				if (e != ((c >> (3*k + r)) & 1))
+					hit = false;
+			}
+		}
+		int center = (c >> 4) & 1;
+		table[c] = hit ? !center : center;
+	}
+}
+
+void
+LauraBinary::thinningTables(uchar* first, uchar* second)
+{
+	//Bits of the neighbors P2 (north) to P9 (north-west),
+	//clockwise, as Zhang and Suen number them.
+	static const int ring[8] = {3, 6, 7, 8, 5, 2, 1, 0};
+	for (int c = 0; c < TABLE_SIZE; ++c)
+	{
+		int center = (c >> 4) & 1;
+		first[c] = center;
+		second[c] = center;
+		if (!center)
+			continue;
+
+		int p[8];
+		int b = 0; //Foreground neighbors.
+		for (int k = 0; k < 8; ++k)
+		{
+			p[k] = (c >> ring[k]) & 1;
+			b += p[k];
+		}
+		int a = 0; //0 to 1 steps going round.
+		for (int k = 0; k < 8; ++k)
+			a += (!p[k] && p[(k + 1) % 8]);
+		if ((2 > b) || (6 < b) || (1 != a))
+			continue;
+
+		int p2 = p[0], p4 = p[2], p6 = p[4], p8 = p[6];
+		if (!(p2 && p4 && p6) && !(p4 && p6 && p8))
+			first[c] = 0;
+		if (!(p2 && p4 && p8) && !(p2 && p6 && p8))
+			second[c] = 0;
+	}
+}
+
+Mat
+LauraBinary::apply(Mat& img, const uchar* table)
+{
+	int rows = img.rows;
+	int cols = img.cols;
+	Mat bin = padded(img, true);
+	int stride = (int) bin.step[0];
+	Mat ret = LauraMemory::create(rows, cols, CV_32F);
+	for (int i = 0; i < rows; ++i)
+	{
+		const uchar* p = bin.ptr<uchar>(i + 1) + 1;
+		float* dst = ret.ptr<float>(i);
+		//Slide the code along the row a column at a time.
+		int c = column(p - 1, stride) | (column(p, stride) << 3);
+		for (int j = 0; j < cols; ++j)
+		{
+			c |= column(p + j + 1, stride) << 6;
+			dst[j] = table[c];
+			c >>= 3;
+		}
+	}
+	return ret;
+}
+
+Mat
+LauraBinary::hitAndMiss(Mat& img, Mat& filter)
+{
+	uchar table[TABLE_SIZE];
+	hitAndMissTable(filter, table);
+	return apply(img, table);
+}
+
+int
+LauraBinary::iterate(Mat& bin, const std::vector<const uchar*>& tables,
+	int maxIterations)
+{
+	int n = (int) tables.size();
+	assert((0 < n) && (8 >= n));
+	int rows = bin.rows;
+	int cols = bin.cols;
+	Mat buf = padded(bin, false);
+	int stride = (int) buf.step[0];
+	uchar* base = buf.data;
+
+	//Pixels whose neighborhood changed since table s last looked
+	//at them are on lists[s], and have bit s set in dirty.
+	std::vector<uchar> dirty(buf.rows*stride, 0);
+	std::vector<std::vector<int> > lists(n);
+	std::vector<int> changes;
+
+	int rounds = 0;
+	bool changed = true;
+	while (changed && ((0 >= maxIterations) || (rounds < maxIterations)))
+	{
+		changed = false;
+		for (int s = 0; s < n; ++s)
+		{
+			const uchar* table = tables[s];
+			int bit = 1 << s;
+			changes.clear();
+			if (0 == rounds)
+			{
+				//Nothing is known yet: look at every pixel.
+				for (size_t k = 0; k < lists[s].size(); ++k)
+					dirty[lists[s][k]] &= ~bit;
+				for (int i = 1; i <= rows; ++i)
+				{
+					const uchar* p = base + i*stride + 1;
+					int c = column(p - 1, stride) |
+						(column(p, stride) << 3);
+					for (int j = 0; j < cols; ++j)
+					{
+						c |= column(p + j + 1, stride) << 6;
+						if (table[c] != p[j])
+							changes.push_back(i*stride + 1 + j);
+						c >>= 3;
+					}
+				}
+			}
+			else
+			{
+				for (size_t k = 0; k < lists[s].size(); ++k)
+				{
+					int q = lists[s][k];
+					dirty[q] &= ~bit;
+					if (table[code(base + q, stride)] != base[q])
+						changes.push_back(q);
+				}
+			}
+			lists[s].clear();
+
+			//All at once, so every pixel saw the same image.
+			for (size_t k = 0; k < changes.size(); ++k)
+				base[changes[k]] ^= 1;
+			//Each changed pixel changes the neighborhoods
+			//of the 3x3 pixels around it, for every table.
+			for (size_t k = 0; k < changes.size(); ++k)
+			{
+				for (int di = -1; di <= 1; ++di)
+				{
+					for (int dj = -1; dj <= 1; ++dj)
+					{
+						int q = changes[k] + di*stride + dj;
+						int i = q/stride;
+						int j = q - i*stride;
+						if ((1 > i) || (rows < i) || (1 > j) || (cols < j))
+							continue;
+						for (int t = 0; t < n; ++t)
+						{
+							if (dirty[q] & (1 << t))
+								continue;
+							dirty[q] |= 1 << t;
+							lists[t].push_back(q);
+						}
+					}
+				}
+			}
+			changed = changed || !changes.empty();
+		}
+		rounds++;
+	}
+
+	for (int i = 0; i < rows; ++i)
+		memcpy(bin.ptr<uchar>(i), buf.ptr<uchar>(i + 1) + 1, cols);
+	return rounds;
+}
+
+Mat
+LauraBinary::thin(Mat& img)
+{
+	assert((CV_32F == img.type()) || (CV_8U == img.type()));
+	int rows = img.rows;
+	int cols = img.cols;
+	Mat bin = LauraMemory::create(rows, cols, CV_8U);
+	Mat ret = LauraMemory::zeros(rows, cols, img.type());
+	for (int i = 0; i < rows; ++i)
+	{
+		uchar* b = bin.ptr<uchar>(i);
+		for (int j = 0; j < cols; ++j)
+			b[j] = (CV_8U == img.type()) ? (0 != img.ptr<uchar>(i)[j]) :
+				(0 != img.ptr<float>(i)[j]);
+	}
+
+	uchar first[TABLE_SIZE];
+	uchar second[TABLE_SIZE];
+	thinningTables(first, second);
+	std::vector<const uchar*> tables;
+	tables.push_back(first);
+	tables.push_back(second);
+	iterate(bin, tables, 0);
+
+	//The skeleton keeps the values it had.
+	size_t esize = img.elemSize();
+	for (int i = 0; i < rows; ++i)
+	{
+		const uchar* b = bin.ptr<uchar>(i);
+		const uchar* src = img.ptr<uchar>(i);
+		uchar* dst = ret.ptr<uchar>(i);
+		for (int j = 0; j < cols; ++j)
+			if (b[j])
+				memcpy(dst + j*esize, src + j*esize, esize);
+	}
+	return ret;
+}
@@ -0,0 +1,89 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef __LAURABINARY_H__
+#define __LAURABINARY_H__
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+using cv::Mat;
+
+//Binary morphology on 3x3 neighborhoods by table lookup.
+//Each neighborhood is packed into a 9-bit code and looked up in
+//a 512-entry table giving the new value of its center, so an
+//operation costs one lookup per pixel however many entries its
+//structuring elements compare.
+//Iterated operations (thinning) keep a worklist of the pixels
+//next to ones that changed; after the first pass only those are
+//looked at again, so the cost follows the pixels that change,
+//not the number of passes times the image size.
+class LauraBinary
+{
+public:
+	LauraBinary();
+	~LauraBinary();
+
+	//Number of entries in a table.
+	enum { TABLE_SIZE = 512 };
+
+	//Code of the neighborhood around p, in an 8-bit image of
+	//0s and 1s whose rows are stride bytes apart. The pixel at
+	//row r, column c of the neighborhood (0 to 2, top left
+	//first) is bit 3*c + r, so bit 4 is the center, and moving
+	//one pixel right is (code >> 3) | (next column << 6).
+	static int code(const uchar* p, int stride);
+
+	/**** Tables ****/
+	//The table of LauraConvolution::hitAndMiss with the 3x3
+	//element filter: 0 and 1 must match, anything else is
+	//blank, and the center flips where everything matches.
+	static void hitAndMissTable(Mat& filter, uchar* table);
+	//The tables of the two subiterations of Zhang-Suen thinning.
+	//A foreground pixel is removed if it has 2 to 6 foreground
+	//neighbors, they form one 8-connected run around it, and it
+	//lies on the south-east boundary (first) or the north-west
+	//boundary (second).
+	static void thinningTables(uchar* first, uchar* second);
+
+	/**** Operations ****/
+	//Applies table to each pixel of img (CV_32F or CV_8U; any
+	//nonzero value is 1), mirror-padded as in
+	//LauraConvolution::addMirroredBoundaries. Returns CV_32F
+	//0s and 1s.
+	static Mat apply(Mat& img, const uchar* table);
+	//Same result as LauraConvolution::hitAndMiss(img, filter)
+	//for a 3x3 filter and an image of 0s and 1s.
+	static Mat hitAndMiss(Mat& img, Mat& filter);
+
+	//Applies the tables in turn, each to the whole image at once
+	//(every pixel sees the image as it was before that table),
+	//until a round of all of them changes nothing or
+	//maxIterations rounds have run (0: no limit).
+	//bin is CV_8U 0s and 1s, changed in place. Pixels past the
+	//edges count as 0. Returns the number of rounds run.
+	static int iterate(Mat& bin, const std::vector<const uchar*>& tables,
+		int maxIterations);
+	//Thins the foreground (nonzero pixels) of img (CV_32F or
+	//CV_8U) to 8-connected lines one pixel wide, by Zhang-Suen.
+	//Pixels of the skeleton keep their values; the rest are 0.
+	static Mat thin(Mat& img);
+};
+
+#endif //!defined __LAURABINARY_H__
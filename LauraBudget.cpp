@@ -0,0 +1,268 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "LauraBudget.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+//Weight of a new timing in a stage's cost. Costs follow changes
+//in load within a few runs without jumping on every outlier.
+#define LAURABUDGET_WEIGHT 0.25
+//Seconds after which choose() starts to discount the cost of a
+//stage that has not been timed again, halving it every as many.
+#define LAURABUDGET_HALFLIFE 5.0
+
+//Whether a and b are the same configuration.
+static bool
+sameConfig(const LauraBudget::Config& a, const LauraBudget::Config& b)
+{
+	return (a.scale == b.scale) && (a.ksize == b.ksize) &&
+		(a.box == b.box);
+}
+
+LauraBudget::Timer::Timer(LauraBudget* budget, const std::string& key,
+	double pixels):
+	budget(budget), key(key), pixels(pixels), start(cv::getTickCount())
+{
+
+}
+
+LauraBudget::Timer::~Timer()
+{
+	if (budget)
+		budget->record(key, (cv::getTickCount() - start)/
+			cv::getTickFrequency(), pixels);
+}
+
+LauraBudget::LauraBudget():
+	lastPredicted(0), lastSeconds(0)
+{
+	last = ladder("canny")[0];
+}
+
+LauraBudget::~LauraBudget()
+{
+
+}
+
+std::string
+LauraBudget::key(const std::string& stage, int ksize)
+{
+	char k[16];
+	snprintf(k, sizeof(k), " %d", ksize);
+	return stage + k;
+}
+
+double
+LauraBudget::aged(const Cost& c, int64 now)
+{
+	if (0 == now)
+		return c.perPixel;
+	double age = (now - c.ticks)/cv::getTickFrequency();
+	if (LAURABUDGET_HALFLIFE >= age)
+		return c.perPixel;
+	return c.perPixel*pow(0.5, (age - LAURABUDGET_HALFLIFE)/
+		LAURABUDGET_HALFLIFE);
+}
+
+void
+LauraBudget::record(const std::string& key, double seconds,
+	double pixels)
+{
+	if (0 >= pixels)
+		return;
+	double cost = seconds/pixels;
+	int64 now = cv::getTickCount();
+	std::map<std::string, Cost>::iterator it = costs.find(key);
+	if (costs.end() == it)
+	{
+		Cost c = {cost, now};
+		costs[key] = c;
+	}
+	else
+	{
+		it->second.perPixel += LAURABUDGET_WEIGHT*
+			(cost - it->second.perPixel);
+		it->second.ticks = now;
+	}
+}
+
+double
+LauraBudget::predict(const std::string& key, double pixels) const
+{
+	return predict(key, pixels, 0);
+}
+
+double
+LauraBudget::predict(const std::string& key, double pixels,
+	int64 now) const
+{
+	std::map<std::string, Cost>::const_iterator it = costs.find(key);
+	if (costs.end() != it)
+		return aged(it->second, now)*pixels;
+
+	//The same stage timed with the nearest kernel size, scaled.
+	size_t space = key.rfind(' ');
+	if (std::string::npos == space)
+		return 0;
+	std::string stage = key.substr(0, space + 1);
+	int ksize = atoi(key.c_str() + space + 1);
+	double best = 0;
+	int bestSize = 0;
+	for (it = costs.begin(); costs.end() != it; ++it)
+	{
+		if (0 != it->first.compare(0, stage.size(), stage))
+			continue;
+		int k = atoi(it->first.c_str() + stage.size());
+		if ((0 < k) && ((0 == bestSize) ||
+			(abs(k - ksize) < abs(bestSize - ksize))))
+		{
+			best = aged(it->second, now);
+			bestSize = k;
+		}
+	}
+	if (0 == bestSize)
+		return 0;
+	return best*ksize/bestSize*pixels;
+}
+
+std::vector<LauraBudget::Config>
+LauraBudget::ladder(const std::string& name)
+{
+	//scale, ksize, box.
+	static const Config canny[] = {
+		{1, 7, false}, {1, 5, false}, {1, 3, false},
+		{2, 5, false}, {2, 3, false}, {4, 3, false}};
+	static const Config harris[] = {
+		{1, 9, false}, {1, 5, false}, {1, 5, true},
+		{2, 5, true}, {4, 3, true}};
+	static const Config logEdge[] = {
+		{1, 13, false}, {1, 9, false}, {2, 9, false},
+		{2, 7, false}, {4, 5, false}};
+	if ("harris" == name)
+		return std::vector<Config>(harris,
+			harris + sizeof(harris)/sizeof(harris[0]));
+	if ("logEdge" == name)
+		return std::vector<Config>(logEdge,
+			logEdge + sizeof(logEdge)/sizeof(logEdge[0]));
+	return std::vector<Config>(canny,
+		canny + sizeof(canny)/sizeof(canny[0]));
+}
+
+std::vector<std::pair<std::string, double> >
+LauraBudget::stages(const std::string& name, const Config& c, int rows,
+	int cols)
+{
+	std::vector<std::pair<std::string, double> > ret;
+	double full = (double) rows*cols;
+	//Sizes rounded up, as LauraIngest::convert makes them.
+	double pixels = (double) ((rows + c.scale - 1)/c.scale)*
+		((cols + c.scale - 1)/c.scale);
+	if (1 < c.scale)
+		ret.push_back(std::make_pair(std::string("downscale"), full));
+	if ("canny" == name)
+	{
+		ret.push_back(std::make_pair(key("canny.graph", c.ksize), pixels));
+		ret.push_back(std::make_pair(std::string("canny.hysteresis"),
+			pixels));
+	}
+	else if ("harris" == name)
+	{
+		ret.push_back(std::make_pair(key(c.box ? "harris.smooth box" :
+			"harris.smooth gaussian", c.ksize), pixels));
+		ret.push_back(std::make_pair(key("harris.opening", c.ksize),
+			pixels));
+		ret.push_back(std::make_pair(std::string("harris.corners"),
+			pixels));
+	}
+	else if ("logEdge" == name)
+		ret.push_back(std::make_pair(key("log", c.ksize), pixels));
+	if (1 < c.scale)
+		ret.push_back(std::make_pair(std::string("upscale"), full));
+	return ret;
+}
+
+double
+LauraBudget::predict(const std::string& name, const Config& c, int rows,
+	int cols) const
+{
+	return predict(name, c, rows, cols, 0);
+}
+
+double
+LauraBudget::predict(const std::string& name, const Config& c, int rows,
+	int cols, int64 now) const
+{
+	std::vector<std::pair<std::string, double> > s =
+		stages(name, c, rows, cols);
+	double ret = 0;
+	for (size_t k = 0; k < s.size(); ++k)
+		ret += predict(s[k].first, s[k].second, now);
+	return ret;
+}
+
+LauraBudget::Config
+LauraBudget::choose(const std::string& name, int rows, int cols,
+	double seconds)
+{
+	//The configuration being measured is taken at its costs; the
+	//others at their aged costs, so that once load has passed
+	//the better ones are tried and timed again.
+	std::vector<Config> configs = ladder(name);
+	int64 now = cv::getTickCount();
+	size_t k = 0;
+	double predicted = predict(name, configs[0], rows, cols,
+		sameConfig(configs[0], last) ? 0 : now);
+	while ((predicted > seconds) && (k + 1 < configs.size()))
+	{
+		++k;
+		predicted = predict(name, configs[k], rows, cols,
+			sameConfig(configs[k], last) ? 0 : now);
+	}
+	last = configs[k];
+	lastPredicted = predicted;
+	lastSeconds = 0;
+	return last;
+}
+
+void
+LauraBudget::finish(double seconds)
+{
+	lastSeconds = seconds;
+}
+
+std::string
+LauraBudget::describe(const Config& c)
+{
+	char ret[64];
+	snprintf(ret, sizeof(ret), "scale=%d kernel=%d%s", c.scale, c.ksize,
+		c.box ? " smooth=box" : "");
+	return ret;
+}
+
+std::string
+LauraBudget::report() const
+{
+	char times[64];
+	snprintf(times, sizeof(times), " predicted_ms=%.1f ms=%.1f",
+		1000*lastPredicted, 1000*lastSeconds);
+	return describe(last) + times;
+}
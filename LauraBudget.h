@@ -0,0 +1,121 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef __LAURABUDGET_H__
+#define __LAURABUDGET_H__
+
+#include <opencv2/opencv.hpp>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+//Picks how to run a pipeline so that it fits a time budget.
+//Each pipeline has a ladder of configurations, best first and
+//each cheaper than the one before: smaller smoothing or LoG
+//kernels (keeping the default's ratio of sigma to size), box
+//instead of Gaussian smoothing, and working at 1/2 or 1/4 of the
+//image size. The stages a configuration runs are timed as it
+//runs, and their costs per pixel kept, so the next choice is the
+//best configuration whose stages are expected to fit.
+//A stage never timed is estimated from the same stage with
+//another kernel size, in proportion to the size, or else taken
+//to be free, so it is tried and timed.
+//When choosing, the cost of a stage not timed for a few seconds
+//is discounted more the longer it goes, except for the
+//configuration last chosen. Once a spell of load has passed the
+//better configurations are tried again, rather than left for
+//the ones that fitted then.
+//Not thread safe; use one per worker (see LauraJobs::Workspace).
+class LauraBudget
+{
+public:
+	struct Config
+	{
+		int scale; //Works at 1/scale of the image size.
+		int ksize; //Smoothing (Gaussian or box) or LoG kernel size.
+		bool box;  //Box instead of Gaussian smoothing (harris).
+	};
+	//Times a stage from construction to destruction and records
+	//it in budget, if that is not NULL.
+	class Timer
+	{
+		LauraBudget* budget;
+		std::string key;
+		double pixels;
+		int64 start;
+	public:
+		Timer(LauraBudget* budget, const std::string& key, double pixels);
+		~Timer();
+	};
+private:
+	struct Cost
+	{
+		double perPixel; //Seconds per pixel.
+		int64 ticks;     //When it was last timed.
+	};
+	std::map<std::string, Cost> costs; //By stage.
+	//c, discounted if it was timed long enough before now
+	//(0: as it is).
+	static double aged(const Cost& c, int64 now);
+	//The predictions below, with costs aged to now.
+	double predict(const std::string& key, double pixels,
+		int64 now) const;
+	double predict(const std::string& name, const Config& c, int rows,
+		int cols, int64 now) const;
+	Config last;
+	double lastPredicted;
+	double lastSeconds;
+public:
+	LauraBudget();
+	~LauraBudget();
+
+	//The key of stage with kernel size ksize ("harris.opening 9").
+	static std::string key(const std::string& stage, int ksize);
+	//Records that stage key took seconds on pixels pixels.
+	void record(const std::string& key, double seconds, double pixels);
+	//Seconds stage key is expected to take on pixels pixels.
+	double predict(const std::string& key, double pixels) const;
+
+	//The configurations of pipeline name ("canny", "harris" or
+	//"logEdge"), best first; the first is what runs unbudgeted.
+	static std::vector<Config> ladder(const std::string& name);
+	//The stages c runs for name on a rows x cols image, with the
+	//number of pixels each works on.
+	static std::vector<std::pair<std::string, double> > stages(
+		const std::string& name, const Config& c, int rows, int cols);
+	//Seconds c is expected to take, the sum of its stages.
+	double predict(const std::string& name, const Config& c, int rows,
+		int cols) const;
+	//The first configuration on the ladder expected to fit in
+	//seconds, or the last if none is.
+	Config choose(const std::string& name, int rows, int cols,
+		double seconds);
+	//Records that the configuration last chosen took seconds.
+	void finish(double seconds);
+
+	//c as "scale=2 kernel=5 smooth=box".
+	static std::string describe(const Config& c);
+	//The configuration last chosen, with the time it was
+	//expected to take and took: "<describe> predicted_ms=x ms=y".
+	std::string report() const;
+};
+
+#endif //!defined __LAURABUDGET_H__
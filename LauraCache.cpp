@@ -0,0 +1,263 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "LauraCache.h"
+#include "LauraMemory.h"
+#include "LauraRaw.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+
+//Size limit without $LAURA_CACHE_MB, in megabytes.
+#define LAURACACHE_MB 1024
+
+namespace
+{
+//Folds the 8 bytes v into the hash h.
+inline uint64_t
+mix(uint64_t h, uint64_t v)
+{
+	h ^= v*0x9e3779b97f4a7c15ULL;
+	h = (h << 31) | (h >> 33);
+	return h*0xbf58476d1ce4e5b9ULL;
+}
+
+//Folds n bytes at p into h, 8 at a time.
+uint64_t
+mixBytes(uint64_t h, const uchar* p, size_t n)
+{
+	size_t k = 0;
+	for (; k + 8 <= n; k += 8)
+	{
+		uint64_t v;
+		memcpy(&v, p + k, 8);
+		h = mix(h, v);
+	}
+	uint64_t tail = 0;
+	memcpy(&tail, p + k, n - k);
+	return mix(h, tail ^ n);
+}
+
+//The time of st's last modification, in seconds.
+double
+modified(const struct stat& st)
+{
+	return st.st_mtim.tv_sec + 1e-9*st.st_mtim.tv_nsec;
+}
+
+//Now, in seconds, on the same clock as modified().
+double
+now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_REALTIME, &t);
+	return t.tv_sec + 1e-9*t.tv_nsec;
+}
+}
+
+LauraCache::LauraCache(const char* dir, size_t maxBytes,
+	bool intermediates):
+	maxBytes(maxBytes), keepIntermediates(intermediates), bytes(0),
+	hitCount(0), missCount(0)
+{
+	if (dir)
+		this->dir = dir;
+	else if (getenv("LAURA_CACHE"))
+		this->dir = getenv("LAURA_CACHE");
+	if (0 == this->maxBytes)
+	{
+		const char* mb = getenv("LAURA_CACHE_MB");
+		this->maxBytes = ((mb && (0 < atol(mb))) ? atol(mb) :
+			LAURACACHE_MB)*(size_t) 1048576;
+	}
+	if (!keepIntermediates)
+		keepIntermediates = (NULL != getenv("LAURA_CACHE_INTERMEDIATE"));
+	if (this->dir.empty())
+		return;
+
+	//What is already there, by when it was last used.
+	mkdir(this->dir.c_str(), 0755);
+	DIR* d = opendir(this->dir.c_str());
+	if (!d)
+	{
+		this->dir.clear();
+		return;
+	}
+	while (struct dirent* e = readdir(d))
+	{
+		std::string name = e->d_name;
+		struct stat st;
+		if (!LauraRaw::isRaw(name) ||
+			(0 != stat((this->dir + "/" + name).c_str(), &st)))
+			continue;
+		Entry& entry = entries[name];
+		entry.used = modified(st);
+		entry.bytes = st.st_size;
+		bytes += entry.bytes;
+	}
+	closedir(d);
+	evict();
+}
+
+LauraCache::~LauraCache()
+{
+
+}
+
+bool
+LauraCache::enabled() const
+{
+	return !dir.empty();
+}
+
+bool
+LauraCache::intermediates() const
+{
+	return keepIntermediates;
+}
+
+uint64_t
+LauraCache::hash(const Mat& img)
+{
+	uint64_t h = mix(mix(0, img.rows), ((uint64_t) img.cols << 32) |
+		(uint32_t) img.type());
+	size_t rowBytes = img.cols*img.elemSize();
+	for (int i = 0; i < img.rows; ++i)
+		h = mixBytes(h, img.ptr(i), rowBytes);
+	return h;
+}
+
+std::string
+LauraCache::key(const Mat& img, const std::string& params)
+{
+	uint64_t h = mixBytes(hash(img), (const uchar*) params.data(),
+		params.size());
+	char ret[17];
+	snprintf(ret, sizeof(ret), "%016llx", (unsigned long long) h);
+	return ret;
+}
+
+std::string
+LauraCache::path(const std::string& key, const std::string& part) const
+{
+	return dir + "/" + key + "." + part + ".lraw";
+}
+
+Mat
+LauraCache::get(const std::string& key, const std::string& part)
+{
+	if (!enabled())
+		return Mat();
+	std::string file = path(key, part);
+	LauraRaw raw;
+	Mat img = raw.load(file);
+	std::lock_guard<std::mutex> guard(lock);
+	std::map<std::string, Entry>::iterator it =
+		entries.find(key + "." + part + ".lraw");
+	if (!img.data)
+	{
+		//Evicted by another process, or never there.
+		if (entries.end() != it)
+		{
+			bytes -= it->second.bytes;
+			entries.erase(it);
+		}
+		missCount++;
+		return Mat();
+	}
+	hitCount++;
+	utimensat(AT_FDCWD, file.c_str(), NULL, 0);
+	if (entries.end() != it)
+		it->second.used = now();
+	//Copied out, as the mapping goes with raw.
+	return LauraMemory::clone(img);
+}
+
+void
+LauraCache::put(const std::string& key, const std::string& part, Mat& img)
+{
+	if (!enabled() || !img.data)
+		return;
+	//Written aside and renamed into place, so that no reader
+	//sees half a file.
+	std::string file = path(key, part);
+	char tmp[64];
+	snprintf(tmp, sizeof(tmp), ".tmp%d.%lu", (int) getpid(),
+		(unsigned long) std::hash<std::thread::id>()(
+		std::this_thread::get_id()));
+	struct stat st;
+	if (!LauraRaw::save(file + tmp, img) ||
+		(0 != stat((file + tmp).c_str(), &st)) ||
+		(0 != rename((file + tmp).c_str(), file.c_str())))
+	{
+		unlink((file + tmp).c_str());
+		return;
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+	std::string name = key + "." + part + ".lraw";
+	std::map<std::string, Entry>::iterator it = entries.find(name);
+	if (entries.end() != it)
+		bytes -= it->second.bytes;
+	Entry& entry = entries[name];
+	entry.used = now();
+	entry.bytes = st.st_size;
+	bytes += entry.bytes;
+	evict();
+}
+
+void
+LauraCache::evict()
+{
+	while ((bytes > maxBytes) && !entries.empty())
+	{
+		std::map<std::string, Entry>::iterator oldest = entries.begin();
+		std::map<std::string, Entry>::iterator it = entries.begin();
+		for (++it; entries.end() != it; ++it)
+		{
+			if (it->second.used < oldest->second.used)
+				oldest = it;
+		}
+		unlink((dir + "/" + oldest->first).c_str());
+		bytes -= oldest->second.bytes;
+		entries.erase(oldest);
+	}
+}
+
+unsigned long
+LauraCache::hits()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return hitCount;
+}
+
+unsigned long
+LauraCache::misses()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return missCount;
+}
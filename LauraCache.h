@@ -0,0 +1,92 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef __LAURACACHE_H__
+#define __LAURACACHE_H__
+
+#include <opencv2/opencv.hpp>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+using cv::Mat;
+
+//On-disk cache of pipeline results, so that a duplicate image
+//run through the same pipeline with the same parameters costs a
+//file map instead of the convolutions.
+//Results are keyed by a hash of the decoded pixels and of the
+//full parameter set (see LauraJobs::describe), and stored in the
+//cache directory as raw images (see LauraRaw), one file per part:
+//	<key>.<part>.lraw
+//where part is "result" or the name of an intermediate image.
+//Files past the size limit are evicted least recently used
+//first; a hit touches its file, so the order survives restarts.
+//Thread safe.
+class LauraCache
+{
+	struct Entry
+	{
+		double used;  //Last use, in seconds since the epoch.
+		size_t bytes;
+	};
+
+	std::string dir;
+	size_t maxBytes;
+	bool keepIntermediates;
+	std::mutex lock; //Guards everything below.
+	std::map<std::string, Entry> entries; //By file name.
+	size_t bytes;
+	unsigned long hitCount;
+	unsigned long missCount;
+
+	std::string path(const std::string& key, const std::string& part) const;
+	//Drops the least recently used files until the cache fits.
+	void evict();
+public:
+	//dir is the cache directory; NULL picks $LAURA_CACHE, and
+	//with neither the cache is off. maxBytes limits its size;
+	//0 picks $LAURA_CACHE_MB megabytes, or 1024. intermediates
+	//also keeps the intermediate images; false picks whether
+	//$LAURA_CACHE_INTERMEDIATE is set.
+	LauraCache(const char* dir, size_t maxBytes, bool intermediates);
+	~LauraCache();
+
+	//Whether there is a cache directory.
+	bool enabled() const;
+	//Whether intermediate images are kept along with results.
+	bool intermediates() const;
+
+	//A fast 64 bit hash of img's size, type and pixels.
+	static uint64_t hash(const Mat& img);
+	//The key of img run with params, a full description of the
+	//pipeline and its parameters.
+	static std::string key(const Mat& img, const std::string& params);
+
+	//Part of the result cached under key, in a new Mat; empty if
+	//there is none.
+	Mat get(const std::string& key, const std::string& part);
+	//Caches img as part of the result under key.
+	void put(const std::string& key, const std::string& part, Mat& img);
+
+	unsigned long hits();
+	unsigned long misses();
+};
+
+#endif //!defined __LAURACACHE_H__
@@ -19,10 +19,230 @@
 //SOFTWARE.
 
 #include "LauraConvolution.h"
+#include "LauraBatch.h"
+#include "LauraCounters.h"
+#include "LauraFilters.h"
+#include "LauraHalf.h"
+#include "LauraMemory.h"
 #include <assert.h>
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
 using cv::Range;
 using cv::Mat_;
 
+//Columns per stripe in the vertical morphology pass.
+#define MORPHOLOGY_STRIPE 64
+//Cache sizes to assume when the system does not say.
+#define L1_CACHE_FALLBACK (32*1024)
+#define L2_CACHE_FALLBACK (256*1024)
+
+//What the batch convolutions hand to each work item.
+struct BatchConvolveArgs
+{
+	std::vector<Mat>* imgs;
+	std::vector<Mat>* dsts;
+	Mat filter;
+	//The largest image, for sizing the scratch.
+	int rows;
+	int cols;
+	int channels;
+};
+
+//Scratch for a work item of the batch convolutions, sized for
+//the largest image.
+static void*
+batchConvolveBegin(void* varargs)
+{
+	BatchConvolveArgs* a = (BatchConvolveArgs*) varargs;
+	LauraConvolution::StencilScratch* scratch =
+		new LauraConvolution::StencilScratch;
+	LauraConvolution::stencilScratch(a->filter, a->rows, a->cols,
+		a->channels, *scratch);
+	return (void*) scratch;
+}
+
+static void
+batchConvolveEnd(void* scratch)
+{
+	delete (LauraConvolution::StencilScratch*) scratch;
+}
+
+//Work item function for the batch convolutions.
+static void
+batchConvolveFunc(int k, int rowStart, int rowEnd, void* varargs,
+	void* scratch)
+{
+	BatchConvolveArgs* a = (BatchConvolveArgs*) varargs;
+	if ((*a->dsts)[k].empty())
+		return; //A colour image with half results.
+	LauraConvolution::convolveBand((*a->imgs)[k], a->filter,
+		(*a->dsts)[k], rowStart, rowEnd,
+		*(LauraConvolution::StencilScratch*) scratch);
+}
+
+//Sets up a for convolving imgs into dsts with filter.
+static void
+batchConvolveArgs(std::vector<Mat>& imgs, std::vector<Mat>& dsts,
+	Mat& filter, BatchConvolveArgs& a)
+{
+	a.imgs = &imgs;
+	a.dsts = &dsts;
+	filter.convertTo(a.filter, CV_32F); //Continuous float, once.
+	a.rows = 0;
+	a.cols = 0;
+	a.channels = 1;
+	for (size_t k = 0; k < imgs.size(); ++k)
+	{
+		a.rows = std::max(a.rows, imgs[k].rows);
+		a.cols = std::max(a.cols, imgs[k].cols);
+		a.channels = std::max(a.channels, imgs[k].channels());
+	}
+}
+
+//dst = min (or max) of a and b, over n floats.
+static inline void
+extremeRow(const float* a, const float* b, int n, bool dilate,
+	float* dst)
+{
+	if (dilate)
+		for (int j = 0; j < n; ++j) dst[j] = std::max(a[j], b[j]);
+	else
+		for (int j = 0; j < n; ++j) dst[j] = std::min(a[j], b[j]);
+}
+
+//Van Herk/Gil-Werman running min (or max) of k samples.
+//g holds n + k - 1 padded samples of w floats each; sample i of
+//out is the min of samples i to i + k - 1 of g.
+//g is cut into blocks of k samples, with running mins forward
+//through each block in pre and backward in suf. Any k samples
+//span at most two blocks, so out[i] = min(suf[i], pre[i + k - 1]).
+static void
+vanHerk(const float* g, int n, int k, int w, bool dilate,
+	float* pre, float* suf, float* out)
+{
+	int len = n + k - 1;
+	for (int b = 0; b < len; b += k)
+	{
+		int e = std::min(b + k, len);
+		memcpy(pre + b*w, g + b*w, w*sizeof(float));
+		for (int i = b + 1; i < e; ++i)
+			extremeRow(pre + (i - 1)*w, g + i*w, w, dilate, pre + i*w);
+		memcpy(suf + (e - 1)*w, g + (e - 1)*w, w*sizeof(float));
+		for (int i = e - 2; i >= b; --i)
+			extremeRow(suf + (i + 1)*w, g + i*w, w, dilate, suf + i*w);
+	}
+	for (int i = 0; i < n; ++i)
+		extremeRow(suf + i*w, pre + (i + k - 1)*w, w, dilate, out + i*w);
+}
+
+//Loop body for LauraConvolution::morphologyLine.
+//The range is of rows, column stripes or diagonals,
+//depending on the direction.
+class MorphologyBody : public cv::ParallelLoopBody
+{
+	Mat& src;
+	Mat& dst;
+	int k;
+	int direction;
+	bool dilate;
+
+	//Start and length of diagonal d.
+	void diagonal(int d, int* i0, int* j0, int* len) const
+	{
+		int rows = src.rows;
+		int cols = src.cols;
+		if (LauraConvolution::LINE_DIAGONAL == direction)
+		{
+			*i0 = (rows > d) ? rows - 1 - d : 0;
+			*j0 = (rows > d) ? 0 : d - rows + 1;
+			*len = std::min(rows - *i0, cols - *j0);
+		}
+		else
+		{
+			*i0 = (cols > d) ? 0 : d - cols + 1;
+			*j0 = (cols > d) ? d : cols - 1;
+			*len = std::min(rows - *i0, *j0 + 1);
+		}
+	}
+public:
+	MorphologyBody(Mat& src, Mat& dst, int k, int direction,
+		bool dilate)
+		: src(src), dst(dst), k(k), direction(direction),
+		  dilate(dilate)
+	{
+
+	}
+
+	virtual void operator()(const Range& range) const
+	{
+		int rows = src.rows;
+		int cols = src.cols;
+		int left = k/2;
+		int right = k - left - 1;
+
+		if (LauraConvolution::LINE_VERTICAL == direction)
+		{
+			//Whole stripes of row segments at a time, so the
+			//inner loops run along rows.
+			int w = MORPHOLOGY_STRIPE;
+			std::vector<float> g((rows + k - 1)*w);
+			std::vector<float> pre(g.size());
+			std::vector<float> suf(g.size());
+			std::vector<float> out(rows*w);
+			for (int s = range.start; s < range.end; ++s)
+			{
+				int c0 = s*MORPHOLOGY_STRIPE;
+				w = std::min(MORPHOLOGY_STRIPE, cols - c0);
+				for (int p = -left; p < rows + right; ++p)
+				{
+					int srcRow = LauraConvolution::mirrorIndex(p, rows);
+					memcpy(&g[(p + left)*w], src.ptr<float>(srcRow) + c0,
+						w*sizeof(float));
+				}
+				vanHerk(&g[0], rows, k, w, dilate, &pre[0], &suf[0],
+					&out[0]);
+				for (int i = 0; i < rows; ++i)
+					memcpy(dst.ptr<float>(i) + c0, &out[i*w],
+						w*sizeof(float));
+			}
+			return;
+		}
+
+		int n = std::max(rows, cols);
+		std::vector<float> line(n);
+		std::vector<float> g(n + k - 1);
+		std::vector<float> pre(g.size());
+		std::vector<float> suf(g.size());
+		std::vector<float> out(n);
+		for (int r = range.start; r < range.end; ++r)
+		{
+			if (LauraConvolution::LINE_HORIZONTAL == direction)
+			{
+				LauraConvolution::padRow(src.ptr<float>(r), cols,
+					left, right, &g[0]);
+				vanHerk(&g[0], cols, k, 1, dilate, &pre[0], &suf[0],
+					dst.ptr<float>(r));
+				continue;
+			}
+
+			//Diagonals are gathered into a line and scattered back.
+			int i0, j0, len;
+			diagonal(r, &i0, &j0, &len);
+			int dj = (LauraConvolution::LINE_DIAGONAL == direction) ?
+				1 : -1;
+			for (int t = 0; t < len; ++t)
+				line[t] = src.ptr<float>(i0 + t)[j0 + dj*t];
+			LauraConvolution::padRow(&line[0], len, left, right, &g[0]);
+			vanHerk(&g[0], len, k, 1, dilate, &pre[0], &suf[0], &out[0]);
+			for (int t = 0; t < len; ++t)
+				dst.ptr<float>(i0 + t)[j0 + dj*t] = out[t];
+		}
+	}
+};
+
 LauraConvolution::LauraConvolution()
 {
 
@@ -39,6 +259,8 @@ LauraConvolution::convolutionEngine(Mat& img, Mat& filter,
 	float (*func) (Mat& inhood, Mat& filter, Range xidx, Range yidx, 
 	void* varargs))
 {
+	LauraCounters::Stage counters("convolutionEngine",
+		(double) img.total());
 	//If you passed a filter under 3x3, you get a 
 	//3x3 mean filter. Sorry.
 	if ((filter.rows < 3) & (filter.cols < 3))
@@ -63,7 +285,7 @@ LauraConvolution::convolutionEngine(Mat& img, Mat& filter,
 
 	//Make conv output matrix.
 	//Mat_ is templated Mat for element-wise ops
-	Mat imgConv = Mat::zeros(imgMir.rows, imgMir.cols, CV_32F);
+	Mat imgConv = LauraMemory::zeros(imgMir.rows, imgMir.cols, CV_32F);
 	Mat_<float> imgConv_ = imgConv;
 
 	//Perform the filtering
@@ -137,7 +359,7 @@ LauraConvolution::addMirroredBoundaries(
 	//Create new matrix.
 	int rows = img.rows;
 	int cols = img.cols;
-	Mat ret = Mat::zeros(rows + top + bottom, 
+	Mat ret = LauraMemory::zeros(rows + top + bottom, 
 		cols + left + right, CV_32F);
 	int mrows = rows + top + bottom;
 	int mcols = cols + left + right;
@@ -191,11 +413,887 @@ LauraConvolution::removeBoundaries(Mat& img,
 Mat
 LauraConvolution::convolve(Mat& img, Mat& filter)
 {
+	//convolutionEngine only handles one channel.
+	if (1 < img.channels())
+		return convolve(img, filter, CV_32F);
 	return convolutionEngine(img, filter, NULL, convFunc);
 }
 
+Mat
+LauraConvolution::convolve(Mat& img, Mat& filter, int type)
+{
+	//Half storage is one channel only.
+	if ((LauraHalf::TYPE == CV_MAKETYPE(CV_MAT_DEPTH(type), 1)) &&
+		(1 < img.channels()))
+		return Mat();
+	Mat ret = LauraMemory::create(img.rows, img.cols,
+		CV_MAKETYPE(CV_MAT_DEPTH(type), img.channels()));
+	convolveBand(img, filter, ret, 0, img.rows);
+	return ret;
+}
+
+std::vector<Mat>
+LauraConvolution::convolve(std::vector<Mat>& imgs, Mat& filter)
+{
+	return convolve(imgs, filter, CV_32F);
+}
+
+std::vector<Mat>
+LauraConvolution::convolve(std::vector<Mat>& imgs, Mat& filter,
+	int type)
+{
+	//Each result has as many channels as its image. Half storage
+	//is one channel only, so colour images get no half result.
+	bool half = (LauraHalf::TYPE == CV_MAKETYPE(CV_MAT_DEPTH(type), 1));
+	std::vector<int> types;
+	for (size_t k = 0; k < imgs.size(); ++k)
+		types.push_back(CV_MAKETYPE(CV_MAT_DEPTH(type),
+			imgs[k].channels()));
+	std::vector<Mat> dsts = LauraBatch::allocate(imgs, types);
+	for (size_t k = 0; k < imgs.size(); ++k)
+	{
+		if (half && (1 < imgs[k].channels()))
+			dsts[k].release();
+	}
+
+	BatchConvolveArgs a;
+	batchConvolveArgs(imgs, dsts, filter, a);
+	LauraBatch::run(imgs, batchConvolveFunc, batchConvolveBegin,
+		batchConvolveEnd, (void*) &a);
+
+	return dsts;
+}
+
+Mat
+LauraConvolution::convolveStacked(Mat& stack, int n, Mat& filter)
+{
+	std::vector<Mat> imgs = LauraBatch::unstack(stack, n);
+	Mat ret = LauraMemory::create(stack.rows, stack.cols,
+		CV_MAKETYPE(CV_32F, stack.channels()));
+	std::vector<Mat> dsts = LauraBatch::unstack(ret, n);
+
+	BatchConvolveArgs a;
+	batchConvolveArgs(imgs, dsts, filter, a);
+	LauraBatch::run(imgs, batchConvolveFunc, batchConvolveBegin,
+		batchConvolveEnd, (void*) &a);
+
+	return ret;
+}
+
+void
+LauraConvolution::convolveBand(Mat& img, Mat& filter, Mat& dst,
+	int rowStart, int rowEnd)
+{
+	convolutionStream(img, filter, rowStart, rowEnd,
+		(void*) &dst, storeRowFunc);
+}
+
+void
+LauraConvolution::convolveBand(Mat& img, Mat& filter, Mat& dst,
+	int rowStart, int rowEnd, StencilScratch& scratch)
+{
+	stencilStream(img, filter, rowStart, rowEnd, convolveRow, NULL,
+		storeRowFunc, (void*) &dst, scratch);
+}
+
+void
+LauraConvolution::storeRowFunc(float* row, int i, int cols,
+	void* varargs)
+{
+	Mat* dst = (Mat*) varargs;
+	LauraHalf::storeRow(row, *dst, i);
+}
+
 Mat
 LauraConvolution::hitAndMiss(Mat& img, Mat& filter)
 {
 	return convolutionEngine(img, filter, NULL, hitAndMissFunc);
 }
+
+void
+LauraConvolution::convolutionStream(Mat& img, Mat& filter,
+	void* varargs,
+	void (*func) (float* row, int i, int cols, void* varargs))
+{
+	convolutionStream(img, filter, 0, img.rows, varargs, func);
+}
+
+void
+LauraConvolution::convolutionStream(Mat& img, Mat& filter,
+	int rowStart, int rowEnd, void* varargs,
+	void (*func) (float* row, int i, int cols, void* varargs))
+{
+	stencilStream(img, filter, rowStart, rowEnd, convolveRow,
+		NULL, func, varargs);
+}
+
+void
+LauraConvolution::stencilStream(Mat& img, Mat& filter,
+	int rowStart, int rowEnd,
+	void (*kernel) (const float** rows, Mat& filter, int width,
+		int channels, float* out),
+	void (*load) (float* row, int i, int cols, void* varargs),
+	void (*store) (float* row, int i, int cols, void* varargs),
+	void* varargs)
+{
+	if (rowEnd <= rowStart)
+		return;
+	StencilScratch scratch;
+	stencilScratch(filter, rowEnd - rowStart, img.cols, img.channels(),
+		scratch);
+	stencilStream(img, filter, rowStart, rowEnd, kernel, load, store,
+		varargs, scratch);
+}
+
+void
+LauraConvolution::stencilScratch(Mat& filter, int rows, int cols,
+	int channels, StencilScratch& scratch)
+{
+	int left = filter.cols/2;
+	int right = filter.cols - left - 1;
+
+	//Output rows are made a block of tileRows at a time, and each
+	//block a tile of tileCols columns at a time, so the padded
+	//rows under one tile stay in cache while all of its rows are
+	//computed, however wide the image is.
+	tileSize(filter, cols, channels, &scratch.tileRows,
+		&scratch.tileCols);
+	scratch.tileRows = std::max(1, std::min(scratch.tileRows, rows));
+
+	int slots = scratch.tileRows + filter.rows - 1;
+	scratch.ring = LauraMemory::create(slots,
+		(cols + left + right)*channels, CV_32F);
+	//For converting or modifying rows.
+	scratch.line = LauraMemory::create(1, cols*channels, CV_32F);
+	scratch.out = LauraMemory::create(scratch.tileRows, cols*channels,
+		CV_32F);
+	scratch.window.resize(filter.rows);
+}
+
+void
+LauraConvolution::stencilStream(Mat& img, Mat& filter,
+	int rowStart, int rowEnd,
+	void (*kernel) (const float** rows, Mat& filter, int width,
+		int channels, float* out),
+	void (*load) (float* row, int i, int cols, void* varargs),
+	void (*store) (float* row, int i, int cols, void* varargs),
+	void* varargs, StencilScratch& scratch)
+{
+	int rows = img.rows;
+	int cols = img.cols;
+	int left = filter.cols/2;
+	int right = filter.cols - left - 1;
+	int top = filter.rows/2;
+	int bottom = filter.rows - top - 1;
+	int cn = img.channels();
+	assert((1 == cn) || (CV_32F == img.depth()));
+
+	if (rowEnd <= rowStart)
+		return;
+
+	int tileRows = std::min(scratch.tileRows, rowEnd - rowStart);
+	int tileCols = std::min(scratch.tileCols, cols);
+	//Padded input row p lives in ring slot
+	//(p - rowStart + top) % slots.
+	int slots = tileRows + filter.rows - 1;
+	assert((scratch.ring.rows >= slots) &&
+		(scratch.ring.cols >= (cols + left + right)*cn) &&
+		(scratch.out.cols >= cols*cn));
+	Mat& ring = scratch.ring;
+	Mat& line = scratch.line;
+	Mat& out = scratch.out;
+	std::vector<const float*>& window = scratch.window;
+	for (int i0 = rowStart; i0 < rowEnd; i0 += tileRows)
+	{
+		int i1 = std::min(i0 + tileRows, rowEnd);
+
+		//The first block fills the whole ring; after that
+		//only the rows below the last block are brought in.
+		int pstart = (rowStart == i0) ? i0 - top : i0 + bottom;
+		for (int p = pstart; p < i1 + bottom; ++p)
+		{
+			int src = mirrorIndex(p, rows);
+			const float* srcRow;
+			if ((LauraHalf::TYPE == img.type()) || load)
+			{
+				LauraHalf::loadRow(img, src, line.ptr<float>());
+				if (load)
+					(*load)(line.ptr<float>(), src, cols, varargs);
+				srcRow = line.ptr<float>();
+			}
+			else
+				srcRow = img.ptr<float>(src);
+			padRow(srcRow, cols, cn, left, right,
+				ring.ptr<float>((p - rowStart + top) % slots));
+		}
+
+		for (int c0 = 0; c0 < cols; c0 += tileCols)
+		{
+			int w = std::min(tileCols, cols - c0);
+			for (int i = i0; i < i1; ++i)
+			{
+				for (int k = 0; k < filter.rows; ++k)
+					window[k] = ring.ptr<float>(
+						(i - rowStart + k) % slots) + c0*cn;
+				(*kernel)(&window[0], filter, w, cn,
+					out.ptr<float>(i - i0) + c0*cn);
+			}
+		}
+
+		for (int i = i0; i < i1; ++i)
+			(*store)(out.ptr<float>(i - i0), i, cols, varargs);
+	}
+}
+
+void
+LauraConvolution::tileSize(Mat& filter, int cols, int channels,
+	int* tileRows, int* tileCols)
+{
+	static const long l1 = cacheSize(1);
+	static const long l2 = cacheSize(2);
+	long halo = filter.cols - 1;
+	long pixel = sizeof(float)*channels;
+
+	//One row of a tile reads filter.rows padded rows and writes
+	//one; keep them all in L1.
+	long w = l1/(pixel*(filter.rows + 1)) - halo;
+	w = std::max(w/16*16, 16L);
+	w = std::min(w, (long) cols);
+
+	//Keep the padded rows under the whole tile in half of L2.
+	long h = (l2/2)/(pixel*(w + halo)) - (filter.rows - 1);
+	h = std::max(h, 1L);
+
+	*tileRows = (int) h;
+	*tileCols = (int) w;
+}
+
+long
+LauraConvolution::cacheSize(int level)
+{
+	long size = 0;
+#if defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+	size = sysconf((1 == level) ? _SC_LEVEL1_DCACHE_SIZE :
+		_SC_LEVEL2_CACHE_SIZE);
+#endif
+	if (0 < size)
+		return size;
+	return (1 == level) ? L1_CACHE_FALLBACK : L2_CACHE_FALLBACK;
+}
+
+void
+LauraConvolution::separableStream(Mat& img, Mat& kx, Mat& ky,
+	void* varargs,
+	void (*func) (float* row, int i, int cols, void* varargs))
+{
+	separableStream(img, kx, ky, 0, img.rows, varargs, func);
+}
+
+void
+LauraConvolution::separableStream(Mat& img, Mat& kx, Mat& ky,
+	int rowStart, int rowEnd, void* varargs,
+	void (*func) (float* row, int i, int cols, void* varargs))
+{
+	int rows = img.rows;
+	int cols = img.cols;
+	int left = kx.cols/2;
+	int right = kx.cols - left - 1;
+	int top = ky.rows/2;
+	int bottom = ky.rows - top - 1;
+
+	//The ring holds rows that have already been filtered by kx,
+	//so each input row is filtered horizontally only once.
+	//Row p lives in ring slot (p + top) % ky.rows.
+	Mat ring = LauraMemory::create(ky.rows, cols, CV_32F);
+	Mat line = LauraMemory::create(1, cols, CV_32F); //For half rows.
+	Mat padded = LauraMemory::create(1, cols + left + right, CV_32F);
+	Mat out = LauraMemory::create(1, cols, CV_32F);
+	std::vector<const float*> window(ky.rows);
+	const float* paddedRow = padded.ptr<float>();
+	for (int i = rowStart; i < rowEnd; ++i)
+	{
+		int pstart = (rowStart == i) ? i - top : i + bottom;
+		for (int p = pstart; p <= i + bottom; ++p)
+		{
+			int src = mirrorIndex(p, rows);
+			const float* srcRow;
+			if (LauraHalf::TYPE == img.type())
+			{
+				LauraHalf::loadRow(img, src, line.ptr<float>());
+				srcRow = line.ptr<float>();
+			}
+			else
+				srcRow = img.ptr<float>(src);
+			padRow(srcRow, cols, left, right, padded.ptr<float>());
+			convolveRow(&paddedRow, kx, cols,
+				ring.ptr<float>((p + top) % ky.rows));
+		}
+		for (int k = 0; k < ky.rows; ++k)
+			window[k] = ring.ptr<float>((i + k) % ky.rows);
+
+		convolveRow(&window[0], ky, cols, out.ptr<float>());
+		(*func)(out.ptr<float>(), i, cols, varargs);
+	}
+}
+
+Mat
+LauraConvolution::convolveSeparable(Mat& img, Mat& kx, Mat& ky)
+{
+	return convolveSeparable(img, kx, ky, CV_32F);
+}
+
+Mat
+LauraConvolution::convolveSeparable(Mat& img, Mat& kx, Mat& ky,
+	int type)
+{
+	Mat ret = LauraMemory::create(img.rows, img.cols, type);
+	separableStream(img, kx, ky, (void*) &ret, storeRowFunc);
+	return ret;
+}
+
+void
+LauraConvolution::convolveSeparableBand(Mat& img, Mat& kx, Mat& ky,
+	Mat& dst, int rowStart, int rowEnd)
+{
+	separableStream(img, kx, ky, rowStart, rowEnd, (void*) &dst,
+		storeRowFunc);
+}
+
+bool
+LauraConvolution::separate(Mat& filter, Mat& kx, Mat& ky)
+{
+	Mat f;
+	filter.convertTo(f, CV_32F);
+
+	//Pivot on the largest entry.
+	int p = 0;
+	int q = 0;
+	float big = 0.0f;
+	for (int i = 0; i < f.rows; ++i)
+	{
+		for (int j = 0; j < f.cols; ++j)
+		{
+			if (fabsf(f.ptr<float>(i)[j]) > big)
+			{
+				big = fabsf(f.ptr<float>(i)[j]);
+				p = i;
+				q = j;
+			}
+		}
+	}
+	if (0.0f == big)
+		return false;
+
+	//Then filter(i, j) = filter(i, q)*filter(p, j)/filter(p, q).
+	Mat row = LauraMemory::clone(f.row(p));
+	Mat col = f.col(q)*(1.0/f.ptr<float>(p)[q]);
+	for (int i = 0; i < f.rows; ++i)
+	{
+		for (int j = 0; j < f.cols; ++j)
+		{
+			float outer = col.ptr<float>(i)[0]*row.ptr<float>(0)[j];
+			if (fabsf(f.ptr<float>(i)[j] - outer) > 1e-6f*big)
+				return false;
+		}
+	}
+
+	kx = row;
+	ky = col;
+	return true;
+}
+
+Mat
+LauraConvolution::convolveBox(Mat& img, int width, int height,
+	float value)
+{
+	Mat src = LauraHalf::toFloat(img);
+	int rows = src.rows;
+	int cols = src.cols;
+	int left = width/2;
+	int right = width - left - 1;
+	int top = height/2;
+	int bottom = height - top - 1;
+
+	//Window sums along the rows, kept in double so the running
+	//sums do not drift.
+	Mat hsum = LauraMemory::create(rows, cols, CV_64F);
+	std::vector<float> padded(cols + width - 1);
+	for (int i = 0; i < rows; ++i)
+	{
+		padRow(src.ptr<float>(i), cols, left, right, &padded[0]);
+		double* h = hsum.ptr<double>(i);
+		double sum = 0.0;
+		for (int j = 0; j < width - 1; ++j)
+			sum += padded[j];
+		for (int j = 0; j < cols; ++j)
+		{
+			sum += padded[j + width - 1];
+			h[j] = sum;
+			sum -= padded[j];
+		}
+	}
+
+	//Then down the columns, a whole row at a time.
+	Mat ret = LauraMemory::create(rows, cols, CV_32F);
+	std::vector<double> sum(cols, 0.0);
+	for (int p = -top; p < bottom; ++p)
+	{
+		const double* h = hsum.ptr<double>(mirrorIndex(p, rows));
+		for (int j = 0; j < cols; ++j)
+			sum[j] += h[j];
+	}
+	for (int i = 0; i < rows; ++i)
+	{
+		const double* in = hsum.ptr<double>(mirrorIndex(i + bottom, rows));
+		const double* out = hsum.ptr<double>(mirrorIndex(i - top, rows));
+		float* d = ret.ptr<float>(i);
+		for (int j = 0; j < cols; ++j)
+		{
+			sum[j] += in[j];
+			d[j] = (float) (value*sum[j]);
+			sum[j] -= out[j];
+		}
+	}
+
+	return ret;
+}
+
+Mat
+LauraConvolution::convolveFFT(Mat& img, Mat& filter)
+{
+	Mat src = LauraHalf::toFloat(img);
+	int rows = src.rows;
+	int cols = src.cols;
+	int left = filter.cols/2;
+	int right = filter.cols - left - 1;
+	int top = filter.rows/2;
+	int bottom = filter.rows - top - 1;
+	int prows = rows + top + bottom;
+	int pcols = cols + left + right;
+
+	//Mirror-padded image and flipped filter (convolve correlates),
+	//zero-padded to a size the DFT likes. Sizes cover the padded
+	//image, so the wrap-around of the circular convolution only
+	//touches rows and columns that are thrown away.
+	int drows = cv::getOptimalDFTSize(prows);
+	int dcols = cv::getOptimalDFTSize(pcols);
+	Mat a = LauraMemory::zeros(drows, dcols, CV_32F);
+	for (int p = 0; p < prows; ++p)
+		padRow(src.ptr<float>(mirrorIndex(p - top, rows)), cols,
+			left, right, a.ptr<float>(p));
+	Mat b = LauraMemory::zeros(drows, dcols, CV_32F);
+	Mat f;
+	filter.convertTo(f, CV_32F);
+	Mat corner = b(Range(0, f.rows), Range(0, f.cols));
+	flip(f, corner, -1);
+
+	cv::dft(a, a, 0, prows);
+	cv::dft(b, b, 0, f.rows);
+	cv::mulSpectrums(a, b, a, 0);
+	cv::dft(a, a, cv::DFT_INVERSE | cv::DFT_SCALE, prows);
+
+	//Output (i, j) sits at the far corner of its window.
+	return a(Range(filter.rows - 1, filter.rows - 1 + rows),
+		Range(filter.cols - 1, filter.cols - 1 + cols)).clone();
+}
+
+void
+LauraConvolution::convolveRow(const float** rows, Mat& filter,
+	int width, float* out)
+{
+	convolveRow(rows, filter, width, 1, out);
+}
+
+void
+LauraConvolution::convolveRow(const float** rows, Mat& filter,
+	int width, int channels, float* out)
+{
+	//Interleaved channels are just a longer row whose taps
+	//are channels floats apart.
+	width *= channels;
+	for (int j = 0; j < width; ++j)
+		out[j] = 0.0f;
+
+	//Accumulate one filter tap at a time across the whole row
+	//so the inner loop is a straight multiply-add.
+	for (int fi = 0; fi < filter.rows; ++fi)
+	{
+		const float* f = filter.ptr<float>(fi);
+		for (int fj = 0; fj < filter.cols; ++fj)
+		{
+			float w = f[fj];
+			if (0.0f == w) continue;
+			const float* src = rows[fi] + fj*channels;
+			for (int j = 0; j < width; ++j)
+				out[j] += w*src[j];
+		}
+	}
+}
+
+void
+LauraConvolution::hitAndMissRow(const float** rows, Mat& filter,
+	int width, int channels, float* out)
+{
+	int ci = filter.rows/2;
+	int cj = filter.cols/2;
+	width *= channels; //Each channel on its own, as in convolveRow.
+	for (int j = 0; j < width; ++j)
+	{
+		bool hit = true; //Assume the hit is true, until proven wrong.
+		for (int fi = 0; (fi < filter.rows) && hit; ++fi)
+		{
+			const float* f = filter.ptr<float>(fi);
+			const float* src = rows[fi] + j;
+			for (int fj = 0; fj < filter.cols; ++fj)
+			{
+				if ((0 != f[fj]) && (1 != f[fj]))
+					continue;  //This is a skip pixel.
+
+				if (f[fj] != src[fj*channels])
+				{
+					hit = false;
+					break;
+				}
+			}
+		}
+
+		//Same as hitAndMissFunc.
+		float center = rows[ci][j + cj*channels];
+		out[j] = hit ? !center : center;
+	}
+}
+
+int
+LauraConvolution::mirrorIndex(int p, int n)
+{
+	//Same as flip() in addMirroredBoundaries: the edge pixel
+	//is repeated, so -1 maps to 0 and n maps to n - 1.
+	if ((0 <= p) && (n > p))
+		return p;
+	//Far outside, keep reflecting; the pattern repeats every 2n.
+	int m = p % (2*n);
+	if (0 > m) m += 2*n;
+	return (n > m) ? m : 2*n - m - 1;
+}
+
+void
+LauraConvolution::padRow(const float* src, int cols,
+	int left, int right, float* dst)
+{
+	for (int j = -left; j < cols + right; ++j)
+		dst[j + left] = src[mirrorIndex(j, cols)];
+}
+
+void
+LauraConvolution::padRow(const float* src, int cols, int channels,
+	int left, int right, float* dst)
+{
+	if (1 == channels)
+	{
+		padRow(src, cols, left, right, dst);
+		return;
+	}
+	for (int j = -left; j < cols + right; ++j)
+		memcpy(dst + (j + left)*channels,
+			src + mirrorIndex(j, cols)*channels,
+			channels*sizeof(float));
+}
+
+Mat
+LauraConvolution::morphologyLine(Mat& img, int length, int direction,
+	bool dilate)
+{
+	Mat src = LauraHalf::toFloat(img);
+	if (1 >= length)
+		return LauraMemory::clone(src);
+
+	Mat ret = LauraMemory::create(src.rows, src.cols, CV_32F);
+	MorphologyBody body(src, ret, length, direction, dilate);
+	int n;
+	if (LINE_HORIZONTAL == direction)
+		n = src.rows;
+	else if (LINE_VERTICAL == direction)
+		n = (src.cols + MORPHOLOGY_STRIPE - 1)/MORPHOLOGY_STRIPE;
+	else
+		n = src.rows + src.cols - 1; //Number of diagonals.
+	cv::parallel_for_(Range(0, n), body);
+
+	return ret;
+}
+
+Mat
+LauraConvolution::erode(Mat& img, int width, int height)
+{
+	Mat ret = morphologyLine(img, width, LINE_HORIZONTAL, false);
+	return morphologyLine(ret, height, LINE_VERTICAL, false);
+}
+
+Mat
+LauraConvolution::dilate(Mat& img, int width, int height)
+{
+	Mat ret = morphologyLine(img, width, LINE_HORIZONTAL, true);
+	return morphologyLine(ret, height, LINE_VERTICAL, true);
+}
+
+Mat
+LauraConvolution::erodeLine(Mat& img, int length, int direction)
+{
+	return morphologyLine(img, length, direction, false);
+}
+
+Mat
+LauraConvolution::dilateLine(Mat& img, int length, int direction)
+{
+	return morphologyLine(img, length, direction, true);
+}
+
+Mat
+LauraConvolution::opening(Mat& img, int width, int height)
+{
+	Mat ret = erode(img, width, height);
+	return dilate(ret, width, height);
+}
+
+Mat
+LauraConvolution::closing(Mat& img, int width, int height)
+{
+	Mat ret = dilate(img, width, height);
+	return erode(ret, width, height);
+}
+
+Mat
+LauraConvolution::maxFilter(Mat& img, int size)
+{
+	return dilate(img, size, size);
+}
+
+int
+LauraConvolution::recursivePadding(float sigma)
+{
+	//The Gaussian is negligible past 4 sigma; beyond the
+	//mirrored samples the line is taken to be constant.
+	return (int) ceil(4*sigma) + 3;
+}
+
+void
+LauraConvolution::recursiveLine(double* line, int n,
+	const double* coeffs)
+{
+	//Forward pass, starting in steady state on the first sample.
+	double w1 = line[0];
+	double w2 = line[0];
+	double w3 = line[0];
+	for (int j = 0; j < n; ++j)
+	{
+		double w = coeffs[0]*line[j] + coeffs[1]*w1
+			+ coeffs[2]*w2 + coeffs[3]*w3;
+		line[j] = w;
+		w3 = w2;
+		w2 = w1;
+		w1 = w;
+	}
+
+	//Backward pass.
+	w1 = line[n-1];
+	w2 = line[n-1];
+	w3 = line[n-1];
+	for (int j = n - 1; j >= 0; --j)
+	{
+		double w = coeffs[0]*line[j] + coeffs[1]*w1
+			+ coeffs[2]*w2 + coeffs[3]*w3;
+		line[j] = w;
+		w3 = w2;
+		w2 = w1;
+		w1 = w;
+	}
+}
+
+void
+LauraConvolution::recursiveColumns(Mat& img, int pad,
+	const double* coeffs)
+{
+	int rows = img.rows;
+	int cols = img.cols;
+
+	//The rows mirrored in below the image are overwritten by the
+	//forward pass before it gets to them, so save them first.
+	Mat below = LauraMemory::create(pad, cols, CV_64F);
+	for (int k = 0; k < pad; ++k)
+	{
+		const float* src = img.ptr<float>(mirrorIndex(rows + k, rows));
+		double* dst = below.ptr<double>(k);
+		for (int j = 0; j < cols; ++j)
+			dst[j] = src[j];
+	}
+
+	//Whole rows go through the recursion at once, so the
+	//inner loops run along memory.
+	//hist holds the last three outputs; x the current input.
+	Mat hist = LauraMemory::create(3, cols, CV_64F);
+	Mat x = LauraMemory::create(1, cols, CV_64F);
+	//Forward output past the image.
+	Mat wbelow = LauraMemory::create(pad, cols, CV_64F);
+	double* xr = x.ptr<double>();
+	double* h1 = hist.ptr<double>(0);
+	double* h2 = hist.ptr<double>(1);
+	double* h3 = hist.ptr<double>(2);
+
+	//Forward pass over the padded column, top to bottom.
+	for (int p = -pad; p < rows + pad; ++p)
+	{
+		if (rows > p)
+		{
+			const float* src = img.ptr<float>(mirrorIndex(p, rows));
+			for (int j = 0; j < cols; ++j)
+				xr[j] = src[j];
+		}
+		else
+			memcpy(xr, below.ptr<double>(p - rows),
+				cols*sizeof(double));
+		if (-pad == p)
+		{
+			//Start in steady state.
+			for (int j = 0; j < cols; ++j)
+				h1[j] = h2[j] = h3[j] = xr[j];
+		}
+
+		//The oldest output is replaced by the newest.
+		for (int j = 0; j < cols; ++j)
+			h3[j] = coeffs[0]*xr[j] + coeffs[1]*h1[j]
+				+ coeffs[2]*h2[j] + coeffs[3]*h3[j];
+		double* tmp = h3;
+		h3 = h2;
+		h2 = h1;
+		h1 = tmp;
+
+		if ((0 <= p) && (rows > p))
+		{
+			float* dst = img.ptr<float>(p);
+			for (int j = 0; j < cols; ++j)
+				dst[j] = (float) h1[j];
+		}
+		else if (rows <= p)
+			memcpy(wbelow.ptr<double>(p - rows), h1,
+				cols*sizeof(double));
+	}
+
+	//Backward pass, bottom to top. Only rows in the image
+	//are kept.
+	for (int p = rows + pad - 1; p >= 0; --p)
+	{
+		if (rows <= p)
+			memcpy(xr, wbelow.ptr<double>(p - rows),
+				cols*sizeof(double));
+		else
+		{
+			const float* src = img.ptr<float>(p);
+			for (int j = 0; j < cols; ++j)
+				xr[j] = src[j];
+		}
+		if (rows + pad - 1 == p)
+		{
+			for (int j = 0; j < cols; ++j)
+				h1[j] = h2[j] = h3[j] = xr[j];
+		}
+
+		for (int j = 0; j < cols; ++j)
+			h3[j] = coeffs[0]*xr[j] + coeffs[1]*h1[j]
+				+ coeffs[2]*h2[j] + coeffs[3]*h3[j];
+		double* tmp = h3;
+		h3 = h2;
+		h2 = h1;
+		h1 = tmp;
+
+		if (rows > p)
+		{
+			float* dst = img.ptr<float>(p);
+			for (int j = 0; j < cols; ++j)
+				dst[j] = (float) h1[j];
+		}
+	}
+}
+
+Mat
+LauraConvolution::recursiveGaussian(Mat& img, float sigma)
+{
+	double coeffs[4];
+	LauraFilters::recursiveGaussian(sigma, coeffs);
+	int pad = recursivePadding(sigma);
+	int rows = img.rows;
+	int cols = img.cols;
+
+	//Along the rows, one mirror-padded line at a time.
+	Mat ret = LauraMemory::create(rows, cols, CV_32F);
+	std::vector<double> line(cols + 2*pad);
+	for (int i = 0; i < rows; ++i)
+	{
+		const float* src = img.ptr<float>(i);
+		for (int p = -pad; p < cols + pad; ++p)
+			line[p + pad] = src[mirrorIndex(p, cols)];
+		recursiveLine(&line[0], cols + 2*pad, coeffs);
+
+		float* dst = ret.ptr<float>(i);
+		for (int j = 0; j < cols; ++j)
+			dst[j] = (float) line[j + pad];
+	}
+
+	//Then down the columns, in place.
+	recursiveColumns(ret, pad, coeffs);
+
+	return ret;
+}
+
+Mat
+LauraConvolution::recursiveGaussianDerivative(Mat& img,
+	float sigma, int dx, int dy)
+{
+	assert((0 <= dx) && (2 >= dx) && (0 <= dy) && (2 >= dy));
+	Mat smooth = recursiveGaussian(img, sigma);
+	int rows = smooth.rows;
+	int cols = smooth.cols;
+
+	//Differentiate the smoothed image with central differences.
+	//Across the columns (x) first.
+	Mat ret = smooth;
+	if (0 < dx)
+	{
+		ret = LauraMemory::create(rows, cols, CV_32F);
+		for (int i = 0; i < rows; ++i)
+		{
+			const float* s = smooth.ptr<float>(i);
+			float* d = ret.ptr<float>(i);
+			for (int j = 0; j < cols; ++j)
+			{
+				float l = s[mirrorIndex(j - 1, cols)];
+				float r = s[mirrorIndex(j + 1, cols)];
+				if (1 == dx)
+					d[j] = 0.5f*(r - l);
+				else
+					d[j] = r - 2*s[j] + l;
+			}
+		}
+	}
+
+	//Then down the rows (y). Up is positive, as in gy3x3.
+	if (0 < dy)
+	{
+		Mat src = ret;
+		ret = LauraMemory::create(rows, cols, CV_32F);
+		for (int i = 0; i < rows; ++i)
+		{
+			const float* u = src.ptr<float>(mirrorIndex(i - 1, rows));
+			const float* c = src.ptr<float>(i);
+			const float* b = src.ptr<float>(mirrorIndex(i + 1, rows));
+			float* d = ret.ptr<float>(i);
+			for (int j = 0; j < cols; ++j)
+			{
+				if (1 == dy)
+					d[j] = 0.5f*(u[j] - b[j]);
+				else
+					d[j] = u[j] - 2*c[j] + b[j];
+			}
+		}
+	}
+
+	return ret;
+}
@@ -0,0 +1,395 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "LauraCounters.h"
+#include <dirent.h>
+#include <errno.h>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//Bytes moved per last level cache miss, if the system won't say.
+#define LAURACOUNTERS_LINE 64
+
+namespace
+{
+struct Books
+{
+	std::once_flag opened;
+	bool requested; //$LAURA_COUNTERS is set.
+	bool works[LauraCounters::NCOUNTERS]; //Counter k could be opened.
+	std::string error; //Why a counter would not open.
+	//The counters of each thread running when they were opened,
+	//by counter; -1 where one did not open.
+	std::vector<std::vector<int> > threads;
+
+	std::mutex lock; //Guards everything below.
+	std::vector<std::string> names;
+	std::map<std::string, size_t> index;
+	std::vector<LauraCounters::Counts> counts;
+};
+
+Books&
+books()
+{
+	//Never destroyed, as the report is printed at exit.
+	static Books* b = new Books;
+	return *b;
+}
+
+//Counter k of thread tid, or -1 if it will not open. It takes
+//in the threads tid starts, and theirs, running or not.
+int
+openCounter(int k, pid_t tid)
+{
+	static const unsigned long long configs[] = {
+		PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = configs[k];
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+		PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return (int) syscall(__NR_perf_event_open, &attr, tid, -1, -1, 0);
+}
+
+//The count of fd so far, scaled up for the time the counter
+//shared the CPU's registers with others; -1 if it is missing.
+double
+readCounter(int fd)
+{
+	uint64_t v[3]; //Value, time enabled, time running.
+	if ((0 > fd) || (sizeof(v) != read(fd, v, sizeof(v))))
+		return -1;
+	if (0 == v[2])
+		return 0;
+	return (double) v[0]*v[1]/v[2];
+}
+
+//Finds out which counters open, and opens them on each thread
+//running now (normally just main's, see reportAtExit). Threads
+//started later are taken in by these.
+void
+openCounters(Books& b)
+{
+	b.requested = (NULL != getenv("LAURA_COUNTERS"));
+	for (int k = 0; k < LauraCounters::NCOUNTERS; ++k)
+		b.works[k] = false;
+	if (!b.requested)
+		return;
+	std::vector<pid_t> tids;
+	DIR* dir = opendir("/proc/self/task");
+	for (struct dirent* e = dir ? readdir(dir) : NULL; e; e = readdir(dir))
+	{
+		if ('.' != e->d_name[0])
+			tids.push_back((pid_t) atoi(e->d_name));
+	}
+	if (dir)
+		closedir(dir);
+	if (tids.empty())
+		tids.push_back(0); //This thread.
+
+	b.threads.resize(tids.size());
+	for (size_t t = 0; t < tids.size(); ++t)
+	{
+		for (int k = 0; k < LauraCounters::NCOUNTERS; ++k)
+		{
+			int fd = openCounter(k, tids[t]);
+			b.threads[t].push_back(fd);
+			if (0 <= fd)
+				b.works[k] = true;
+			else if (b.error.empty())
+				b.error = strerror(errno);
+		}
+	}
+}
+
+Books&
+openBooks()
+{
+	Books& b = books();
+	std::call_once(b.opened, openCounters, std::ref(b));
+	return b;
+}
+
+//The counts of the whole process so far, of the threads running
+//and of those that have exited. -1 for a missing counter.
+void
+readCounters(Books& b, double* values)
+{
+	for (int k = 0; k < LauraCounters::NCOUNTERS; ++k)
+	{
+		values[k] = b.works[k] ? 0 : -1;
+		for (size_t t = 0; b.works[k] && (t < b.threads.size()); ++t)
+		{
+			double v = readCounter(b.threads[t][k]);
+			if (0 <= v)
+				values[k] += v;
+		}
+	}
+}
+
+//Bytes moved per cache miss.
+double
+lineSize()
+{
+	long line = sysconf(_SC_LEVEL3_CACHE_LINESIZE);
+	return (0 < line) ? line : LAURACOUNTERS_LINE;
+}
+
+//a/b, or -1 if either is missing or b is 0.
+double
+ratio(double a, double b)
+{
+	return ((0 <= a) && (0 < b)) ? a/b : -1;
+}
+
+//The derived figures of c: instructions per cycle, cycles per
+//pixel and bytes per pixel.
+void
+derive(const LauraCounters::Counts& c, double* ipc, double* cpp,
+	double* bpp)
+{
+	*ipc = ratio(c.values[LauraCounters::INSTRUCTIONS],
+		c.values[LauraCounters::CYCLES]);
+	*cpp = ratio(c.values[LauraCounters::CYCLES], c.pixels);
+	double misses = c.values[LauraCounters::LLC_MISSES];
+	*bpp = ratio((0 <= misses) ? misses*lineSize() : -1, c.pixels);
+}
+
+//v formatted with format, or "-" if it is missing.
+std::string
+field(const char* format, double v)
+{
+	char ret[32];
+	if (0 > v)
+		return "-";
+	snprintf(ret, sizeof(ret), format, v);
+	return ret;
+}
+
+//The same, for JSON: null if it is missing.
+std::string
+jsonField(double v)
+{
+	char ret[32];
+	if (0 > v)
+		return "null";
+	snprintf(ret, sizeof(ret), "%.6g", v);
+	return ret;
+}
+
+//s as a JSON string.
+std::string
+jsonString(const std::string& s)
+{
+	std::string ret = "\"";
+	for (size_t k = 0; k < s.size(); ++k)
+	{
+		if (('"' == s[k]) || ('\\' == s[k]))
+			ret += '\\';
+		ret += s[k];
+	}
+	return ret + "\"";
+}
+
+void
+printReport()
+{
+	const char* format = getenv("LAURA_COUNTERS");
+	if (format && (0 == strcmp(format, "json")))
+		LauraCounters::reportJSON(std::cerr);
+	else
+		LauraCounters::report(std::cerr);
+}
+}
+
+LauraCounters::Stage::Stage(const std::string& name, double pixels):
+	name(name), pixels(pixels), startTicks(0), on(enabled())
+{
+	if (!on)
+		return;
+	readCounters(books(), start);
+	startTicks = cv::getTickCount();
+}
+
+LauraCounters::Stage::~Stage()
+{
+	if (!on)
+		return;
+	Books& b = books();
+	double end[NCOUNTERS];
+	readCounters(b, end);
+	double seconds = (cv::getTickCount() - startTicks)/
+		cv::getTickFrequency();
+
+	std::lock_guard<std::mutex> guard(b.lock);
+	std::map<std::string, size_t>::iterator it = b.index.find(name);
+	if (b.index.end() == it)
+	{
+		Counts c;
+		memset(&c, 0, sizeof(c));
+		it = b.index.insert(std::make_pair(name, b.counts.size())).first;
+		b.names.push_back(name);
+		b.counts.push_back(c);
+	}
+	Counts& c = b.counts[it->second];
+	for (int k = 0; k < NCOUNTERS; ++k)
+	{
+		if ((0 > start[k]) || (0 > end[k]) || (0 > c.values[k]))
+			c.values[k] = -1;
+		else
+			c.values[k] += end[k] - start[k];
+	}
+	c.pixels += pixels;
+	c.seconds += seconds;
+	c.calls++;
+}
+
+LauraCounters::LauraCounters()
+{
+
+}
+
+LauraCounters::~LauraCounters()
+{
+
+}
+
+bool
+LauraCounters::enabled()
+{
+	Books& b = openBooks();
+	for (int k = 0; k < NCOUNTERS; ++k)
+	{
+		if (b.works[k])
+			return true;
+	}
+	return false;
+}
+
+LauraCounters::Counts
+LauraCounters::counts(const std::string& name)
+{
+	Books& b = books();
+	std::lock_guard<std::mutex> guard(b.lock);
+	std::map<std::string, size_t>::iterator it = b.index.find(name);
+	if (b.index.end() != it)
+		return b.counts[it->second];
+	Counts c;
+	memset(&c, 0, sizeof(c));
+	return c;
+}
+
+std::vector<std::string>
+LauraCounters::stages()
+{
+	Books& b = books();
+	std::lock_guard<std::mutex> guard(b.lock);
+	return b.names;
+}
+
+void
+LauraCounters::report(std::ostream& out)
+{
+	Books& b = openBooks();
+	if (!enabled())
+	{
+		out << "counters unavailable: " <<
+			(b.error.empty() ? "$LAURA_COUNTERS is not set" : b.error) <<
+			std::endl;
+		return;
+	}
+	std::lock_guard<std::mutex> guard(b.lock);
+	char line[256];
+	snprintf(line, sizeof(line),
+		"%-24s %6s %10s %12s %12s %5s %11s %11s %9s %9s", "stage",
+		"calls", "ms", "cycles", "instructions", "IPC", "LLC misses",
+		"br misses", "cycles/px", "bytes/px");
+	out << line << std::endl;
+	for (size_t k = 0; k < b.names.size(); ++k)
+	{
+		const Counts& c = b.counts[k];
+		double ipc, cpp, bpp;
+		derive(c, &ipc, &cpp, &bpp);
+		snprintf(line, sizeof(line),
+			"%-24s %6ld %10.2f %12s %12s %5s %11s %11s %9s %9s",
+			b.names[k].c_str(), c.calls, 1000*c.seconds,
+			field("%.0f", c.values[CYCLES]).c_str(),
+			field("%.0f", c.values[INSTRUCTIONS]).c_str(),
+			field("%.2f", ipc).c_str(),
+			field("%.0f", c.values[LLC_MISSES]).c_str(),
+			field("%.0f", c.values[BRANCH_MISSES]).c_str(),
+			field("%.1f", cpp).c_str(), field("%.2f", bpp).c_str());
+		out << line << std::endl;
+	}
+}
+
+void
+LauraCounters::reportJSON(std::ostream& out)
+{
+	Books& b = openBooks();
+	out << "{\"available\": " << (enabled() ? "true" : "false");
+	if (!b.error.empty())
+		out << ", \"error\": " << jsonString(b.error);
+	out << ", \"stages\": [";
+	std::lock_guard<std::mutex> guard(b.lock);
+	for (size_t k = 0; k < b.names.size(); ++k)
+	{
+		const Counts& c = b.counts[k];
+		double ipc, cpp, bpp;
+		derive(c, &ipc, &cpp, &bpp);
+		out << (k ? ", " : "") << "{\"name\": " << jsonString(b.names[k]) <<
+			", \"calls\": " << c.calls <<
+			", \"seconds\": " << jsonField(c.seconds) <<
+			", \"pixels\": " << jsonField(c.pixels) <<
+			", \"cycles\": " << jsonField(c.values[CYCLES]) <<
+			", \"instructions\": " << jsonField(c.values[INSTRUCTIONS]) <<
+			", \"llc_misses\": " << jsonField(c.values[LLC_MISSES]) <<
+			", \"branch_misses\": " << jsonField(c.values[BRANCH_MISSES]) <<
+			", \"ipc\": " << jsonField(ipc) <<
+			", \"cycles_per_pixel\": " << jsonField(cpp) <<
+			", \"bytes_per_pixel\": " << jsonField(bpp) << "}";
+	}
+	out << "]}" << std::endl;
+}
+
+void
+LauraCounters::reportAtExit()
+{
+	static std::once_flag once;
+	//Opened now, from main, so the threads running are known
+	//before any stage.
+	openBooks();
+	if (getenv("LAURA_COUNTERS"))
+		std::call_once(once, []() { atexit(printReport); });
+}
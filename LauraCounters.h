@@ -0,0 +1,109 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef __LAURACOUNTERS_H__
+#define __LAURACOUNTERS_H__
+
+#include <opencv2/opencv.hpp>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//Hardware performance counters per stage, read straight from
+//Linux (perf_event_open), so no profiler is needed: CPU cycles,
+//instructions, last level cache misses and branch misses, from
+//which the report derives instructions per cycle, cycles per pixel
+//and the memory traffic per pixel (a cache line per miss).
+//
+//Nothing is counted unless $LAURA_COUNTERS is set; it then picks
+//the report printed at exit (see reportAtExit): "json" for JSON,
+//anything else for a table. The counters are opened by
+//reportAtExit, from main before any other thread starts, and take
+//in every thread started afterwards (task graph workers, the pool
+//behind parallel_for_, the server's workers), whether it is still
+//running or not. Opened later, by the first stage, they also cover
+//the threads running by then. They count user time only, so they
+//work under the default perf_event_paranoid of containers.
+//Counters the CPU or the container does not offer are reported as
+//missing.
+//Like LauraMemory, stages are process wide: stages that overlap in
+//time, on other threads, see each other's counts, and a stage
+//includes the stages nested in it.
+//
+//	{
+//		LauraCounters::Stage counters("gradient", img.total());
+//		...
+//	}
+class LauraCounters
+{
+public:
+	enum
+	{
+		CYCLES,
+		INSTRUCTIONS,
+		LLC_MISSES,
+		BRANCH_MISSES,
+		NCOUNTERS
+	};
+	struct Counts
+	{
+		//Events counted, scaled up for any time the counter was
+		//not on the CPU; -1 if the counter is missing.
+		double values[NCOUNTERS];
+		double pixels;  //Pixels the stage worked on.
+		double seconds; //Wall clock time.
+		long calls;
+	};
+	//Counts from construction to destruction under name, for
+	//work on pixels pixels (0 if there is no sense in it).
+	class Stage
+	{
+		std::string name;
+		double pixels;
+		double start[NCOUNTERS];
+		int64 startTicks;
+		bool on;
+	public:
+		Stage(const std::string& name, double pixels);
+		~Stage();
+	};
+
+	LauraCounters();
+	~LauraCounters();
+
+	//Whether stages are being counted: $LAURA_COUNTERS is set and
+	//at least one counter could be opened.
+	static bool enabled();
+	//The counts of stage name so far (all zero if none).
+	static Counts counts(const std::string& name);
+	//The names of the stages counted, in order of first use.
+	static std::vector<std::string> stages();
+
+	//Writes a line per stage: calls, time, counts and the
+	//derived figures.
+	static void report(std::ostream& out);
+	//The same, as a JSON object.
+	static void reportJSON(std::ostream& out);
+	//Prints the report to stderr at exit, if $LAURA_COUNTERS is
+	//set. Call once from main, before starting any threads.
+	static void reportAtExit();
+};
+
+#endif //!defined __LAURACOUNTERS_H__
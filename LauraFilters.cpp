@@ -19,11 +19,318 @@
 //SOFTWARE.
 
 #include "LauraFilters.h"
+#include "LauraConvolution.h"
+#include "LauraBatch.h"
+#include "LauraCounters.h"
+#include "LauraHistogram.h"
+#include "LauraHalf.h"
+#include "LauraMemory.h"
+#include <algorithm>
 #include <cmath>
-#include <iostream>
+#include <complex>
+#include <stdint.h>
+#include <string.h>
 
 #define PI 3.14159265358979323846264338327950288
 
+//What the batch filters hand to each work item.
+struct BatchFilterArgs
+{
+	std::vector<Mat>* in1;
+	std::vector<Mat>* in2;
+	std::vector<Mat>* out1;
+	std::vector<Mat>* out2;
+};
+
+//Work item functions for the batch filters.
+static void
+batchGradientFunc(int k, int rowStart, int rowEnd, void* varargs)
+{
+	BatchFilterArgs* a = (BatchFilterArgs*) varargs;
+	LauraFilters::gradientMagAngle((*a->in1)[k], (*a->in2)[k],
+		(*a->out1)[k], (*a->out2)[k], rowStart, rowEnd);
+}
+
+static void
+batchNonmaximaFunc(int k, int rowStart, int rowEnd, void* varargs)
+{
+	BatchFilterArgs* a = (BatchFilterArgs*) varargs;
+	LauraFilters::nonmaximaSuppression3x3((*a->in1)[k], (*a->in2)[k],
+		(*a->out1)[k], rowStart, rowEnd);
+}
+
+//Pixels per run of the selection networks: the size*size
+//scratch rows of a run stay in L1.
+#define RANK_RUN 256
+//Rows per band of the histogram rank filter. Each band builds
+//its column histograms from scratch, so bands are at least twice
+//the filter size.
+#define RANK_BAND 64
+
+//Comparators of a network that puts the value of rank rank among
+//n values into slot rank, as pairs of slots (min to the first,
+//max to the second): Batcher's odd-even merge sort, less the
+//comparators that cannot reach slot rank.
+static void
+selectionNetwork(int n, int rank, std::vector<int>& pairs)
+{
+	std::vector<int> sort;
+	for (int p = 1; p < n; p <<= 1)
+		for (int k = p; k >= 1; k >>= 1)
+			for (int j = k % p; j + k < n; j += 2*k)
+				for (int i = 0; i < std::min(k, n - j - k); ++i)
+				{
+					if ((i + j)/(2*p) == (i + j + k)/(2*p))
+					{
+						sort.push_back(i + j);
+						sort.push_back(i + j + k);
+					}
+				}
+
+	//Back from the result, keeping what feeds it.
+	std::vector<bool> needed(n, false);
+	std::vector<int> kept;
+	needed[rank] = true;
+	for (int c = (int) sort.size() - 2; c >= 0; c -= 2)
+	{
+		if (!needed[sort[c]] && !needed[sort[c+1]])
+			continue;
+		needed[sort[c]] = true;
+		needed[sort[c+1]] = true;
+		kept.push_back(c);
+	}
+	pairs.clear();
+	for (int c = (int) kept.size() - 1; c >= 0; --c)
+	{
+		pairs.push_back(sort[kept[c]]);
+		pairs.push_back(sort[kept[c] + 1]);
+	}
+}
+
+//Loop body for the CV_32F rank filters; the range is of rows.
+//Each run of pixels has its size*size neighbors copied into as
+//many scratch rows, which the network then sorts a comparator at
+//a time, all the pixels of the run together. Without a network
+//each neighborhood is partially sorted on its own.
+class NetworkRankBody : public cv::ParallelLoopBody
+{
+	Mat& src;
+	Mat& dst;
+	int size;
+	int rank;
+	std::vector<int> pairs;
+public:
+	NetworkRankBody(Mat& src, Mat& dst, int size, int rank,
+		bool network)
+		: src(src), dst(dst), size(size), rank(rank)
+	{
+		if (network)
+			selectionNetwork(size*size, rank, pairs);
+	}
+
+	virtual void operator()(const cv::Range& range) const
+	{
+		int rows = src.rows;
+		int cols = src.cols;
+		int r = size/2;
+		int n = size*size;
+		int width = cols + size - 1;
+		std::vector<float> padded(size*width);
+		std::vector<float> scratch(n*RANK_RUN);
+		std::vector<float> hood(n);
+		for (int i = range.start; i < range.end; ++i)
+		{
+			for (int dy = 0; dy < size; ++dy)
+			{
+				int p = LauraConvolution::mirrorIndex(i + dy - r, rows);
+				LauraConvolution::padRow(src.ptr<float>(p), cols, r, r,
+					&padded[dy*width]);
+			}
+			float* out = dst.ptr<float>(i);
+
+			if (pairs.empty())
+			{
+				for (int j = 0; j < cols; ++j)
+				{
+					for (int dy = 0; dy < size; ++dy)
+						memcpy(&hood[dy*size], &padded[dy*width + j],
+							size*sizeof(float));
+					std::nth_element(hood.begin(),
+						hood.begin() + rank, hood.end());
+					out[j] = hood[rank];
+				}
+				continue;
+			}
+
+			for (int j0 = 0; j0 < cols; j0 += RANK_RUN)
+			{
+				int m = std::min(RANK_RUN, cols - j0);
+				for (int t = 0; t < n; ++t)
+				{
+					const float* in = &padded[(t/size)*width + t % size];
+					memcpy(&scratch[t*m], in + j0, m*sizeof(float));
+				}
+				for (size_t c = 0; c < pairs.size(); c += 2)
+				{
+					float* a = &scratch[pairs[c]*m];
+					float* b = &scratch[pairs[c+1]*m];
+					for (int j = 0; j < m; ++j)
+					{
+						float lo = std::min(a[j], b[j]);
+						float hi = std::max(a[j], b[j]);
+						a[j] = lo;
+						b[j] = hi;
+					}
+				}
+				memcpy(out + j0, &scratch[rank*m], m*sizeof(float));
+			}
+		}
+	}
+};
+
+//Loop body for the CV_8U rank filters (Perreault and Hebert,
+//"Median Filtering in Constant Time", 2007); the range is of
+//bands of rows.
+//Each column of the padded image keeps a histogram of the size
+//pixels around the current row, moved down a row by one removal
+//and one addition. The neighborhood histogram is the sum of size
+//column histograms, moved right by one subtraction and one
+//addition. Histograms have 16 coarse bins (the high 4 bits) and
+//256 fine ones: the coarse ones are kept up to date at every
+//pixel and find the fine segment that holds the rank, and only
+//that segment is brought up to date, from where it was last used.
+class HistogramRankBody : public cv::ParallelLoopBody
+{
+	//The column histograms of a band, over the padded columns.
+	struct Columns
+	{
+		std::vector<int> map; //Source column of each padded one.
+		std::vector<uint16_t> coarse; //16 bins per column.
+		std::vector<uint16_t> fine;   //256 bins per column.
+	};
+
+	Mat& src;
+	Mat& dst;
+	int r;
+	int rank;
+	int band;
+
+	//Adds (delta 1) or removes (-1) row p of the padded image to
+	//the column histograms.
+	void addRow(int p, int delta, Columns& h) const
+	{
+		const uchar* row = src.ptr<uchar>(
+			LauraConvolution::mirrorIndex(p, src.rows));
+		int width = (int) h.map.size();
+		for (int x = 0; x < width; ++x)
+		{
+			int v = row[h.map[x]];
+			h.coarse[x*16 + (v >> 4)] += delta;
+			h.fine[x*256 + v] += delta;
+		}
+	}
+
+	//Ranks row out from the column histograms.
+	void rankRow(const Columns& h, uchar* out) const
+	{
+		int cols = src.cols;
+		int size = 2*r + 1;
+		const uint16_t* colCoarse = &h.coarse[0];
+		const uint16_t* colFine = &h.fine[0];
+		int coarse[16];
+		int fine[256];
+		int lastUsed[16]; //Column of each fine segment; -1 if none.
+		memset(coarse, 0, sizeof(coarse));
+		for (int x = 0; x < size; ++x)
+			for (int c = 0; c < 16; ++c)
+				coarse[c] += colCoarse[x*16 + c];
+		for (int c = 0; c < 16; ++c)
+			lastUsed[c] = -1;
+
+		for (int j = 0; j < cols; ++j)
+		{
+			if (0 < j)
+			{
+				const uint16_t* gone = colCoarse + (j - 1)*16;
+				const uint16_t* come = gone + size*16;
+				for (int c = 0; c < 16; ++c)
+					coarse[c] += come[c] - gone[c];
+			}
+
+			int count = 0;
+			int c = 0;
+			while (count + coarse[c] <= rank)
+				count += coarse[c++];
+
+			//Bring fine segment c from its last column to j, or
+			//build it again if that is cheaper.
+			int* f = fine + c*16;
+			if ((0 > lastUsed[c]) || (size <= j - lastUsed[c]))
+			{
+				memset(f, 0, 16*sizeof(int));
+				for (int x = j; x < j + size; ++x)
+				{
+					const uint16_t* come = colFine + x*256 + c*16;
+					for (int b = 0; b < 16; ++b)
+						f[b] += come[b];
+				}
+			}
+			else
+			{
+				for (int x = lastUsed[c]; x < j; ++x)
+				{
+					const uint16_t* gone = colFine + x*256 + c*16;
+					const uint16_t* come = gone + size*256;
+					for (int b = 0; b < 16; ++b)
+						f[b] += come[b] - gone[b];
+				}
+			}
+			lastUsed[c] = j;
+
+			int b = 0;
+			while (count + f[b] <= rank)
+				count += f[b++];
+			out[j] = (uchar) (c*16 + b);
+		}
+	}
+public:
+	HistogramRankBody(Mat& src, Mat& dst, int size, int rank, int band)
+		: src(src), dst(dst), r(size/2), rank(rank), band(band)
+	{
+
+	}
+
+	virtual void operator()(const cv::Range& range) const
+	{
+		int width = src.cols + 2*r;
+		Columns h;
+		h.map.resize(width);
+		for (int x = 0; x < width; ++x)
+			h.map[x] = LauraConvolution::mirrorIndex(x - r, src.cols);
+		h.coarse.resize(width*16);
+		h.fine.resize(width*256);
+
+		for (int k = range.start; k < range.end; ++k)
+		{
+			int i0 = k*band;
+			int i1 = std::min(src.rows, i0 + band);
+			std::fill(h.coarse.begin(), h.coarse.end(), 0);
+			std::fill(h.fine.begin(), h.fine.end(), 0);
+			for (int p = i0 - r; p <= i0 + r; ++p)
+				addRow(p, 1, h);
+			for (int i = i0; i < i1; ++i)
+			{
+				if (i0 < i)
+				{
+					addRow(i - r - 1, -1, h);
+					addRow(i + r, 1, h);
+				}
+				rankRow(h, dst.ptr<uchar>(i));
+			}
+		}
+	}
+};
+
 LauraFilters::LauraFilters()
 {
 
@@ -38,7 +345,7 @@ Mat
 LauraFilters::gaussian(int fsize1, int fsize2, float sigma)
 {
 	//Make return matrix. _ for element access.
-	Mat ret = Mat::zeros(fsize1, fsize2, CV_32F);
+	Mat ret = LauraMemory::zeros(fsize1, fsize2, CV_32F);
 	cv::Mat_<float> ret_ = ret;
 	
 	int halfsize1 = fsize1/2;
@@ -58,6 +365,81 @@ LauraFilters::gaussian(int fsize1, int fsize2, float sigma)
 	return ret;
 }
 
+Mat
+LauraFilters::gaussian1D(int fsize, float sigma)
+{
+	//Make return matrix. _ for element access.
+	Mat ret = LauraMemory::zeros(1, fsize, CV_32F);
+	cv::Mat_<float> ret_ = ret;
+
+	int halfsize = fsize/2;
+	for (int j = -halfsize; j < halfsize + 1; ++j)
+	{
+		float x = (float) j;
+		ret_(0, j + halfsize) =
+			(1/(sqrt(2*PI)*sigma)) *
+			exp(-1*((x*x)/(2*sigma*sigma)));
+	}
+
+	return ret;
+}
+
+//Feedback coefficients of the recursive Gaussian whose poles
+//are the base poles raised to 1/q.
+static void
+recursivePoles(double q, double* coeffs)
+{
+	//Poles for q = 1, from van Vliet, Young and Verbeek,
+	//"Recursive Gaussian derivative filters" (1998).
+	std::complex<double> d1(1.40098, 1.00236);
+	std::complex<double> d3(1.85132, 0.0);
+	std::complex<double> p1 = std::pow(d1, 1.0/q);
+	std::complex<double> p2 = std::conj(p1);
+	std::complex<double> p3 = std::pow(d3, 1.0/q);
+
+	//1/((p1 - z)(p2 - z)(p3 - z)), normalized, with z = delay.
+	std::complex<double> s0 = p1*p2*p3;
+	std::complex<double> s1 = p1*p2 + p1*p3 + p2*p3;
+	std::complex<double> s2 = p1 + p2 + p3;
+	coeffs[1] = (s1/s0).real();
+	coeffs[2] = -(s2/s0).real();
+	coeffs[3] = (1.0/s0).real();
+	coeffs[0] = 1.0 - (coeffs[1] + coeffs[2] + coeffs[3]);
+}
+
+//Variance of the forward-backward filter with the given
+//coefficients.
+static double
+recursiveVariance(const double* coeffs)
+{
+	//Mean and variance of one causal pass, from the
+	//derivatives of its transfer function at z = 1.
+	double B = coeffs[0];
+	double m = (coeffs[1] + 2*coeffs[2] + 3*coeffs[3])/B;
+	double v = m*m + m + (2*coeffs[2] + 6*coeffs[3])/B;
+	//Backward pass adds the same again.
+	return 2*v;
+}
+
+void
+LauraFilters::recursiveGaussian(float sigma, double* coeffs)
+{
+	//Variance grows monotonically with q; bisect for sigma^2.
+	double target = (double) sigma*sigma;
+	double lo = 0.01;
+	double hi = 2.0*sigma + 5.0;
+	for (int it = 0; it < 60; ++it)
+	{
+		double mid = 0.5*(lo + hi);
+		recursivePoles(mid, coeffs);
+		if (recursiveVariance(coeffs) < target)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	recursivePoles(0.5*(lo + hi), coeffs);
+}
+
 Mat
 LauraFilters::laplacian()
 {
@@ -70,7 +452,7 @@ Mat
 LauraFilters::LoG(int fsize, float sigma)
 {
 	//Make return matrix. _ for element access.
-	Mat ret = Mat::zeros(fsize, fsize, CV_32F);
+	Mat ret = LauraMemory::zeros(fsize, fsize, CV_32F);
 	cv::Mat_<float> ret_ = ret;
 	
 	int halfsize = fsize/2;
@@ -106,65 +488,187 @@ LauraFilters::gy3x3()
 	return ret;
 }
 
+Mat
+LauraFilters::compose(Mat& first, Mat& second)
+{
+	Mat a, b;
+	first.convertTo(a, CV_32F);
+	second.convertTo(b, CV_32F);
+	Mat ret = LauraMemory::zeros(a.rows + b.rows - 1, a.cols + b.cols - 1,
+		CV_32F);
+	for (int p = 0; p < a.rows; ++p)
+	{
+		for (int q = 0; q < a.cols; ++q)
+		{
+			float w = a.ptr<float>(p)[q];
+			for (int i = 0; i < b.rows; ++i)
+			{
+				const float* brow = b.ptr<float>(i);
+				float* out = ret.ptr<float>(p + i) + q;
+				for (int j = 0; j < b.cols; ++j)
+					out[j] += w*brow[j];
+			}
+		}
+	}
+	return ret;
+}
+
+bool
+LauraFilters::compose(Mat& first, Mat& second, Mat& kx, Mat& ky)
+{
+	Mat kx1, ky1, kx2, ky2;
+	if (!LauraConvolution::separate(first, kx1, ky1) ||
+		!LauraConvolution::separate(second, kx2, ky2))
+		return false;
+	kx = compose(kx1, kx2);
+	ky = compose(ky1, ky2);
+	return true;
+}
+
 Mat
 LauraFilters::zeroCross3x3(Mat& img)
 {
-	//For determining if pixel in process is
-	//"small" in intensity value.
-	double min, max;
-	cv::minMaxLoc(img, &min, &max);
-	//float eps = 0.1*((fabs(min) + fabs(max))/2.0f);
+	//For determining if there is a significant
+	//difference across P0.
 	cv::Scalar mean, stddev;
 	cv::meanStdDev(img, mean, stddev);
-	float eps = 2*stddev(0);//1.5*stddev(0);
-	std::cout << "mean: " << mean(0) << std::endl;
-	std::cout << "std: " << stddev(0) << std::endl;
-	std::cout << "Zero epsilon: " << eps << std::endl;
 	float deps = 0.5*stddev(0);//2.5*stddev(0);
-	std::cout << "Difference epsilon: " << deps << std::endl;
 
-	//Make return matrix and _ for element access.
-	cv::Mat_<float> img_ = img;
-	Mat ret = Mat::zeros(img.rows, img.cols, CV_32F);
-	cv::Mat_<float> ret_ = ret;
+	//Make return matrix.
+	Mat ret = LauraMemory::zeros(img.rows, img.cols, CV_32F);
 
-	//For each pixel in process (not considering the boundary).
+	//For each row in process (not considering the boundary).
 	for (int i = 1; i < img.rows - 1; ++i)
 	{
-		for (int j = 1; j < img.cols - 1; ++j)
+		zeroCrossRow(img.ptr<float>(i-1), img.ptr<float>(i),
+			img.ptr<float>(i+1), img.cols, deps,
+			ret.ptr<float>(i));
+	}
+
+	return ret;
+}
+
+void
+LauraFilters::zeroCrossRow(const float* above,
+	const float* row, const float* below,
+	int cols, float deps, float* out)
+{
+	for (int j = 1; j < cols - 1; ++j)
+	{
+		//Check to see how many pairs of neighbors
+		//have opposing signs. If between 1 and 3,
+		//P0 is on the edge.
+
+		//Using the book's numbering:
+		//P4 P3 P2
+		//P5 P0 P1
+		//P6 P7 P8
+		float p0 = row[j];
+		if (1e-30 > p0)
 		{
-			//Check to see how many pairs of neighbors
-			//have opposing signs. If between 1 and 3,
-			//P0 is on the edge.
+			float p1 = row[j+1];
+			float p5 = row[j-1];
+			float p3 = above[j];
+			float p4 = above[j-1];
+			float p2 = above[j+1];
+			float p7 = below[j];
+			float p6 = below[j-1];
+			float p8 = below[j+1];
 
-			//Using the book's numbering:
-			//P4 P3 P2
-			//P5 P0 P1
-			//P6 P7 P8
-			float p0 = img_(i, j);
-			if (1e-30 > p0)
-			{
-				float p1 = img_(i, j+1);
-				float p5 = img_(i, j-1);
-				float p3 = img_(i-1, j);
-				float p4 = img_(i-1, j-1);
-				float p2 = img_(i-1, j+1);
-				float p7 = img_(i+1, j);
-				float p6 = img_(i+1, j-1);
-				float p8 = img_(i+1, j+1);
-
-				////For counting opposite pairs.
-				int oppositePairs = 0;
-				if(opposingPair(p1, p5, deps)) oppositePairs++;
-				if(opposingPair(p2, p6, deps)) oppositePairs++;
-				if(opposingPair(p3, p7, deps)) oppositePairs++;
-				if(opposingPair(p4, p8, deps)) oppositePairs++;
-
-				if ((0 < oppositePairs) && (4 > oppositePairs))
-					ret_(i, j) = 255.0f;
-			}
+			////For counting opposite pairs.
+			int oppositePairs = 0;
+			if(opposingPair(p1, p5, deps)) oppositePairs++;
+			if(opposingPair(p2, p6, deps)) oppositePairs++;
+			if(opposingPair(p3, p7, deps)) oppositePairs++;
+			if(opposingPair(p4, p8, deps)) oppositePairs++;
+
+			if ((0 < oppositePairs) && (4 > oppositePairs))
+				out[j] = 255.0f;
 		}
 	}
+}
+
+//Where LoGEdge's rows go as they are convolved.
+struct LoGEdgeArgs
+{
+	Mat* filtered;
+	LauraHistogram* hist;
+};
+
+//Stores a row of the LoG response and adds it to the statistics.
+static void
+logEdgeRowFunc(float* row, int i, int cols, void* varargs)
+{
+	LoGEdgeArgs* args = (LoGEdgeArgs*) varargs;
+	memcpy(args->filtered->ptr<float>(i), row, cols*sizeof(float));
+	args->hist->accumulate(row, cols);
+}
+
+Mat
+LauraFilters::LoGEdge(Mat& img, int fsize, float sigma,
+	Mat& filtered, float* mean, float* stddev)
+{
+	LauraCounters::Stage counters("LoGEdge", (double) img.total());
+	Mat filter = LoG(fsize, sigma);
+	int rows = img.rows;
+	int cols = img.cols;
+
+	/**** Pass 1: convolve and accumulate statistics. ****/
+	LauraMemory::create(filtered, rows, cols, CV_32F);
+	LauraHistogram hist(512, -256.0f, 256.0f);
+	LoGEdgeArgs args;
+	args.filtered = &filtered;
+	args.hist = &hist;
+	LauraConvolution::convolutionStream(img, filter,
+		(void*) &args, logEdgeRowFunc);
+
+	//Thresholds are only known now.
+	float lmean = hist.mean();
+	float lstd = hist.stddev();
+	if (mean) *mean = lmean;
+	if (stddev) *stddev = lstd;
+
+	/**** Pass 2: subtract the mean and find zero-crossings. ****/
+	return zeroCrossCentered(filtered, lmean, lstd);
+}
+
+Mat
+LauraFilters::zeroCrossCentered(Mat& filtered, float mean,
+	float stddev)
+{
+	int rows = filtered.rows;
+	int cols = filtered.cols;
+	float deps = 0.5*stddev;
+
+	//Keep three mean-subtracted rows; each row is written back
+	//once it has left the window.
+	Mat ret = LauraMemory::zeros(rows, cols, CV_32F);
+	Mat sub = LauraMemory::create(3, cols, CV_32F);
+	for (int i = 0; i < rows; ++i)
+	{
+		//Load row i + 1 (row 0 too on the first step).
+		int lstart = (0 == i) ? 0 : i + 1;
+		for (int r = lstart; (r <= i + 1) && (r < rows); ++r)
+		{
+			const float* src = filtered.ptr<float>(r);
+			float* dst = sub.ptr<float>(r % 3);
+			for (int j = 0; j < cols; ++j)
+				dst[j] = src[j] - mean;
+		}
+
+		if ((0 < i) && (rows - 1 > i))
+		{
+			zeroCrossRow(sub.ptr<float>((i - 1) % 3),
+				sub.ptr<float>(i % 3), sub.ptr<float>((i + 1) % 3),
+				cols, deps, ret.ptr<float>(i));
+		}
+
+		//Row i - 1 is no longer needed.
+		if (0 < i)
+			sub.row((i - 1) % 3).copyTo(filtered.row(i - 1));
+	}
+	if (0 < rows)
+		sub.row((rows - 1) % 3).copyTo(filtered.row(rows - 1));
 
 	return ret;
 }
@@ -182,88 +686,314 @@ LauraFilters::opposingPair(float p1, float p2, float eps)
 		return false;
 }
 
-Mat
-LauraFilters::nonmaximaSuppression3x3(
+void
+LauraFilters::gradientMagAngle(Mat& gx, Mat& gy,
 	Mat& mag, Mat& angle)
 {
-	//Make return matrix and _ for element access.
-	cv::Mat_<float> mag_ = mag;
-	cv::Mat_<float> angle_ = angle;
-	Mat ret = mag.clone();
-	cv::Mat_<float> ret_ = ret;
+	LauraCounters::Stage counters("gradientMagAngle",
+		(double) gx.total());
+	//Outputs are stored the same way as the inputs,
+	//with one channel.
+	LauraMemory::create(mag, gx.rows, gx.cols, gx.depth());
+	LauraMemory::create(angle, gx.rows, gx.cols, gx.depth());
+	gradientMagAngle(gx, gy, mag, angle, 0, gx.rows);
+}
 
-	//For each pixel in process (not considering the boundary).
-	for (int i = 1; i < mag.rows - 1; ++i)
+void
+LauraFilters::gradientMagAngle(Mat& gx, Mat& gy,
+	Mat& mag, Mat& angle, int rowStart, int rowEnd)
+{
+	int cn = gx.channels();
+	Mat line = LauraMemory::create(4, gx.cols*cn, CV_32F);
+	float* dx = line.ptr<float>(0);
+	float* dy = line.ptr<float>(1);
+	float* m = line.ptr<float>(2);
+	float* a = line.ptr<float>(3);
+	for (int i = rowStart; i < rowEnd; ++i)
 	{
-		for (int j = 1; j < mag.cols - 1; ++j)
+		LauraHalf::loadRow(gx, i, dx);
+		LauraHalf::loadRow(gy, i, dy);
+		if (1 < cn)
 		{
-			//If the pixel is pure black, ignore it.
-			if (!mag_(i, j)) continue;
+			for (int j = 0; j < gx.cols; ++j)
+				combineChannels(dx + j*cn, dy + j*cn, cn,
+					COLOR_DI_ZENZO, m + j, a + j);
+			LauraHalf::storeRow(m, mag, i);
+			LauraHalf::storeRow(a, angle, i);
+			continue;
+		}
+		for (int j = 0; j < gx.cols; ++j)
+		{
+			m[j] = sqrt(dx[j]*dx[j] + dy[j]*dy[j]);
+			//Degrees in [0, 360), as from cv::phase.
+			float ang = (float) (atan2(dy[j], dx[j])*180.0/PI);
+			if (0.0f > ang) ang += 360.0f;
+			a[j] = ang;
+		}
+		LauraHalf::storeRow(m, mag, i);
+		LauraHalf::storeRow(a, angle, i);
+	}
+}
 
-			//Determine edge angle.
-			float ang = angle_(i, j);
-			while (0.0f > ang)
-				ang += 360.0f;
-			while (360.0f < ang)
-				ang -= 360.0f;
-
-			//Direction to thin (degrees).
-			//Either -45, 0, 45, or 90.
-			int thinDir;
-			if ((22.5f > ang) || (337.5f <= ang))
-				thinDir = 0;
-			else if ((22.5f <= ang) && (67.5f > ang))
-				thinDir = 45;
-			else if ((67.5f <= ang) && (112.5f > ang))
-				thinDir = 90;
-			else if ((112.5f <= ang) && (157.5f > ang))
-				thinDir = -45;
-			else if ((157.5f <= ang) && (202.5f > ang))
-				thinDir = 0;
-			else if ((202.5f <= ang) && (247.5f > ang))
-				thinDir = 45;
-			else if ((247.5f <= ang) && (292.5f > ang))
-				thinDir = 90;
-			else if ((292.5f <= ang) && (337.5f > ang))
-				thinDir = -45;
+void
+LauraFilters::gradientMagAngle(std::vector<Mat>& gx,
+	std::vector<Mat>& gy, std::vector<Mat>& mag,
+	std::vector<Mat>& angle)
+{
+	//Each image's outputs are stored like its inputs (see above),
+	//with one channel.
+	std::vector<int> types;
+	for (size_t k = 0; k < gx.size(); ++k)
+		types.push_back((LauraHalf::TYPE == gx[k].type()) ?
+			LauraHalf::TYPE : CV_32F);
+	mag = LauraBatch::allocate(gx, types);
+	angle = LauraBatch::allocate(gx, types);
 
-			//Determine whether or not pix in process
-			//is a local maximum.
-			//Using the book's numbering:
-			//P4 P3 P2
-			//P5 P0 P1
-			//P6 P7 P8
-			float p0 = mag_(i, j);
-			bool isMax;
-			if (-45 == thinDir)
-			{
-				float p4 = mag_(i-1, j-1);
-				float p8 = mag_(i+1, j+1);
-				isMax = isLocalMax(p0, p4, p8);
-			}
-			else if (0 == thinDir)
-			{
-				float p1 = mag_(i, j+1);
-				float p5 = mag_(i, j-1);
-				isMax = isLocalMax(p0, p1, p5);
-			}
-			else if (45 == thinDir)
+	BatchFilterArgs a;
+	a.in1 = &gx;
+	a.in2 = &gy;
+	a.out1 = &mag;
+	a.out2 = &angle;
+	LauraBatch::run(gx, batchGradientFunc, (void*) &a);
+}
+
+void
+LauraFilters::colorGradient(Mat& img, Mat& mag, Mat& angle,
+	int method)
+{
+	LauraCounters::Stage counters("colorGradient", (double) img.total());
+	if (mag.empty())
+		LauraMemory::create(mag, img.rows, img.cols, CV_32F);
+	if (angle.empty())
+		LauraMemory::create(angle, img.rows, img.cols, CV_32F);
+	colorGradient(img, mag, angle, method, 0, img.rows);
+}
+
+void
+LauraFilters::colorGradient(Mat& img, Mat& mag, Mat& angle,
+	int method, int rowStart, int rowEnd)
+{
+	int rows = img.rows;
+	int cols = img.cols;
+	int cn = img.channels();
+
+	Mat line = LauraMemory::create(2, cols, CV_32F);
+	float* m = line.ptr<float>(0);
+	float* a = line.ptr<float>(1);
+	std::vector<float> dx(cn);
+	std::vector<float> dy(cn);
+	for (int i = rowStart; i < rowEnd; ++i)
+	{
+		//Mirrored like convolve.
+		const float* up = img.ptr<float>(
+			LauraConvolution::mirrorIndex(i - 1, rows));
+		const float* row = img.ptr<float>(i);
+		const float* dn = img.ptr<float>(
+			LauraConvolution::mirrorIndex(i + 1, rows));
+		for (int j = 0; j < cols; ++j)
+		{
+			int l = LauraConvolution::mirrorIndex(j - 1, cols)*cn;
+			int c = j*cn;
+			int r = LauraConvolution::mirrorIndex(j + 1, cols)*cn;
+			for (int k = 0; k < cn; ++k)
 			{
-				float p2 = mag_(i-1, j+1);
-				float p6 = mag_(i+1, j-1);
-				isMax = isLocalMax(p0, p2, p6);
+				//gx3x3 and gy3x3 (up is positive).
+				dx[k] = (up[r + k] - up[l + k])
+					+ 2*(row[r + k] - row[l + k])
+					+ (dn[r + k] - dn[l + k]);
+				dy[k] = (up[l + k] + 2*up[c + k] + up[r + k])
+					- (dn[l + k] + 2*dn[c + k] + dn[r + k]);
 			}
-			else //thinDir = 90
+			combineChannels(&dx[0], &dy[0], cn, method, m + j, a + j);
+		}
+		LauraHalf::storeRow(m, mag, i);
+		LauraHalf::storeRow(a, angle, i);
+	}
+}
+
+void
+LauraFilters::combineChannels(const float* dx, const float* dy,
+	int channels, int method, float* mag, float* angle)
+{
+	if (COLOR_MAX_CHANNEL == method)
+	{
+		int best = 0;
+		float bestsq = -1.0f;
+		for (int k = 0; k < channels; ++k)
+		{
+			float sq = dx[k]*dx[k] + dy[k]*dy[k];
+			if (sq > bestsq)
 			{
-				float p3 = mag_(i-1, j);
-				float p7 = mag_(i+1, j);
-				isMax = isLocalMax(p0, p3, p7);
+				bestsq = sq;
+				best = k;
 			}
+		}
+		*mag = sqrt(bestsq);
+		//Degrees in [0, 360), as in gradientMagAngle.
+		float ang = (float) (atan2(dy[best], dx[best])*180.0/PI);
+		if (0.0f > ang) ang += 360.0f;
+		*angle = ang;
+		return;
+	}
 
-			if (!isMax)
-				ret_(i, j) = 0.0f;
+	//Di Zenzo: the structure tensor summed over the channels,
+	//[gxx gxy; gxy gyy]. Its larger eigenvalue is the squared
+	//magnitude, and its eigenvector the direction.
+	double gxx = 0.0;
+	double gyy = 0.0;
+	double gxy = 0.0;
+	for (int k = 0; k < channels; ++k)
+	{
+		gxx += dx[k]*dx[k];
+		gyy += dy[k]*dy[k];
+		gxy += dx[k]*dy[k];
+	}
+	double diff = gxx - gyy;
+	double lambda = 0.5*(gxx + gyy + sqrt(diff*diff + 4*gxy*gxy));
+	*mag = (float) sqrt(lambda);
+	float ang = (float) (0.5*atan2(2*gxy, diff)*180.0/PI);
+	if (0.0f > ang) ang += 180.0f;
+	*angle = ang;
+}
+
+Mat
+LauraFilters::nonmaximaSuppression3x3(
+	Mat& mag, Mat& angle)
+{
+	LauraCounters::Stage counters("nonmaximaSuppression3x3",
+		(double) mag.total());
+	Mat ret = LauraMemory::create(mag.rows, mag.cols, mag.type());
+	nonmaximaSuppression3x3(mag, angle, ret, 0, mag.rows);
+	return ret;
+}
+
+void
+LauraFilters::nonmaximaSuppression3x3(Mat& mag, Mat& angle,
+	Mat& dst, int rowStart, int rowEnd)
+{
+	int rows = mag.rows;
+	int cols = mag.cols;
+
+	//mag and angle may be CV_32F or half, so work on float
+	//copies of the three rows in process.
+	//Row r lives in window row r % 3.
+	Mat window = LauraMemory::create(3, cols, CV_32F);
+	Mat angrow = LauraMemory::create(1, cols, CV_32F);
+	Mat out = LauraMemory::create(1, cols, CV_32F);
+	for (int i = rowStart; i < rowEnd; ++i)
+	{
+		//Bring in the rows below (and at first, around) row i.
+		int lstart = (rowStart == i) ? i - 1 : i + 1;
+		for (int r = lstart; r <= i + 1; ++r)
+		{
+			if ((0 <= r) && (rows > r))
+				LauraHalf::loadRow(mag, r, window.ptr<float>(r % 3));
+		}
+		const float* row = window.ptr<float>(i % 3);
+		memcpy(out.ptr<float>(), row, cols*sizeof(float));
+
+		//Pixels on the boundary are passed through.
+		if ((0 < i) && (rows - 1 > i))
+		{
+			LauraHalf::loadRow(angle, i, angrow.ptr<float>());
+			nonmaximaRow(window.ptr<float>((i - 1) % 3), row,
+				window.ptr<float>((i + 1) % 3), angrow.ptr<float>(),
+				cols, out.ptr<float>());
+		}
+		LauraHalf::storeRow(out.ptr<float>(), dst, i);
+	}
+}
+
+void
+LauraFilters::nonmaximaRow(const float* above,
+	const float* row, const float* below,
+	const float* angle, int cols, float* out)
+{
+	for (int j = 1; j < cols - 1; ++j)
+	{
+		//If the pixel is pure black, ignore it.
+		if (!row[j]) continue;
+
+		//Determine edge angle.
+		float ang = angle[j];
+		while (0.0f > ang)
+			ang += 360.0f;
+		while (360.0f < ang)
+			ang -= 360.0f;
+
+		//Direction to thin (degrees).
+		//Either -45, 0, 45, or 90.
+		int thinDir;
+		if ((22.5f > ang) || (337.5f <= ang))
+			thinDir = 0;
+		else if ((22.5f <= ang) && (67.5f > ang))
+			thinDir = 45;
+		else if ((67.5f <= ang) && (112.5f > ang))
+			thinDir = 90;
+		else if ((112.5f <= ang) && (157.5f > ang))
+			thinDir = -45;
+		else if ((157.5f <= ang) && (202.5f > ang))
+			thinDir = 0;
+		else if ((202.5f <= ang) && (247.5f > ang))
+			thinDir = 45;
+		else if ((247.5f <= ang) && (292.5f > ang))
+			thinDir = 90;
+		else if ((292.5f <= ang) && (337.5f > ang))
+			thinDir = -45;
+
+		//Determine whether or not pix in process
+		//is a local maximum.
+		//Using the book's numbering:
+		//P4 P3 P2
+		//P5 P0 P1
+		//P6 P7 P8
+		float p0 = row[j];
+		bool isMax;
+		if (-45 == thinDir)
+		{
+			float p4 = above[j-1];
+			float p8 = below[j+1];
+			isMax = isLocalMax(p0, p4, p8);
+		}
+		else if (0 == thinDir)
+		{
+			float p1 = row[j+1];
+			float p5 = row[j-1];
+			isMax = isLocalMax(p0, p1, p5);
 		}
+		else if (45 == thinDir)
+		{
+			float p2 = above[j+1];
+			float p6 = below[j-1];
+			isMax = isLocalMax(p0, p2, p6);
+		}
+		else //thinDir = 90
+		{
+			float p3 = above[j];
+			float p7 = below[j];
+			isMax = isLocalMax(p0, p3, p7);
+		}
+
+		if (!isMax)
+			out[j] = 0.0f;
 	}
+}
+
+std::vector<Mat>
+LauraFilters::nonmaximaSuppression3x3(std::vector<Mat>& mag,
+	std::vector<Mat>& angle)
+{
+	std::vector<int> types;
+	for (size_t k = 0; k < mag.size(); ++k)
+		types.push_back(mag[k].type());
+	std::vector<Mat> ret = LauraBatch::allocate(mag, types);
+
+	BatchFilterArgs a;
+	a.in1 = &mag;
+	a.in2 = &angle;
+	a.out1 = &ret;
+	a.out2 = NULL;
+	LauraBatch::run(mag, batchNonmaximaFunc, (void*) &a);
 
 	return ret;
 }
@@ -273,7 +1003,7 @@ LauraFilters::nonmaximaSuppression3x3(Mat& mag)
 {
 	//Make return matrix and _ for element access.
 	cv::Mat_<float> mag_ = mag;
-	Mat ret = mag.clone();
+	Mat ret = LauraMemory::clone(mag);
 	cv::Mat_<float> ret_ = ret;
 
 	//For each pixel in process (not considering the boundary).
@@ -341,6 +1071,8 @@ LauraFilters::hysteresisThresholding(
 	Mat& img, float lthresh,
 	float uthresh)
 {
+	LauraCounters::Stage counters("hysteresisThresholding",
+		(double) img.total());
 	//Threshold the image
 	//ubin = upper thresholded image.
 	//lbin = lower thresholded image.
@@ -387,7 +1119,7 @@ LauraFilters::threshold(Mat& img,
 {
 	//Make return matrix and _ for element access.
 	cv::Mat_<float> img_ = img;
-	Mat ret = Mat::zeros(img.rows, img.cols, CV_32F);
+	Mat ret = LauraMemory::zeros(img.rows, img.cols, CV_32F);
 	cv::Mat_<float> ret_ = ret;
 
 	for (int i = 0; i < img.rows; ++i)
@@ -402,30 +1134,49 @@ LauraFilters::threshold(Mat& img,
 	return ret;
 }
 
+Mat
+LauraFilters::median(Mat& img, int size)
+{
+	size |= 1;
+	return rankFilter(img, size, size*size/2);
+}
+
+Mat
+LauraFilters::rankFilter(Mat& img, int size, int rank)
+{
+	LauraCounters::Stage counters("rankFilter", (double) img.total());
+	size |= 1; //The neighborhood needs a center.
+	rank = std::max(0, std::min(size*size - 1, rank));
+	if (CV_8U == img.type())
+	{
+		if (1 >= size)
+			return LauraMemory::clone(img);
+		Mat ret = LauraMemory::create(img.rows, img.cols, CV_8U);
+		int band = std::max(RANK_BAND, 2*size);
+		int bands = (img.rows + band - 1)/band;
+		HistogramRankBody body(img, ret, size, rank, band);
+		cv::parallel_for_(cv::Range(0, bands), body);
+		return ret;
+	}
+
+	Mat src = LauraHalf::toFloat(img);
+	if (1 >= size)
+		return LauraMemory::clone(src);
+	Mat ret = LauraMemory::create(src.rows, src.cols, CV_32F);
+	NetworkRankBody body(src, ret, size, rank, 5 >= size);
+	cv::parallel_for_(cv::Range(0, src.rows), body);
+	return ret;
+}
+
 void
 LauraFilters::correctedMeanStdDev(
 	Mat& img, float* mean, float* stddev)
 {
-	//Generate a mask from img where 0 values are 0 (trivial, of
-	//course) and 255 values are also 0.
-	Mat img8u;
-	img.convertTo(img8u, CV_8U); //Mask must be CV_8U.
-	cv::Mat_<unsigned char> img8u_ = img8u;
-	for (int i = 0; i < img8u.rows; ++i)
-	{
-		for (int j = 0; j < img8u.cols; ++j)
-		{
-			if (255 == img8u_(i, j))
-				img8u_(i, j) = 0;
-		}
-	}
-	
-	//Ask OpenCV to compute mean and stddev without including
-	//the masked points.
-	cv::Scalar tmean, tstd;
-	cv::meanStdDev(img, tmean, tstd, img8u);
-
-	//Convert to float and store in pointers.
-	*mean = (float) tmean(0);
-	*stddev = (float) tstd(0);
+	//Leave out the pixels that would be 0 or 255 once converted
+	//to CV_8U (rounding to nearest), as the old 8-bit mask did.
+	LauraHistogram hist(256, 0.0f, 256.0f);
+	hist.compute(img, 0.5f, 254.5f);
+
+	*mean = hist.mean();
+	*stddev = hist.stddev();
 }
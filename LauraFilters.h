@@ -22,6 +22,7 @@
 #define __LAURAFILTERS_H__
 
 #include <opencv2/opencv.hpp>
+#include <vector>
 using cv::Mat;
 
 class LauraFilters
@@ -38,6 +39,21 @@ public:
 	static Mat gaussian(int fsize1,
 		int fsize2, float sigma);
 
+	//Generates a 1D Gaussian filter
+	//of size 1 row x fsize cols and std. dev. sigma.
+	//gaussian(n, n, sigma) is the outer product of
+	//two of these. Transpose for a column filter.
+	static Mat gaussian1D(int fsize, float sigma);
+
+	//Coefficients of a recursive (IIR) Gaussian of std. dev.
+	//sigma, for LauraConvolution::recursiveGaussian.
+	//Uses the 3rd order poles of Young, van Vliet and Verbeek,
+	//scaled so the impulse response has variance sigma^2.
+	//coeffs[0] is the gain B and coeffs[1..3] the feedback:
+	//w[n] = B*x[n] + c1*w[n-1] + c2*w[n-2] + c3*w[n-3],
+	//run forward along a line and then backward.
+	static void recursiveGaussian(float sigma, double* coeffs);
+
 	//Generates a 3x3 Laplacian filter.
 	static Mat laplacian();
 
@@ -51,24 +67,121 @@ public:
 	//3x3 Sobel gradient estimate in y
 	static Mat gy3x3();
 
+	//The filter that convolving with first and then with second
+	//amounts to: their full convolution, (m1 + m2 - 1) x
+	//(n1 + n2 - 1), so one pass instead of two. Sizes must be
+	//odd. Same result as the two passes but within second's
+	//reach of the edges, where second reads mirrored samples of
+	//first's result rather than of the image.
+	static Mat compose(Mat& first, Mat& second);
+	//Same, as the separable filter ky * kx (see
+	//LauraConvolution::convolveSeparable), if first and second
+	//are both separable: their rows and their columns are
+	//composed apart. Returns false, leaving kx and ky alone,
+	//if either is not.
+	static bool compose(Mat& first, Mat& second, Mat& kx, Mat& ky);
+
 	/***** Filters for the whole image ****/
 
 	//Finds zero-crossings in an image
 	//by looking in a 3x3 neighborhood.
 	static Mat zeroCross3x3(Mat& img);
+	//Helper for zeroCross3x3 and LoGEdge.
+	//Marks zero-crossings in row given the rows
+	//above and below it. deps is the threshold
+	//for a significant difference. Leaves the first
+	//and last pixels of out alone.
+	static void zeroCrossRow(const float* above,
+		const float* row, const float* below,
+		int cols, float deps, float* out);
 	//Helper function for zeroCross3x3
 	//Determines whether two intensities
 	//are on opposite sides of I = 0.
 	//eps is the threshold for a significant difference.
 	static bool opposingPair(float p1, float p2, float eps);
 
+	//LoG edge detection in two passes over memory.
+	//Convolves img with an fsize x fsize LoG of std. dev.
+	//sigma while accumulating its mean and std. dev., then
+	//finds zero-crossings of the mean-subtracted response.
+	//filtered receives the mean-subtracted LoG image.
+	//mean and stddev (may be NULL) receive its statistics.
+	static Mat LoGEdge(Mat& img, int fsize, float sigma,
+		Mat& filtered, float* mean, float* stddev);
+	//Second pass of LoGEdge, for LoG responses made some
+	//other way (e.g. LauraScaleSpace::DoG).
+	//Subtracts mean from filtered in place and returns its
+	//zero-crossings. stddev sets the significant difference.
+	static Mat zeroCrossCentered(Mat& filtered, float mean,
+		float stddev);
+
+	//Computes gradient magnitude and angle (degrees) images
+	//from gx and gy, like cv::magnitude and cv::phase.
+	//Inputs may be CV_32F or half (LauraHalf::TYPE); the
+	//outputs are stored the same way.
+	//If gx and gy have 3 or 4 channels (CV_32F), the channels
+	//are combined as by colorGradient with COLOR_DI_ZENZO and
+	//the outputs have one channel.
+	static void gradientMagAngle(Mat& gx, Mat& gy,
+		Mat& mag, Mat& angle);
+	//Same, for rows rowStart to rowEnd - 1 only.
+	//mag and angle must already be allocated.
+	static void gradientMagAngle(Mat& gx, Mat& gy,
+		Mat& mag, Mat& angle, int rowStart, int rowEnd);
+	//Same, for a batch of images (see LauraBatch).
+	static void gradientMagAngle(std::vector<Mat>& gx,
+		std::vector<Mat>& gy, std::vector<Mat>& mag,
+		std::vector<Mat>& angle);
+
+	//Ways to combine the channels of a colour gradient.
+	enum
+	{
+		COLOR_MAX_CHANNEL, //Gradient of the channel that changes most.
+		COLOR_DI_ZENZO     //Di Zenzo: strongest direction of the
+		                   //summed structure tensor. Angles are
+		                   //in [0, 180), as edges have no sign.
+	};
+	//Gradient magnitude and angle (degrees) of a CV_32F image
+	//with 1, 3 or 4 interleaved channels, in one pass: each 3x3
+	//neighborhood is read once and gx3x3 and gy3x3 are applied
+	//to all its channels, which are combined by method.
+	//mag and angle have one channel (CV_32F, or half if they
+	//are already allocated that way).
+	static void colorGradient(Mat& img, Mat& mag, Mat& angle,
+		int method);
+	//Same, for rows rowStart to rowEnd - 1 only.
+	//mag and angle must already be allocated.
+	static void colorGradient(Mat& img, Mat& mag, Mat& angle,
+		int method, int rowStart, int rowEnd);
+	//Helper for the colour gradients.
+	//Combines the x and y derivatives of each of channels
+	//channels into one magnitude and angle, by method.
+	static void combineChannels(const float* dx, const float* dy,
+		int channels, int method, float* mag, float* angle);
+
 	//Performs nonmaxima suppression
 	//Requires a gradient magnitude and
 	//a gradient angle (phase) image.
 	//angle must be in degrees!!!!
 	//Only examines a 3x3 neighborhood.
+	//mag and angle may be CV_32F or half; the result
+	//is stored like mag.
 	static Mat nonmaximaSuppression3x3(
 		Mat& mag, Mat& angle);
+	//Same, writing rows rowStart to rowEnd - 1 of the
+	//result into dst, which must already be allocated.
+	static void nonmaximaSuppression3x3(Mat& mag, Mat& angle,
+		Mat& dst, int rowStart, int rowEnd);
+	//Same, for a batch of images (see LauraBatch).
+	static std::vector<Mat> nonmaximaSuppression3x3(
+		std::vector<Mat>& mag, std::vector<Mat>& angle);
+	//Helper for nonmaximaSuppression3x3.
+	//Zeros the pixels of out (a copy of row) that are not
+	//local maxima across the edge. Leaves the first and last
+	//pixels alone.
+	static void nonmaximaRow(const float* above,
+		const float* row, const float* below,
+		const float* angle, int cols, float* out);
 	//Performs nonmaxima suppression on blobs (all angles at once).
 	//Only works on a 3x3.
 	static Mat nonmaximaSuppression3x3(Mat& mag);
@@ -92,6 +205,22 @@ public:
 	static Mat threshold(Mat& img,
 		float thesh);
 
+	//Median of each size x size neighborhood (size odd; an even
+	//size is rounded up), for impulse (salt and pepper) noise on
+	//gray images: unlike smoothing, it drops outliers and keeps
+	//edges. The image is mirror-padded as in addMirroredBoundaries.
+	//CV_8U images give CV_8U and run by the sliding histograms
+	//of Perreault and Hebert, at a cost per pixel that does not
+	//grow with size. CV_32F or half images give CV_32F; 3x3 and
+	//5x5 run through selection networks (min and max only, a
+	//run of pixels at a time), larger sizes by partially sorting
+	//each neighborhood.
+	static Mat median(Mat& img, int size);
+	//Same, for the value of rank rank in each sorted neighborhood:
+	//0 is the min, size*size/2 the median and size*size - 1 the
+	//max. rank is clamped to that range.
+	static Mat rankFilter(Mat& img, int size, int rank);
+
 	/**** Functions returning scalars ***/
 	//Computes mean and standard deviation
 	//for the image and returns them as 
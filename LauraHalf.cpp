@@ -0,0 +1,226 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "LauraHalf.h"
+#include "LauraMemory.h"
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define LAURA_F16C 1
+#endif
+
+//Software conversions, also used for the tails of the F16C loops
+//so that every pixel rounds the same way.
+static unsigned short
+floatToHalf(float f)
+{
+	unsigned int x;
+	memcpy(&x, &f, sizeof(x));
+	unsigned int sign = (x >> 16) & 0x8000;
+	unsigned int mant = x & 0x007fffff;
+	int exp = (int) ((x >> 23) & 0xff);
+
+	//Inf and NaN (keep NaN quiet).
+	if (0xff == exp)
+		return sign | 0x7c00 | (mant ? 0x200 | (mant >> 13) : 0);
+
+	exp = exp - 127 + 15;
+	if (0x1f <= exp)
+		return sign | 0x7c00; //Overflow to inf.
+
+	if (0 >= exp)
+	{
+		//Denormal or zero in half.
+		if (-10 > exp)
+			return sign;
+		mant |= 0x00800000;
+		int shift = 14 - exp;
+		unsigned int h = mant >> shift;
+		unsigned int rem = mant & ((1u << shift) - 1);
+		unsigned int halfway = 1u << (shift - 1);
+		if ((rem > halfway) || ((rem == halfway) && (h & 1)))
+			++h;
+		return sign | h;
+	}
+
+	unsigned int h = ((unsigned int) exp << 10) | (mant >> 13);
+	unsigned int rem = mant & 0x1fff;
+	//A carry out of the mantissa correctly bumps the exponent.
+	if ((rem > 0x1000) || ((rem == 0x1000) && (h & 1)))
+		++h;
+	return sign | h;
+}
+
+static float
+halfToFloat(unsigned short h)
+{
+	unsigned int sign = (unsigned int) (h & 0x8000) << 16;
+	unsigned int exp = (h >> 10) & 0x1f;
+	unsigned int mant = h & 0x3ff;
+	unsigned int x;
+
+	if (0 == exp)
+	{
+		//Zero or denormal: mant * 2^-24.
+		float f = ldexpf((float) mant, -24);
+		return (h & 0x8000) ? -f : f;
+	}
+	else if (0x1f == exp)
+		x = sign | 0x7f800000 | (mant << 13) | (mant ? 0x400000 : 0);
+	else
+		x = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+
+	float f;
+	memcpy(&f, &x, sizeof(f));
+	return f;
+}
+
+#ifdef LAURA_F16C
+__attribute__((target("avx,f16c")))
+static void
+packRowF16C(const float* src, unsigned short* dst, int n)
+{
+	int j = 0;
+	for (; j + 8 <= n; j += 8)
+	{
+		__m256 v = _mm256_loadu_ps(src + j);
+		__m128i h = _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT);
+		_mm_storeu_si128((__m128i*) (dst + j), h);
+	}
+	for (; j < n; ++j)
+		dst[j] = floatToHalf(src[j]);
+}
+
+__attribute__((target("avx,f16c")))
+static void
+unpackRowF16C(const unsigned short* src, float* dst, int n)
+{
+	int j = 0;
+	for (; j + 8 <= n; j += 8)
+	{
+		__m128i h = _mm_loadu_si128((const __m128i*) (src + j));
+		_mm256_storeu_ps(dst + j, _mm256_cvtph_ps(h));
+	}
+	for (; j < n; ++j)
+		dst[j] = halfToFloat(src[j]);
+}
+#endif
+
+LauraHalf::LauraHalf()
+{
+
+}
+
+LauraHalf::~LauraHalf()
+{
+
+}
+
+bool
+LauraHalf::hasF16C()
+{
+#ifdef LAURA_F16C
+	static const bool has = __builtin_cpu_supports("avx") &&
+		__builtin_cpu_supports("f16c");
+	return has;
+#else
+	return false;
+#endif
+}
+
+void
+LauraHalf::packRow(const float* src, unsigned short* dst, int n)
+{
+#ifdef LAURA_F16C
+	if (hasF16C())
+	{
+		packRowF16C(src, dst, n);
+		return;
+	}
+#endif
+	for (int j = 0; j < n; ++j)
+		dst[j] = floatToHalf(src[j]);
+}
+
+void
+LauraHalf::unpackRow(const unsigned short* src, float* dst, int n)
+{
+#ifdef LAURA_F16C
+	if (hasF16C())
+	{
+		unpackRowF16C(src, dst, n);
+		return;
+	}
+#endif
+	for (int j = 0; j < n; ++j)
+		dst[j] = halfToFloat(src[j]);
+}
+
+Mat
+LauraHalf::pack(Mat& img)
+{
+	assert(img.type() == CV_32F);
+	Mat ret = LauraMemory::create(img.rows, img.cols, TYPE);
+	for (int i = 0; i < img.rows; ++i)
+		packRow(img.ptr<float>(i), ret.ptr<unsigned short>(i), img.cols);
+	return ret;
+}
+
+Mat
+LauraHalf::unpack(Mat& himg)
+{
+	assert(himg.type() == TYPE);
+	Mat ret = LauraMemory::create(himg.rows, himg.cols, CV_32F);
+	for (int i = 0; i < himg.rows; ++i)
+		unpackRow(himg.ptr<unsigned short>(i), ret.ptr<float>(i),
+			himg.cols);
+	return ret;
+}
+
+Mat
+LauraHalf::toFloat(Mat& img)
+{
+	if (TYPE == img.type())
+		return unpack(img);
+	return img;
+}
+
+void
+LauraHalf::loadRow(Mat& img, int i, float* dst)
+{
+	if (TYPE == img.type())
+		unpackRow(img.ptr<unsigned short>(i), dst, img.cols);
+	else
+		memcpy(dst, img.ptr<float>(i),
+			img.cols*img.channels()*sizeof(float));
+}
+
+void
+LauraHalf::storeRow(const float* src, Mat& img, int i)
+{
+	if (TYPE == img.type())
+		packRow(src, img.ptr<unsigned short>(i), img.cols);
+	else
+		memcpy(img.ptr<float>(i), src,
+			img.cols*img.channels()*sizeof(float));
+}
@@ -0,0 +1,64 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef __LAURAHALF_H__
+#define __LAURAHALF_H__
+
+#include <opencv2/opencv.hpp>
+using cv::Mat;
+
+//IEEE half precision storage for intermediate images.
+//OpenCV has no half type, so half images are CV_16U Mats
+//holding the raw 16-bit patterns. Only storage is half;
+//everything that reads one converts to float first, row by row,
+//and accumulates in float.
+//Uses F16C when the CPU has it.
+class LauraHalf
+{
+public:
+	LauraHalf();
+	~LauraHalf();
+
+	//Type used for half precision images.
+	enum { TYPE = CV_16U };
+
+	//Whether the conversions run on F16C.
+	static bool hasF16C();
+
+	//Converts n floats to half, rounding to nearest even.
+	static void packRow(const float* src, unsigned short* dst, int n);
+	//Converts n halves to float.
+	static void unpackRow(const unsigned short* src, float* dst, int n);
+
+	//Converts a CV_32F image to half storage.
+	static Mat pack(Mat& img);
+	//Converts a half image back to CV_32F.
+	static Mat unpack(Mat& himg);
+
+	//Returns img as CV_32F, unpacking only if it is half.
+	static Mat toFloat(Mat& img);
+	//Loads row i of img (CV_32F or half) into dst as floats.
+	//CV_32F images may have several (interleaved) channels.
+	static void loadRow(Mat& img, int i, float* dst);
+	//Stores src as row i of img (CV_32F or half), the same way.
+	static void storeRow(const float* src, Mat& img, int i);
+};
+
+#endif //!defined __LAURAHALF_H__
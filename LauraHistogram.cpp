@@ -0,0 +1,253 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "LauraHistogram.h"
+#include <assert.h>
+#include <algorithm>
+#include <cmath>
+using cv::Range;
+
+//Loop body for LauraHistogram::compute.
+//Each stripe of rows is binned into a private histogram,
+//which is merged into the shared one once at the end.
+class HistogramBody : public cv::ParallelLoopBody
+{
+	Mat& img;
+	LauraHistogram& hist;
+	LauraHistogram proto; //Empty histogram with the right bins.
+	float mlo;
+	float mhi;
+	cv::Mutex& lock;
+public:
+	HistogramBody(Mat& img, LauraHistogram& hist,
+		const LauraHistogram& proto, float mlo, float mhi,
+		cv::Mutex& lock)
+		: img(img), hist(hist), proto(proto), mlo(mlo), mhi(mhi),
+		  lock(lock)
+	{
+
+	}
+
+	virtual void operator()(const Range& range) const
+	{
+		LauraHistogram local = proto;
+		for (int i = range.start; i < range.end; ++i)
+			local.accumulate(img.ptr<float>(i), img.cols, mlo, mhi);
+
+		cv::AutoLock guard(lock);
+		hist.merge(local);
+	}
+};
+
+LauraHistogram::LauraHistogram(int nbins, float lo, float hi)
+	: nbins(nbins), lo(lo), hi(hi), bins(nbins, 0.0)
+{
+	scale = nbins/(hi - lo);
+	clear();
+}
+
+LauraHistogram::~LauraHistogram()
+{
+
+}
+
+void
+LauraHistogram::range(int* nbins, float* lo, float* hi) const
+{
+	*nbins = this->nbins;
+	*lo = this->lo;
+	*hi = this->hi;
+}
+
+void
+LauraHistogram::clear()
+{
+	std::fill(bins.begin(), bins.end(), 0.0);
+	n = 0.0;
+	sum = 0.0;
+	sumsq = 0.0;
+}
+
+int
+LauraHistogram::binOf(float v) const
+{
+	float b = (v - lo)*scale;
+	if (0.0f >= b) return 0;
+	if ((float) nbins <= b) return nbins - 1;
+	return (int) b;
+}
+
+void
+LauraHistogram::compute(Mat& img, float mlo, float mhi)
+{
+	assert(img.type() == CV_32F);
+	clear();
+
+	LauraHistogram proto(nbins, lo, hi);
+	cv::Mutex lock;
+	//A few stripes per thread keeps the merges cheap while
+	//still balancing the load.
+	cv::parallel_for_(Range(0, img.rows),
+		HistogramBody(img, *this, proto, mlo, mhi, lock),
+		4*cv::getNumThreads());
+}
+
+void
+LauraHistogram::accumulate(const float* vals, int count)
+{
+	for (int j = 0; j < count; ++j)
+	{
+		float v = vals[j];
+		if (v != v) continue; //NaN
+		bins[binOf(v)] += 1.0;
+		n += 1.0;
+		sum += v;
+		sumsq += (double) v*v;
+	}
+}
+
+void
+LauraHistogram::accumulate(const float* vals, int count,
+	float mlo, float mhi)
+{
+	for (int j = 0; j < count; ++j)
+	{
+		float v = vals[j];
+		//Written so that NaN is masked out too.
+		if (!((mlo <= v) && (mhi > v))) continue;
+		bins[binOf(v)] += 1.0;
+		n += 1.0;
+		sum += v;
+		sumsq += (double) v*v;
+	}
+}
+
+void
+LauraHistogram::merge(const LauraHistogram& other)
+{
+	assert(other.nbins == nbins);
+	for (int b = 0; b < nbins; ++b)
+		bins[b] += other.bins[b];
+	n += other.n;
+	sum += other.sum;
+	sumsq += other.sumsq;
+}
+
+void
+LauraHistogram::pack(double* out) const
+{
+	for (int b = 0; b < nbins; ++b)
+		out[b] = bins[b];
+	out[nbins] = n;
+	out[nbins + 1] = sum;
+	out[nbins + 2] = sumsq;
+}
+
+void
+LauraHistogram::unpack(const double* in)
+{
+	for (int b = 0; b < nbins; ++b)
+		bins[b] = in[b];
+	n = in[nbins];
+	sum = in[nbins + 1];
+	sumsq = in[nbins + 2];
+}
+
+double
+LauraHistogram::count() const
+{
+	return n;
+}
+
+float
+LauraHistogram::mean() const
+{
+	if (0.0 == n) return 0.0f;
+	return (float) (sum/n);
+}
+
+float
+LauraHistogram::stddev() const
+{
+	if (0.0 == n) return 0.0f;
+	double m = sum/n;
+	double var = sumsq/n - m*m;
+	if (0.0 > var) var = 0.0; //Rounding.
+	return (float) sqrt(var);
+}
+
+float
+LauraHistogram::percentile(float p) const
+{
+	if (0.0 == n) return lo;
+
+	double target = p*n;
+	double cum = 0.0;
+	for (int b = 0; b < nbins; ++b)
+	{
+		if (cum + bins[b] >= target)
+		{
+			//Spread the bin's pixels evenly across its width.
+			double frac = (0.0 < bins[b]) ?
+				(target - cum)/bins[b] : 0.0;
+			return lo + (float) ((b + frac)/scale);
+		}
+		cum += bins[b];
+	}
+
+	return hi;
+}
+
+float
+LauraHistogram::otsu() const
+{
+	if (0.0 == n) return lo;
+
+	//Bin centers stand in for the intensities.
+	double total = 0.0;
+	for (int b = 0; b < nbins; ++b)
+		total += bins[b]*(b + 0.5);
+
+	//Maximize the between-class variance
+	//w0*w1*(m0 - m1)^2 over split points.
+	double w0 = 0.0;
+	double sum0 = 0.0;
+	double best = -1.0;
+	int bestBin = 0;
+	for (int b = 0; b < nbins - 1; ++b)
+	{
+		w0 += bins[b];
+		sum0 += bins[b]*(b + 0.5);
+		double w1 = n - w0;
+		if ((0.0 == w0) || (0.0 >= w1)) continue;
+
+		double m0 = sum0/w0;
+		double m1 = (total - sum0)/w1;
+		double between = w0*w1*(m0 - m1)*(m0 - m1);
+		if (between > best)
+		{
+			best = between;
+			bestBin = b;
+		}
+	}
+
+	//Class 0 is bins 0 to bestBin; the threshold is its upper edge.
+	return lo + (bestBin + 1)/scale;
+}
@@ -0,0 +1,91 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef __LAURAHISTOGRAM_H__
+#define __LAURAHISTOGRAM_H__
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+using cv::Mat;
+
+//Histogram of a float image plus its exact first two moments.
+//Built in one streaming pass; masked mean/std. dev., percentiles
+//and Otsu thresholds are all read back from it afterwards.
+class LauraHistogram
+{
+	int nbins;
+	float lo;
+	float hi;
+	float scale; //bins per unit intensity
+
+	std::vector<double> bins;
+	double n;
+	double sum;
+	double sumsq;
+
+	//Bin holding value v. Out of range values go to the end bins.
+	int binOf(float v) const;
+public:
+	//nbins bins evenly spanning [lo, hi).
+	LauraHistogram(int nbins, float lo, float hi);
+	~LauraHistogram();
+
+	//The bins it was made with.
+	void range(int* nbins, float* lo, float* hi) const;
+	//Forget everything accumulated so far.
+	void clear();
+
+	//Builds the histogram of a CV_32F image in one parallel pass.
+	//Each thread fills its own histogram; they are merged at the end.
+	//Only pixels in [mlo, mhi) are counted, the rest are masked out.
+	void compute(Mat& img, float mlo, float mhi);
+
+	//Adds n values to the histogram.
+	//For stages that want statistics of what they produce
+	//without a separate pass.
+	void accumulate(const float* vals, int n);
+	//Same, but only values in [mlo, mhi) are counted.
+	void accumulate(const float* vals, int n, float mlo, float mhi);
+
+	//Adds the contents of other, which must have the same bins.
+	void merge(const LauraHistogram& other);
+	//Copies the contents into nbins + 3 doubles (the bins, then
+	//count, sum and sum of squares), for sending elsewhere.
+	void pack(double* out) const;
+	//Replaces the contents with what pack() gave for a histogram
+	//with the same bins.
+	void unpack(const double* in);
+
+	/**** Statistics of the counted pixels ****/
+	//Number of pixels counted.
+	double count() const;
+	//Mean and std. dev. (exact, not binned).
+	float mean() const;
+	float stddev() const;
+	//Intensity below which a fraction p (0 to 1) of the counted
+	//pixels lie. Interpolates linearly inside a bin.
+	float percentile(float p) const;
+	//Otsu's threshold: the intensity that best splits the
+	//counted pixels into two classes. Pixels above it are the
+	//foreground, as in LauraFilters::threshold.
+	float otsu() const;
+};
+
+#endif //!defined __LAURAHISTOGRAM_H__
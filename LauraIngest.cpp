@@ -0,0 +1,200 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "LauraIngest.h"
+#include "LauraHalf.h"
+#include "LauraMemory.h"
+#include <algorithm>
+#include <assert.h>
+#include <vector>
+
+//Whether imread can decode at a reduced size.
+#if (CV_MAJOR_VERSION > 3) || \
+	((3 == CV_MAJOR_VERSION) && (2 <= CV_MINOR_VERSION))
+#define LAURAINGEST_REDUCED_DECODE 1
+#endif
+
+namespace
+{
+//Adds the pixels of src, cols of cn channels, to the sums of the
+//blocks of scale columns they fall in.
+template <typename T>
+void
+accumulateRow(const T* src, int cols, int cn, int scale, float* sum)
+{
+	for (int j = 0; j < cols; ++j)
+	{
+		float* s = sum + (j/scale)*cn;
+		for (int c = 0; c < cn; ++c)
+			s[c] += src[j*cn + c];
+	}
+}
+}
+
+LauraIngest::LauraIngest(int scale, int type):
+	scale(scale), type(type)
+{
+	assert(isScale(scale));
+	assert((CV_32F == type) || (LauraHalf::TYPE == type));
+}
+
+LauraIngest::~LauraIngest()
+{
+
+}
+
+bool
+LauraIngest::isScale(int scale)
+{
+	return (1 == scale) || (2 == scale) || (4 == scale) || (8 == scale);
+}
+
+Mat
+LauraIngest::decode(const std::string& path, bool color, int scale,
+	int& remaining)
+{
+	remaining = scale;
+#ifdef LAURAINGEST_REDUCED_DECODE
+	//JPEGs are decoded at the smaller size (the DCT is cut
+	//short), anything else is decoded and resized by imread.
+	int flags = color ? cv::IMREAD_COLOR : cv::IMREAD_GRAYSCALE;
+	switch (scale)
+	{
+	case 2:
+		flags = color ? cv::IMREAD_REDUCED_COLOR_2 :
+			cv::IMREAD_REDUCED_GRAYSCALE_2;
+		break;
+	case 4:
+		flags = color ? cv::IMREAD_REDUCED_COLOR_4 :
+			cv::IMREAD_REDUCED_GRAYSCALE_4;
+		break;
+	case 8:
+		flags = color ? cv::IMREAD_REDUCED_COLOR_8 :
+			cv::IMREAD_REDUCED_GRAYSCALE_8;
+		break;
+	}
+	remaining = 1;
+	return cv::imread(path, flags);
+#else
+	return cv::imread(path, color ? CV_LOAD_IMAGE_COLOR :
+		CV_LOAD_IMAGE_GRAYSCALE);
+#endif
+}
+
+Mat
+LauraIngest::loadGray(const std::string& path)
+{
+	Mat img;
+	int remaining = scale;
+	if (LauraRaw::isRaw(path))
+	{
+		img = raw.load(path);
+		if (!img.data)
+			return img;
+		if ((1 == scale) && (type == img.type()))
+			return img;
+		if (1 < img.channels())
+			cv::cvtColor(img, img, CV_BGR2GRAY);
+	}
+	else
+		img = decode(path, false, scale, remaining);
+	if (!img.data)
+		return img;
+	return convert(img, remaining, type);
+}
+
+Mat
+LauraIngest::loadColor(const std::string& path)
+{
+	assert(CV_32F == type);
+	Mat img;
+	int remaining = scale;
+	if (LauraRaw::isRaw(path))
+	{
+		img = raw.load(path);
+		if (!img.data)
+			return img;
+		if ((1 == scale) && (CV_32F == img.depth()))
+			return img;
+	}
+	else
+		img = decode(path, true, scale, remaining);
+	if (!img.data)
+		return img;
+	return convert(img, remaining, type);
+}
+
+Mat
+LauraIngest::convert(Mat& img, int scale, int type)
+{
+	int cn = img.channels();
+	assert(1 <= scale);
+	assert((CV_32F == type) || ((LauraHalf::TYPE == type) && (1 == cn)));
+	Mat src = img;
+	if ((CV_8U != src.depth()) && (CV_16U != src.depth()) &&
+		(CV_32F != src.depth()))
+		src.convertTo(src, CV_MAKETYPE(CV_32F, cn));
+
+	int rows = (src.rows + scale - 1)/scale;
+	int cols = (src.cols + scale - 1)/scale;
+	Mat ret = LauraMemory::create(rows, cols,
+		(CV_32F == type) ? CV_MAKETYPE(CV_32F, cn) : type);
+	std::vector<float> sum(cols*cn);
+	for (int i = 0; i < rows; ++i)
+	{
+		//Sums each block of source rows into the output row.
+		int rowEnd = std::min((i + 1)*scale, src.rows);
+		std::fill(sum.begin(), sum.end(), 0.0f);
+		for (int r = i*scale; r < rowEnd; ++r)
+		{
+			switch (src.depth())
+			{
+			case CV_8U:
+				accumulateRow(src.ptr<uchar>(r), src.cols, cn, scale, &sum[0]);
+				break;
+			case CV_16U:
+				accumulateRow(src.ptr<unsigned short>(r), src.cols, cn, scale,
+					&sum[0]);
+				break;
+			default:
+				accumulateRow(src.ptr<float>(r), src.cols, cn, scale, &sum[0]);
+			}
+		}
+
+		//Means of the blocks, smaller at the right and bottom.
+		if (1 < scale)
+		{
+			int height = rowEnd - i*scale;
+			for (int j = 0; j < cols; ++j)
+			{
+				int width = std::min((j + 1)*scale, src.cols) - j*scale;
+				float norm = 1.0f/(width*height);
+				for (int c = 0; c < cn; ++c)
+					sum[j*cn + c] *= norm;
+			}
+		}
+
+		if (CV_32F == type)
+			std::copy(sum.begin(), sum.end(), ret.ptr<float>(i));
+		else
+			LauraHalf::packRow(&sum[0], ret.ptr<unsigned short>(i), cols);
+	}
+	return ret;
+}
@@ -0,0 +1,75 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef __LAURAINGEST_H__
+#define __LAURAINGEST_H__
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include "LauraRaw.h"
+using cv::Mat;
+
+//Reads images into the form the pipelines work on, in as few
+//passes as possible: encoded images are decoded straight to
+//grayscale (not to colour, then converted), at 1/scale of their
+//size if the pipeline works at a lower resolution, and then
+//reduced and converted to the working type in one pass.
+//On OpenCV 3.2 and later JPEGs are decoded at the reduced size
+//itself; before that they are decoded whole and reduced while
+//being converted.
+//Raw (.lraw) files are mapped (see LauraRaw), and come back as
+//the mapping with no copy when they already have the working
+//type and no reduction is asked for. The mappings live as long
+//as the LauraIngest, so it must outlive the Mats.
+class LauraIngest
+{
+	LauraRaw raw;
+	int scale;
+	int type;
+
+	//Decodes path with imread, gray or in colour, as small as
+	//the decoder can make it for scale. Sets remaining to the
+	//reduction still to be done.
+	static Mat decode(const std::string& path, bool color, int scale,
+		int& remaining);
+public:
+	//scale is 1, 2, 4 or 8: images are read at 1/scale of their
+	//width and height (rounded up), each pixel the mean of a
+	//scale x scale block. type is CV_32F or LauraHalf::TYPE.
+	LauraIngest(int scale, int type);
+	~LauraIngest();
+
+	//Whether scale is one LauraIngest takes.
+	static bool isScale(int scale);
+
+	//The image in path as one channel of the working type.
+	//Returns an empty Mat if it cannot be read.
+	Mat loadGray(const std::string& path);
+	//Same, keeping the colour channels (BGR, as imread gives
+	//them). The working type must be CV_32F: half images have
+	//one channel.
+	Mat loadColor(const std::string& path);
+
+	//img (CV_8U, CV_16U or CV_32F, any number of channels) made
+	//1/scale the size and converted to type, in one pass.
+	static Mat convert(Mat& img, int scale, int type);
+};
+
+#endif //!defined __LAURAINGEST_H__
@@ -0,0 +1,547 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "LauraJobs.h"
+#include "LauraBinary.h"
+#include "LauraConvolution.h"
+#include "LauraCounters.h"
+#include "LauraFilters.h"
+#include "LauraHalf.h"
+#include "LauraHistogram.h"
+#include "LauraIngest.h"
+#include "LauraMemory.h"
+#include "LauraScaleSpace.h"
+#include "LauraSparse.h"
+#include "LauraTaskGraph.h"
+#include <algorithm>
+#include <cfloat>
+#include <stdio.h>
+#include <vector>
+
+//Keeps the corner signal finite where there is no gradient.
+#define HARRIS_EPS 1e-7
+//Default settings, at the kernel sizes of LauraBudget::ladder's
+//first configurations.
+#define CANNY_SIGMA 1.0f
+#define CANNY_KL 1.5f
+#define CANNY_KU 0.7f
+#define HARRIS_SIGMA 1.3f
+#define HARRIS_THRESH 50.0f
+#define HARRIS_DOTS 7
+#define LOG_SIGMA 2.0f
+#define DOG_SIGMA 2.0f
+#define DOG_K 1.6f
+
+namespace
+{
+//Sigma for a ksize kernel in pipeline name, keeping the ratio of
+//sigma to size of the default kernel (which keeps its sigma
+//exactly).
+float
+scaledSigma(const std::string& name, int ksize, float defaultSigma)
+{
+	int defaultSize = LauraBudget::ladder(name)[0].ksize;
+	if (defaultSize == ksize)
+		return defaultSigma;
+	return defaultSigma*ksize/defaultSize;
+}
+}
+
+LauraJobs::Workspace::Workspace()
+	: convTuner(false, NULL), nthreads(0)
+{
+
+}
+
+LauraJobs::Workspace::~Workspace()
+{
+
+}
+
+Mat&
+LauraJobs::Workspace::gaussian(int fsize1, int fsize2, float sigma)
+{
+	char key[64];
+	snprintf(key, sizeof(key), "%d %d %g", fsize1, fsize2, sigma);
+	Mat& filter = kernels[key];
+	if (!filter.data)
+		filter = LauraFilters::gaussian(fsize1, fsize2, sigma);
+	return filter;
+}
+
+Mat&
+LauraJobs::Workspace::buffer(const std::string& name, int rows,
+	int cols, int type)
+{
+	Mat& buf = buffers[name];
+	LauraMemory::create(buf, rows, cols, type);
+	return buf;
+}
+
+LauraTuner&
+LauraJobs::Workspace::tuner()
+{
+	return convTuner;
+}
+
+std::map<std::string, Mat>
+LauraJobs::Workspace::buffersOf(const std::string& name)
+{
+	std::string prefix = name + ".";
+	std::map<std::string, Mat> ret;
+	std::map<std::string, Mat>::iterator it;
+	for (it = buffers.lower_bound(prefix); (buffers.end() != it) &&
+		(0 == it->first.compare(0, prefix.size(), prefix)); ++it)
+		ret.insert(*it);
+	return ret;
+}
+
+LauraBudget&
+LauraJobs::Workspace::budget()
+{
+	return costs;
+}
+
+void
+LauraJobs::Workspace::setThreads(int nthreads)
+{
+	this->nthreads = nthreads;
+	convTuner.setThreads(nthreads);
+}
+
+int
+LauraJobs::Workspace::threads() const
+{
+	return nthreads;
+}
+
+float
+LauraJobs::param(const Params& params, const std::string& key,
+	float def)
+{
+	Params::const_iterator it = params.find(key);
+	return (params.end() == it) ? def : it->second;
+}
+
+Mat
+LauraJobs::run(const std::string& name, Mat& img, const Params& params,
+	Workspace& ws)
+{
+	LauraCounters::Stage counters(name, (double) img.total());
+	if ("canny" == name)
+		return canny(img, params, ws);
+	if ("harris" == name)
+		return harris(img, params, ws);
+	if ("lapLine" == name)
+		return lapLine(img, params, ws);
+	if ("logEdge" == name)
+		return logEdge(img, params, ws);
+	return Mat();
+}
+
+Mat
+LauraJobs::run(const std::string& name, Mat& img, const Params& params,
+	Workspace& ws, LauraCache& cache)
+{
+	//A budgeted result depends on the load, not just the inputs.
+	if (!cache.enabled() || (0 < param(params, "budget", 0)))
+		return run(name, img, params, ws);
+	std::string key = LauraCache::key(img, describe(name, params));
+	Mat ret = cache.get(key, "result");
+	if (ret.data)
+		return ret;
+
+	ret = run(name, img, params, ws);
+	if (!ret.data)
+		return ret;
+	cache.put(key, "result", ret);
+	if (cache.intermediates())
+	{
+		std::map<std::string, Mat> parts = ws.buffersOf(name);
+		std::map<std::string, Mat>::iterator it;
+		for (it = parts.begin(); parts.end() != it; ++it)
+			cache.put(key, it->first, it->second);
+	}
+	return ret;
+}
+
+std::string
+LauraJobs::describe(const std::string& name, const Params& params)
+{
+	int k = LauraBudget::ladder(name)[0].ksize;
+	char ret[256];
+	if ("canny" == name)
+		snprintf(ret, sizeof(ret),
+			"canny ksize=%d sigma=%g half=%g kl=%g ku=%g thin=%g", k,
+			CANNY_SIGMA, param(params, "half", 0),
+			param(params, "kl", CANNY_KL), param(params, "ku", CANNY_KU),
+			param(params, "thin", 0));
+	else if ("harris" == name)
+		snprintf(ret, sizeof(ret),
+			"harris ksize=%d sigma=%g opening=%d dots=%d thresh=%g", k,
+			HARRIS_SIGMA, k, HARRIS_DOTS,
+			param(params, "thresh", HARRIS_THRESH));
+	else if (("logEdge" == name) && param(params, "dog", 0))
+		snprintf(ret, sizeof(ret), "logEdge dog sigma=%g k=%g", DOG_SIGMA,
+			DOG_K);
+	else if ("logEdge" == name)
+		snprintf(ret, sizeof(ret), "logEdge ksize=%d sigma=%g", k,
+			LOG_SIGMA);
+	else if ("lapLine" == name)
+		snprintf(ret, sizeof(ret), "lapLine median=%g thin=%g",
+			param(params, "median", 0), param(params, "thin", 0));
+	else
+		snprintf(ret, sizeof(ret), "%s thin=%g", name.c_str(),
+			param(params, "thin", 0));
+	return ret;
+}
+
+void
+LauraJobs::calibrate(const std::string& name, Mat& img, Workspace& ws)
+{
+	runConfig(name, img, Params(), ws, LauraBudget::ladder(name).back(),
+		&ws.budget());
+}
+
+Mat
+LauraJobs::runConfig(const std::string& name, Mat& img,
+	const Params& params, Workspace& ws, const LauraBudget::Config& c,
+	LauraBudget* budget)
+{
+	Mat work = img;
+	if (1 < c.scale)
+	{
+		LauraBudget::Timer t(budget, "downscale", (double) img.total());
+		work = LauraIngest::convert(img, c.scale, CV_32F);
+	}
+
+	Mat ret;
+	if ("harris" == name)
+		ret = harris(work, params, ws, c, budget);
+	else if ("logEdge" == name)
+		ret = logEdge(work, params, ws, c, budget);
+	else
+		ret = canny(work, params, ws, c, budget);
+
+	//Nearest, so edges and dots stay 0 or 255.
+	if (1 < c.scale)
+	{
+		LauraBudget::Timer t(budget, "upscale", (double) img.total());
+		Mat full;
+		cv::resize(ret, full, cv::Size(img.cols, img.rows), 0, 0,
+			cv::INTER_NEAREST);
+		ret = full;
+	}
+	return ret;
+}
+
+Mat
+LauraJobs::budgeted(const std::string& name, Mat& img,
+	const Params& params, Workspace& ws)
+{
+	LauraBudget& budget = ws.budget();
+	LauraBudget::Config c = budget.choose(name, img.rows, img.cols,
+		param(params, "budget", 0)/1000.0);
+	int64 start = cv::getTickCount();
+	Mat ret = runConfig(name, img, params, ws, c, &budget);
+	budget.finish((cv::getTickCount() - start)/cv::getTickFrequency());
+	return ret;
+}
+
+Mat
+LauraJobs::canny(Mat& img, const Params& params, Workspace& ws)
+{
+	if (0 < param(params, "budget", 0))
+		return budgeted("canny", img, params, ws);
+	return canny(img, params, ws, LauraBudget::ladder("canny")[0], NULL);
+}
+
+Mat
+LauraJobs::canny(Mat& img, const Params& params, Workspace& ws,
+	const LauraBudget::Config& c, LauraBudget* budget)
+{
+	int itype = param(params, "half", 0) ? LauraHalf::TYPE : CV_32F;
+	int rows = img.rows;
+	int cols = img.cols;
+
+	Mat& gfilt = ws.gaussian(c.ksize, c.ksize,
+		scaledSigma("canny", c.ksize, CANNY_SIGMA));
+	Mat dxfilt = LauraFilters::gx3x3();
+	Mat dyfilt = LauraFilters::gy3x3();
+	//The Gaussian and Sobel filters composed into separable
+	//derivative of Gaussian filters.
+	Mat kxdx, kydx, kxdy, kydy;
+	LauraFilters::compose(gfilt, dxfilt, kxdx, kydx);
+	LauraFilters::compose(gfilt, dyfilt, kxdy, kydy);
+	Mat& dximg = ws.buffer("canny.dx", rows, cols, itype);
+	Mat& dyimg = ws.buffer("canny.dy", rows, cols, itype);
+	Mat& mag = ws.buffer("canny.mag", rows, cols, itype);
+	Mat& angimg = ws.buffer("canny.angle", rows, cols, itype);
+	Mat& thinned = ws.buffer("canny.thinned", rows, cols, itype);
+
+	double pixels = (double) img.total();
+	{
+		LauraBudget::Timer t(budget,
+			LauraBudget::key("canny.graph", c.ksize), pixels);
+		LauraTaskGraph graph(0);
+		int xstage = graph.addSeparableConvolution(img, kxdx, kydx,
+			dximg, -1);
+		int ystage = graph.addSeparableConvolution(img, kxdy, kydy,
+			dyimg, -1);
+		int mstage = graph.addGradient(dximg, dyimg, mag, angimg,
+			xstage, ystage);
+		graph.addNonmaxima(mag, angimg, thinned, mstage);
+		graph.run(ws.threads());
+	}
+
+	LauraBudget::Timer t(budget, "canny.hysteresis", pixels);
+	//Clamped to 0 to 255, as by the trip through CV_8U in Canny.
+	Mat clamped = LauraHalf::toFloat(thinned);
+	clamped.convertTo(clamped, CV_8U);
+	clamped.convertTo(clamped, CV_32F);
+
+	float tmean, tstd;
+	LauraFilters::correctedMeanStdDev(clamped, &tmean, &tstd);
+	float lthresh = tmean - param(params, "kl", CANNY_KL)*tstd;
+	if (lthresh < 0) lthresh = 0;
+	float uthresh = tmean + param(params, "ku", CANNY_KU)*tstd;
+	if (uthresh > 255) uthresh = 255;
+	Mat edges = LauraSparse::hysteresisThresholding(clamped,
+		lthresh, uthresh);
+	return param(params, "thin", 0) ? LauraBinary::thin(edges) : edges;
+}
+
+Mat
+LauraJobs::harris(Mat& img, const Params& params, Workspace& ws)
+{
+	if (0 < param(params, "budget", 0))
+		return budgeted("harris", img, params, ws);
+	return harris(img, params, ws, LauraBudget::ladder("harris")[0], NULL);
+}
+
+Mat
+LauraJobs::harris(Mat& img, const Params& params, Workspace& ws,
+	const LauraBudget::Config& c, LauraBudget* budget)
+{
+	int k = c.ksize;
+	double pixels = (double) img.total();
+	Mat smoothed;
+	{
+		LauraBudget::Timer t(budget, LauraBudget::key(c.box ?
+			"harris.smooth box" : "harris.smooth gaussian", k), pixels);
+		//The tuner takes a box to its running sums.
+		if (c.box)
+		{
+			Mat box = Mat::ones(k, k, CV_32F)/(float) (k*k);
+			smoothed = ws.tuner().convolve(img, box);
+		}
+		else
+			smoothed = ws.tuner().convolve(img,
+				ws.gaussian(k, k, scaledSigma("harris", k, HARRIS_SIGMA)));
+	}
+	{
+		LauraBudget::Timer t(budget, LauraBudget::key("harris.opening", k),
+			pixels);
+		smoothed = LauraConvolution::opening(smoothed, k, k);
+	}
+
+	LauraBudget::Timer t(budget, "harris.corners", pixels);
+	//The opening comes between the Gaussian and the Sobel
+	//filters, so they cannot be composed; Sobel alone is still
+	//separable.
+	Mat gxfilt = LauraFilters::gx3x3();
+	Mat gyfilt = LauraFilters::gy3x3();
+	Mat kxgx, kygx, kxgy, kygy;
+	LauraConvolution::separate(gxfilt, kxgx, kygx);
+	LauraConvolution::separate(gyfilt, kxgy, kygy);
+	Mat& gx = ws.buffer("harris.gx", img.rows, img.cols, CV_32F);
+	Mat& gy = ws.buffer("harris.gy", img.rows, img.cols, CV_32F);
+	LauraTaskGraph graph(0);
+	graph.addSeparableConvolution(smoothed, kxgx, kygx, gx, -1);
+	graph.addSeparableConvolution(smoothed, kxgy, kygy, gy, -1);
+	graph.run(ws.threads());
+
+	Mat cimg = harrisSignal(gx, gy, 3, 3);
+	Mat thinned = LauraSparse::nonmaximaSuppression3x3(cimg);
+	LauraPipeline corners(thinned);
+	thinned = corners.normalize()
+		.threshold(param(params, "thresh", HARRIS_THRESH)).run();
+	//Dots closer than HARRIS_DOTS pixels in the full image, odd
+	//and at least 3.
+	return removeMultiDots(thinned,
+		std::max(3, (HARRIS_DOTS/c.scale) | 1));
+}
+
+Mat
+LauraJobs::lapLine(Mat& img, const Params& params, Workspace& ws)
+{
+	int median = (int) param(params, "median", 0);
+	Mat denoised = (1 < median) ? LauraJobs::median(img, median | 1) :
+		img;
+	LauraPipeline lines(denoised);
+	removeSP(lines);
+	Mat laplacian = LauraFilters::laplacian();
+	LauraHistogram hist(256, 0.0f, 256.0f);
+	Mat absimg = lines.convolve(laplacian).abs()
+		.histogram(hist, 0.5f, FLT_MAX).run();
+
+	LauraPipeline thin(absimg);
+	thin.threshold(hist.mean() + hist.stddev());
+	removeSP(thin);
+	Mat ret = thin.run(CV_8U);
+	return param(params, "thin", 0) ? LauraBinary::thin(ret) : ret;
+}
+
+Mat
+LauraJobs::logEdge(Mat& img, const Params& params, Workspace& ws)
+{
+	if (!param(params, "dog", 0))
+	{
+		if (0 < param(params, "budget", 0))
+			return budgeted("logEdge", img, params, ws);
+		return logEdge(img, params, ws, LauraBudget::ladder("logEdge")[0],
+			NULL);
+	}
+
+	Mat img2;
+	std::vector<Mat> dogs;
+	LauraScaleSpace::DoG(img, DOG_SIGMA, DOG_K, 1, dogs);
+	img2 = dogs[0];
+	LauraHistogram hist(512, -256.0f, 256.0f);
+	hist.compute(img2, -FLT_MAX, FLT_MAX);
+	return LauraFilters::zeroCrossCentered(img2, hist.mean(),
+		hist.stddev());
+}
+
+Mat
+LauraJobs::logEdge(Mat& img, const Params& params, Workspace& ws,
+	const LauraBudget::Config& c, LauraBudget* budget)
+{
+	LauraBudget::Timer t(budget, LauraBudget::key("log", c.ksize),
+		(double) img.total());
+	Mat img2;
+	float lmean, lstd;
+	return LauraFilters::LoGEdge(img, c.ksize,
+		scaledSigma("logEdge", c.ksize, LOG_SIGMA), img2, &lmean, &lstd);
+}
+
+//Filter to remove Salt & Pepper noise
+//Adds the steps to pipeline.
+void
+LauraJobs::removeSP(LauraPipeline& pipeline)
+{
+	Mat pepper5 = (cv::Mat_<float>(5, 5)
+		<< 1, 1, 1, 1, 1,
+		   1, 2, 2, 2, 1,
+		   1, 2, 0, 2, 1,
+		   1, 2, 2, 2, 1,
+		   1, 1, 1, 1, 1);
+	Mat salt5 = (cv::Mat_<float>(5, 5)
+		<< 0, 0, 0, 0, 0,
+		   0, 2, 2, 2, 0,
+		   0, 2, 1, 2, 0,
+		   0, 2, 2, 2, 0,
+		   0, 0, 0, 0, 0);
+	Mat pepper3 = (cv::Mat_<float>(3, 3)
+		<< 1, 1, 1, 1, 0, 1, 1, 1, 1);
+	Mat salt3 = (cv::Mat_<float>(3, 3)
+		<< 0, 0, 0, 0, 1, 0, 0, 0, 0);
+	pipeline.scale(1/255.0f, 0.0f)
+		.hitAndMiss(salt5)
+		.hitAndMiss(pepper5)
+		.hitAndMiss(salt3)
+		.hitAndMiss(pepper3)
+		.scale(255.0f, 0.0f);
+}
+
+Mat
+LauraJobs::median(Mat& img, int size)
+{
+	Mat gray, ret;
+	LauraHalf::toFloat(img).convertTo(gray, CV_8U);
+	LauraFilters::median(gray, size).convertTo(ret, CV_32F);
+	return ret;
+}
+
+Mat
+LauraJobs::harrisSignal(Mat& gx, Mat& gy, int fsize1, int fsize2)
+{
+	//cornerSignal reads gy at gx's padded coordinates, out of a
+	//copy of gy padded by 2.
+	Mat gyMir = LauraConvolution::addMirroredBoundaries(gy, 2, 2, 2, 2);
+	Mat filter = Mat::ones(fsize1, fsize2, gx.type());
+	void* varargs = (void*) &gyMir;
+	return LauraConvolution::convolutionEngine(
+		gx, filter, varargs, cornerSignal);
+}
+
+float
+LauraJobs::cornerSignal(Mat& inhood, Mat& filter, Range xidx,
+	Range yidx, void* varargs)
+{
+	Mat gxinhood = inhood;
+	//Unpackage gy and get its neighborhood
+	Mat* gy = (Mat*) varargs;
+	Mat gyinhood = (*gy)(yidx, xidx);
+
+	//Calculate A.
+	//Sum of I_x^2:
+	//dot() will unroll into a vector
+	float A11 = gxinhood.dot(gxinhood);
+	//Sum of I_xI_y:
+	float A12 = gxinhood.dot(gyinhood);
+	//Sum of I_y^2:
+	float A22 = gyinhood.dot(gyinhood);
+
+	float traceA = A11 + A22;
+	float detA = (A11*A22) - (A12*A12);
+
+	return (2*detA)/(traceA + HARRIS_EPS);
+}
+
+//Get rid of more than one dot on each corner.
+Mat
+LauraJobs::removeMultiDots(Mat& img, int fsize)
+{
+	Mat filter = Mat::ones(fsize, fsize, img.type());
+	return LauraConvolution::convolutionEngine(
+		img, filter, NULL, dotYield);
+}
+
+float
+LauraJobs::dotYield(Mat& inhood, Mat& filter, Range xidx, Range yidx,
+	void* varargs)
+{
+	cv::Mat_<float> inhood_ = inhood;
+	float inhoodSum = inhood.dot(filter);
+	int i = filter.rows/2;
+	int j = filter.cols/2;
+	float p0 = inhood_(i, j);
+
+	//If there is another non-zero in the neighborhood
+	//turn this pixel off.
+	if (p0 && (inhoodSum > p0))
+	{
+		inhood_(i, j) = 0.0f; //Must do this to ensure in-place
+		return 0.0f;
+	}
+	else
+		return p0;
+}
@@ -0,0 +1,157 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef __LAURAJOBS_H__
+#define __LAURAJOBS_H__
+
+#include <opencv2/opencv.hpp>
+#include <map>
+#include <string>
+#include "LauraBudget.h"
+#include "LauraCache.h"
+#include "LauraPipeline.h"
+#include "LauraTuner.h"
+using cv::Mat;
+using cv::Range;
+
+//The apps' pipelines as functions, for running many requests in
+//one process (see LauraServer). Each takes a CV_32F grayscale
+//image and named parameters and returns the image its app saves
+//to output.lraw, in a new Mat.
+class LauraJobs
+{
+	//Functions for LauraConvolution::convolutionEngine.
+	static float cornerSignal(Mat& inhood, Mat& filter, Range xidx,
+		Range yidx, void* varargs);
+	static float dotYield(Mat& inhood, Mat& filter, Range xidx,
+		Range yidx, void* varargs);
+public:
+	typedef std::map<std::string, float> Params;
+
+	//What one worker keeps from job to job: the filters it has
+	//made, its tuner and the buffers for intermediate images.
+	//Not thread safe; use one per worker.
+	class Workspace
+	{
+		std::map<std::string, Mat> kernels;
+		std::map<std::string, Mat> buffers;
+		LauraTuner convTuner;
+		LauraBudget costs;
+		int nthreads;
+	public:
+		Workspace();
+		~Workspace();
+		//LauraFilters::gaussian, made once per size and sigma.
+		Mat& gaussian(int fsize1, int fsize2, float sigma);
+		//The buffer called name, made rows x cols of type.
+		//It keeps its memory if it already has that size and
+		//type, and is overwritten by the next job.
+		Mat& buffer(const std::string& name, int rows, int cols,
+			int type);
+		//Uses the choices saved by tuning runs (see LauraTuner)
+		//but does not time any itself.
+		LauraTuner& tuner();
+		//The buffers of pipeline name, by buffer name.
+		std::map<std::string, Mat> buffersOf(const std::string& name);
+		//The stage costs of the budgeted jobs, and the
+		//configuration the last one ran.
+		LauraBudget& budget();
+		//Threads the task graphs of a job, the tuner's
+		//included, run on (0, the default: one per core).
+		//A server running a job on each of its workers sets 1.
+		void setThreads(int nthreads);
+		int threads() const;
+	};
+
+	//params[key], or def if it is not there.
+	static float param(const Params& params, const std::string& key,
+		float def);
+
+	//Runs the pipeline called name: "canny", "harris", "lapLine"
+	//or "logEdge". Returns an empty Mat if there is none.
+	//canny, harris and logEdge take budget = ms: they then run
+	//in the configuration expected to take ms or less (see
+	//LauraBudget), and ws.budget().report() says which it was.
+	static Mat run(const std::string& name, Mat& img,
+		const Params& params, Workspace& ws);
+	//run, through cache: a result cached for the same pixels and
+	//parameters is returned without running anything. Otherwise
+	//the result is cached, with the pipeline's buffers if cache
+	//keeps intermediates. Budgeted runs are not cached.
+	static Mat run(const std::string& name, Mat& img,
+		const Params& params, Workspace& ws, LauraCache& cache);
+	//Pipeline name with params, as a string naming every setting
+	//its result depends on, defaults included.
+	static std::string describe(const std::string& name,
+		const Params& params);
+	//Runs the cheapest configuration of pipeline name on img
+	//once, so that the first budgeted run has costs to go on.
+	static void calibrate(const std::string& name, Mat& img,
+		Workspace& ws);
+	//Canny edges. half = 1 keeps the intermediate images in half
+	//precision; kl and ku (1.5, 0.7) set the hysteresis
+	//thresholds mean - kl*std. dev. and mean + ku*std. dev.;
+	//thin = 1 thins the edges to one pixel wide.
+	static Mat canny(Mat& img, const Params& params, Workspace& ws);
+	//Harris corners, as dots. thresh (50) is applied to the
+	//normalized corner signal.
+	static Mat harris(Mat& img, const Params& params, Workspace& ws);
+	//Lines from the Laplacian, CV_8U. median = n median filters
+	//the image over n x n first (n odd; 0 for none); thin = 1
+	//thins the lines to one pixel wide.
+	static Mat lapLine(Mat& img, const Params& params, Workspace& ws);
+	//LoG zero crossings. dog = 1 uses a Difference of Gaussians
+	//(with no budget).
+	static Mat logEdge(Mat& img, const Params& params, Workspace& ws);
+
+	/**** Steps shared with the apps ****/
+	//Adds salt and pepper noise removal to pipeline.
+	static void removeSP(LauraPipeline& pipeline);
+	//The median of each size x size neighborhood of img (CV_32F
+	//or half, gray levels 0 to 255), as CV_32F. The image is
+	//rounded to CV_8U for the filter, whose cost per pixel then
+	//does not grow with size (see LauraFilters::median).
+	static Mat median(Mat& img, int size);
+	//Harris corner signal 2 det(A)/trace(A) from the gradient
+	//images, with A summed over fsize1 x fsize2 neighborhoods.
+	static Mat harrisSignal(Mat& gx, Mat& gy, int fsize1, int fsize2);
+	//Leaves one dot in each group of dots closer than fsize.
+	static Mat removeMultiDots(Mat& img, int fsize);
+private:
+	//The pipelines as configuration c has them, timing their
+	//stages into budget if it is not NULL.
+	static Mat canny(Mat& img, const Params& params, Workspace& ws,
+		const LauraBudget::Config& c, LauraBudget* budget);
+	static Mat harris(Mat& img, const Params& params, Workspace& ws,
+		const LauraBudget::Config& c, LauraBudget* budget);
+	static Mat logEdge(Mat& img, const Params& params, Workspace& ws,
+		const LauraBudget::Config& c, LauraBudget* budget);
+	//Runs pipeline name as c has it, on img made 1/c.scale the
+	//size, and brings the result back to img's size.
+	static Mat runConfig(const std::string& name, Mat& img,
+		const Params& params, Workspace& ws, const LauraBudget::Config& c,
+		LauraBudget* budget);
+	//Runs pipeline name in the configuration that fits the
+	//budget in params.
+	static Mat budgeted(const std::string& name, Mat& img,
+		const Params& params, Workspace& ws);
+};
+
+#endif //!defined __LAURAJOBS_H__
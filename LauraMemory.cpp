@@ -0,0 +1,276 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "LauraMemory.h"
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+
+//Bytes in front of each buffer for its header. A multiple of
+//the alignment cv::fastMalloc gives, so the data keeps it.
+#define HEADER_BYTES 64
+
+namespace
+{
+struct Header
+{
+	size_t bytes;
+	size_t stage; //Index into Books::usages.
+};
+
+//What has been charged to whom.
+struct Books
+{
+	std::mutex lock;
+	std::vector<std::string> names;
+	std::vector<LauraMemory::Usage> usages;
+	std::map<std::string, size_t> index;
+	LauraMemory::Usage total;
+	std::string current; //Stage being charged.
+};
+
+//Both are made on first use and never destroyed, so images that
+//outlive main (statics) can still be freed through them.
+Books&
+books()
+{
+	static Books* b = NULL;
+	static std::once_flag once;
+	std::call_once(once, []() {
+		b = new Books();
+		b->total.current = 0;
+		b->total.peak = 0;
+		b->total.allocations = 0;
+		b->current = "other";
+	});
+	return *b;
+}
+
+LauraMemory&
+tracker()
+{
+	static LauraMemory* t = new LauraMemory();
+	return *t;
+}
+
+//Index of stage name in b.usages, adding it if it is new.
+//Call with b.lock held.
+size_t
+stageIndex(Books& b, const std::string& name)
+{
+	std::map<std::string, size_t>::iterator it = b.index.find(name);
+	if (b.index.end() != it)
+		return it->second;
+	LauraMemory::Usage u;
+	u.current = 0;
+	u.peak = 0;
+	u.allocations = 0;
+	b.names.push_back(name);
+	b.usages.push_back(u);
+	b.index[name] = b.usages.size() - 1;
+	return b.usages.size() - 1;
+}
+
+void
+charge(LauraMemory::Usage& u, size_t bytes)
+{
+	u.current += bytes;
+	u.allocations++;
+	if (u.current > u.peak)
+		u.peak = u.current;
+}
+
+void
+printReport()
+{
+	LauraMemory::report(std::cerr);
+}
+}
+
+LauraMemory::Stage::Stage(const std::string& name)
+{
+	Books& b = books();
+	std::lock_guard<std::mutex> guard(b.lock);
+	previous = b.current;
+	b.current = name;
+}
+
+LauraMemory::Stage::~Stage()
+{
+	Books& b = books();
+	std::lock_guard<std::mutex> guard(b.lock);
+	b.current = previous;
+}
+
+LauraMemory::LauraMemory()
+{
+
+}
+
+LauraMemory::~LauraMemory()
+{
+
+}
+
+void
+LauraMemory::allocate(int dims, const int* sizes, int type,
+	int*& refcount, uchar*& datastart, uchar*& data, size_t* step)
+{
+	//Continuous, like Mat's own buffers.
+	size_t bytes = CV_ELEM_SIZE(type);
+	for (int i = dims - 1; i >= 0; --i)
+	{
+		if (step)
+			step[i] = bytes;
+		bytes *= sizes[i];
+	}
+	//The reference count goes after the data, as Mat puts it.
+	size_t padded = (bytes + sizeof(int) - 1) & ~(sizeof(int) - 1);
+
+	uchar* block = (uchar*) cv::fastMalloc(HEADER_BYTES + padded +
+		sizeof(int));
+	Header* h = (Header*) block;
+	h->bytes = bytes;
+	{
+		Books& b = books();
+		std::lock_guard<std::mutex> guard(b.lock);
+		h->stage = stageIndex(b, b.current);
+		charge(b.usages[h->stage], bytes);
+		charge(b.total, bytes);
+	}
+
+	datastart = data = block + HEADER_BYTES;
+	refcount = (int*) (data + padded);
+	*refcount = 1;
+}
+
+void
+LauraMemory::deallocate(int* refcount, uchar* datastart, uchar* data)
+{
+	if (!datastart)
+		return;
+	uchar* block = datastart - HEADER_BYTES;
+	Header* h = (Header*) block;
+	{
+		Books& b = books();
+		std::lock_guard<std::mutex> guard(b.lock);
+		b.usages[h->stage].current -= h->bytes;
+		b.total.current -= h->bytes;
+	}
+	cv::fastFree(block);
+}
+
+Mat
+LauraMemory::create(int rows, int cols, int type)
+{
+	Mat ret;
+	ret.allocator = &tracker();
+	ret.create(rows, cols, type);
+	return ret;
+}
+
+Mat
+LauraMemory::zeros(int rows, int cols, int type)
+{
+	Mat ret = create(rows, cols, type);
+	ret = cv::Scalar(0);
+	return ret;
+}
+
+void
+LauraMemory::create(Mat& img, int rows, int cols, int type)
+{
+	if (img.data && (rows == img.rows) && (cols == img.cols) &&
+		(type == img.type()))
+		return;
+	img.release();
+	img.allocator = &tracker();
+	img.create(rows, cols, type);
+}
+
+Mat
+LauraMemory::clone(const Mat& img)
+{
+	Mat ret = create(img.rows, img.cols, img.type());
+	img.copyTo(ret);
+	return ret;
+}
+
+LauraMemory::Usage
+LauraMemory::usage(const std::string& name)
+{
+	Books& b = books();
+	std::lock_guard<std::mutex> guard(b.lock);
+	std::map<std::string, size_t>::iterator it = b.index.find(name);
+	if (b.index.end() != it)
+		return b.usages[it->second];
+	Usage u;
+	u.current = 0;
+	u.peak = 0;
+	u.allocations = 0;
+	return u;
+}
+
+LauraMemory::Usage
+LauraMemory::total()
+{
+	Books& b = books();
+	std::lock_guard<std::mutex> guard(b.lock);
+	return b.total;
+}
+
+std::vector<std::string>
+LauraMemory::stages()
+{
+	Books& b = books();
+	std::lock_guard<std::mutex> guard(b.lock);
+	return b.names;
+}
+
+void
+LauraMemory::report(std::ostream& out)
+{
+	Books& b = books();
+	std::lock_guard<std::mutex> guard(b.lock);
+	char line[256];
+	snprintf(line, sizeof(line), "%-24s %14s %14s %12s", "stage",
+		"current bytes", "peak bytes", "allocations");
+	out << line << std::endl;
+	for (size_t k = 0; k <= b.names.size(); ++k)
+	{
+		bool all = (b.names.size() == k);
+		const Usage& u = all ? b.total : b.usages[k];
+		snprintf(line, sizeof(line), "%-24s %14lu %14lu %12ld",
+			all ? "total" : b.names[k].c_str(),
+			(unsigned long) u.current, (unsigned long) u.peak,
+			u.allocations);
+		out << line << std::endl;
+	}
+}
+
+void
+LauraMemory::reportAtExit()
+{
+	static std::once_flag once;
+	if (getenv("LAURA_MEMORY_REPORT"))
+		std::call_once(once, []() { atexit(printReport); });
+}
@@ -0,0 +1,101 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef __LAURAMEMORY_H__
+#define __LAURAMEMORY_H__
+
+#include <opencv2/opencv.hpp>
+#include <ostream>
+#include <string>
+#include <vector>
+using cv::Mat;
+
+//Accounts for the image memory the Laura modules allocate.
+//Mats made through create() and zeros() get their buffers from
+//this allocator, which charges each one to the stage open when it
+//was allocated, until the last Mat using it lets go. For each
+//stage it keeps the bytes still held, the most ever held at once
+//and the number of allocations.
+//Stages are process wide, not per thread, so the bands a task
+//graph runs for a stage are charged to it too.
+//
+//	{
+//		LauraMemory::Stage stage("gradient");
+//		Mat gx = LauraMemory::create(rows, cols, CV_32F);
+//		...
+//	}
+//	LauraMemory::Usage u = LauraMemory::usage("gradient");
+class LauraMemory : public cv::MatAllocator
+{
+public:
+	struct Usage
+	{
+		size_t current;   //Bytes allocated and not yet freed.
+		size_t peak;      //Most current has ever been.
+		long allocations; //Number of buffers allocated.
+	};
+	//Charges allocations to name while it exists. Stages nest:
+	//the innermost open one is charged, and the one it hid is
+	//charged again once it closes.
+	class Stage
+	{
+		std::string previous;
+	public:
+		Stage(const std::string& name);
+		~Stage();
+	};
+
+	LauraMemory();
+	~LauraMemory();
+
+	//The allocator interface. Buffers carry a small header
+	//recording their size and stage.
+	void allocate(int dims, const int* sizes, int type,
+		int*& refcount, uchar*& datastart, uchar*& data, size_t* step);
+	void deallocate(int* refcount, uchar* datastart, uchar* data);
+
+	/**** Tracked images ****/
+	//A new rows x cols image of type, counted.
+	static Mat create(int rows, int cols, int type);
+	//Same, filled with zeros.
+	static Mat zeros(int rows, int cols, int type);
+	//Makes img rows x cols of type, counted, unless it already
+	//is that size and type (like Mat::create, which keeps it).
+	static void create(Mat& img, int rows, int cols, int type);
+	//A counted copy of img.
+	static Mat clone(const Mat& img);
+
+	/**** Queries ****/
+	//Usage of stage name (zero if nothing was charged to it).
+	//Allocations outside every stage go to "other".
+	static Usage usage(const std::string& name);
+	//Usage of all stages together. Its peak is the most held at
+	//once, which is not the sum of the stages' peaks.
+	static Usage total();
+	//Names of the stages charged so far, in order of first use.
+	static std::vector<std::string> stages();
+	//One line per stage and the total.
+	static void report(std::ostream& out);
+	//Prints report() to stderr when the program exits, if
+	//$LAURA_MEMORY_REPORT is set.
+	static void reportAtExit();
+};
+
+#endif //!defined __LAURAMEMORY_H__
@@ -0,0 +1,424 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "LauraPipeline.h"
+#include "LauraConvolution.h"
+#include "LauraCounters.h"
+#include "LauraHalf.h"
+#include "LauraTaskGraph.h"
+#include <cfloat>
+#include <cmath>
+#include <string.h>
+
+struct LauraPipeline::Band
+{
+	Pass* pass;
+	int rowStart;
+	int rowEnd;
+	int next; //Next input row of this band the prologue counts.
+	Stats stats;
+	std::vector<LauraHistogram> prologueHists;
+	std::vector<LauraHistogram> epilogueHists;
+};
+
+LauraPipeline::LauraPipeline(Mat& img)
+	: img(img)
+{
+
+}
+
+LauraPipeline::~LauraPipeline()
+{
+
+}
+
+LauraPipeline&
+LauraPipeline::record(Kind kind, float a, float b)
+{
+	Op op;
+	op.kind = kind;
+	op.a = a;
+	op.b = b;
+	op.hist = NULL;
+	op.tap = NULL;
+	ops.push_back(op);
+	return *this;
+}
+
+LauraPipeline&
+LauraPipeline::convolve(Mat& filter)
+{
+	record(CONVOLVE, 0, 0);
+	ops.back().filter = filter;
+	return *this;
+}
+
+LauraPipeline&
+LauraPipeline::hitAndMiss(Mat& filter)
+{
+	record(HITANDMISS, 0, 0);
+	ops.back().filter = filter;
+	return *this;
+}
+
+LauraPipeline&
+LauraPipeline::abs()
+{
+	return record(ABS, 0, 0);
+}
+
+LauraPipeline&
+LauraPipeline::scale(float a, float b)
+{
+	return record(SCALE, a, b);
+}
+
+LauraPipeline&
+LauraPipeline::threshold(float thresh)
+{
+	return record(THRESHOLD, thresh, 0);
+}
+
+LauraPipeline&
+LauraPipeline::clamp(float lo, float hi)
+{
+	return record(CLAMP, lo, hi);
+}
+
+LauraPipeline&
+LauraPipeline::subtractMean()
+{
+	return record(SUBTRACTMEAN, 0, 0);
+}
+
+LauraPipeline&
+LauraPipeline::normalize()
+{
+	return record(NORMALIZE, 0, 0);
+}
+
+LauraPipeline&
+LauraPipeline::histogram(LauraHistogram& hist, float mlo, float mhi)
+{
+	record(HISTOGRAM, mlo, mhi);
+	ops.back().hist = &hist;
+	return *this;
+}
+
+LauraPipeline&
+LauraPipeline::tap(Mat& out)
+{
+	record(TAP, 0, 0);
+	ops.back().tap = &out;
+	return *this;
+}
+
+void
+LauraPipeline::compile(int type)
+{
+	passes.clear();
+
+	Pass blank;
+	blank.owner = this;
+	blank.kernel = copyRow;
+	blank.filter = Mat::ones(1, 1, CV_32F);
+	blank.collectStats = false;
+	blank.stats.min = DBL_MAX;
+	blank.stats.max = -DBL_MAX;
+	blank.stats.sum = 0;
+	blank.stats.n = 0;
+	blank.source = NULL;
+	blank.writes = true;
+
+	std::vector<Op> pending; //Ops waiting for the next stencil.
+	Pass* open = NULL; //Pass whose epilogue takes new ops.
+	for (size_t k = 0; k < ops.size(); ++k)
+	{
+		Op& op = ops[k];
+		if (TAP == op.kind)
+			op.tap->create(img.rows, img.cols, CV_32F);
+
+		if ((CONVOLVE == op.kind) || (HITANDMISS == op.kind))
+		{
+			passes.push_back(blank);
+			open = &passes.back();
+			if (CONVOLVE == op.kind)
+				open->kernel = LauraConvolution::convolveRow;
+			else
+				open->kernel = LauraConvolution::hitAndMissRow;
+			open->filter = op.filter;
+			open->prologue.swap(pending);
+		}
+		else if ((SUBTRACTMEAN == op.kind) || (NORMALIZE == op.kind))
+		{
+			//The producing pass collects the statistics; this op
+			//starts the prologue of the next one.
+			if (!open)
+			{
+				//Nothing produces the values here, so add a pass
+				//just to look at them. It only has to write them
+				//out if it changes them.
+				passes.push_back(blank);
+				open = &passes.back();
+				open->prologue.swap(pending);
+				open->writes = !open->prologue.empty();
+			}
+			open->collectStats = true;
+			open = NULL;
+			pending.push_back(op);
+		}
+		else if (open)
+			open->epilogue.push_back(op);
+		else
+			pending.push_back(op);
+	}
+	if (passes.empty() || !pending.empty())
+	{
+		passes.push_back(blank);
+		passes.back().prologue.swap(pending);
+	}
+
+	//Wire up the images between the passes.
+	for (size_t k = 0; k < passes.size(); ++k)
+	{
+		Pass& pass = passes[k];
+		pass.in = (0 == k) ? img : passes[k - 1].out;
+		if (0 < k)
+			pass.source = &passes[k - 1].stats;
+		if (!pass.writes)
+			pass.out = pass.in;
+		else if (passes.size() - 1 == k)
+			pass.out.create(img.rows, img.cols, type);
+		else
+			pass.out.create(img.rows, img.cols, CV_32F);
+	}
+}
+
+Mat
+LauraPipeline::run()
+{
+	return run(CV_32F);
+}
+
+Mat
+LauraPipeline::run(int type)
+{
+	compile(type);
+	LauraCounters::Stage counters("LauraPipeline", (double) img.total());
+
+	LauraTaskGraph graph(0);
+	int input = -1;
+	for (size_t k = 0; k < passes.size(); ++k)
+	{
+		Pass& pass = passes[k];
+		int halo = (pass.filter.rows > pass.filter.cols) ?
+			pass.filter.rows : pass.filter.cols;
+		halo /= 2;
+		//Whole image statistics mean waiting for the whole image.
+		for (size_t p = 0; p < pass.prologue.size(); ++p)
+		{
+			if ((SUBTRACTMEAN == pass.prologue[p].kind) ||
+				(NORMALIZE == pass.prologue[p].kind))
+				halo = img.rows;
+		}
+		std::vector<int> inputs(1, input);
+		input = graph.addStage(img.rows, passTask, (void*) &pass,
+			inputs, halo);
+	}
+	graph.run(0);
+
+	return passes.back().out;
+}
+
+void
+LauraPipeline::passTask(int rowStart, int rowEnd, void* varargs)
+{
+	Pass* pass = (Pass*) varargs;
+
+	Band band;
+	band.pass = pass;
+	band.rowStart = rowStart;
+	band.rowEnd = rowEnd;
+	band.next = rowStart;
+	band.stats.min = DBL_MAX;
+	band.stats.max = -DBL_MAX;
+	band.stats.sum = 0;
+	band.stats.n = 0;
+	localHistograms(pass->prologue, band.prologueHists);
+	localHistograms(pass->epilogue, band.epilogueHists);
+
+	LauraConvolution::stencilStream(pass->in, pass->filter,
+		rowStart, rowEnd, pass->kernel,
+		pass->prologue.empty() ? NULL : loadFunc,
+		storeFunc, (void*) &band);
+
+	//Merge what this band found.
+	std::lock_guard<std::mutex> guard(pass->owner->lock);
+	if (pass->collectStats)
+	{
+		Stats& s = pass->stats;
+		if (band.stats.min < s.min) s.min = band.stats.min;
+		if (band.stats.max > s.max) s.max = band.stats.max;
+		s.sum += band.stats.sum;
+		s.n += band.stats.n;
+	}
+	const std::vector<Op>* opLists[] = {&pass->prologue, &pass->epilogue};
+	std::vector<LauraHistogram>* hists[] =
+		{&band.prologueHists, &band.epilogueHists};
+	for (int l = 0; l < 2; ++l)
+	{
+		int h = 0;
+		for (size_t k = 0; k < opLists[l]->size(); ++k)
+		{
+			if (HISTOGRAM == (*opLists[l])[k].kind)
+				(*opLists[l])[k].hist->merge((*hists[l])[h++]);
+		}
+	}
+}
+
+void
+LauraPipeline::applyOps(const std::vector<Op>& ops, float* row, int i,
+	int cols, bool count, const Stats* source, LauraHistogram* hists)
+{
+	int h = 0;
+	for (size_t k = 0; k < ops.size(); ++k)
+	{
+		const Op& op = ops[k];
+		switch (op.kind)
+		{
+		case ABS:
+			for (int j = 0; j < cols; ++j)
+				row[j] = fabsf(row[j]);
+			break;
+		case SCALE:
+			for (int j = 0; j < cols; ++j)
+				row[j] = op.a*row[j] + op.b;
+			break;
+		case THRESHOLD:
+			for (int j = 0; j < cols; ++j)
+				row[j] = (op.a < row[j]) ? 255.0f : 0.0f;
+			break;
+		case CLAMP:
+			for (int j = 0; j < cols; ++j)
+			{
+				if (op.a > row[j]) row[j] = op.a;
+				if (op.b < row[j]) row[j] = op.b;
+			}
+			break;
+		case SUBTRACTMEAN:
+		{
+			float mean = (0 < source->n) ?
+				(float) (source->sum/source->n) : 0.0f;
+			for (int j = 0; j < cols; ++j)
+				row[j] -= mean;
+			break;
+		}
+		case NORMALIZE:
+		{
+			float min = (float) source->min;
+			float range = (float) (source->max - source->min);
+			float s = (0 < range) ? 255.0f/range : 0.0f;
+			for (int j = 0; j < cols; ++j)
+				row[j] = (row[j] - min)*s;
+			break;
+		}
+		case HISTOGRAM:
+			if (count)
+				hists[h].accumulate(row, cols, op.a, op.b);
+			++h;
+			break;
+		case TAP:
+			if (count)
+				memcpy(op.tap->ptr<float>(i), row, cols*sizeof(float));
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void
+LauraPipeline::loadFunc(float* row, int i, int cols, void* varargs)
+{
+	Band* band = (Band*) varargs;
+	Pass* pass = band->pass;
+
+	//Rows load in order, with mirrored copies and the halo
+	//around them. Count each row of the band once.
+	bool count = (band->next == i) && (band->rowEnd > i);
+	if (count)
+		band->next++;
+	applyOps(pass->prologue, row, i, cols, count, pass->source,
+		band->prologueHists.empty() ? NULL : &band->prologueHists[0]);
+}
+
+void
+LauraPipeline::storeFunc(float* row, int i, int cols, void* varargs)
+{
+	Band* band = (Band*) varargs;
+	Pass* pass = band->pass;
+
+	applyOps(pass->epilogue, row, i, cols, true, pass->source,
+		band->epilogueHists.empty() ? NULL : &band->epilogueHists[0]);
+
+	if (pass->collectStats)
+	{
+		Stats& s = band->stats;
+		for (int j = 0; j < cols; ++j)
+		{
+			if (row[j] < s.min) s.min = row[j];
+			if (row[j] > s.max) s.max = row[j];
+			s.sum += row[j];
+		}
+		s.n += cols;
+	}
+
+	if (!pass->writes)
+		return;
+	if (CV_8U == pass->out.type())
+	{
+		uchar* dst = pass->out.ptr<uchar>(i);
+		for (int j = 0; j < cols; ++j)
+			dst[j] = cv::saturate_cast<uchar>(row[j]);
+	}
+	else
+		LauraHalf::storeRow(row, pass->out, i);
+}
+
+void
+LauraPipeline::copyRow(const float** rows, Mat& filter, int width,
+	int channels, float* out)
+{
+	memcpy(out, rows[0], width*channels*sizeof(float));
+}
+
+void
+LauraPipeline::localHistograms(const std::vector<Op>& ops,
+	std::vector<LauraHistogram>& hists)
+{
+	for (size_t k = 0; k < ops.size(); ++k)
+	{
+		if (ops[k].hist)
+		{
+			hists.push_back(*ops[k].hist);
+			hists.back().clear();
+		}
+	}
+}
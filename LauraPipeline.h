@@ -0,0 +1,149 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef __LAURAPIPELINE_H__
+#define __LAURAPIPELINE_H__
+
+#include <opencv2/opencv.hpp>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "LauraHistogram.h"
+using cv::Mat;
+
+//Deferred image pipeline.
+//Stages are only recorded until run(). Then the cheap pointwise
+//ops (abs, scaling, thresholds, ...) are fused into the stencil
+//stage next to them: ops after a stencil run on each row it
+//produces, ops before the first stencil run on each row as it is
+//loaded. Each stencil with its ops is one pass over the image,
+//run band by band on a LauraTaskGraph, instead of one full image
+//read and write per op.
+//Ops that need statistics of the whole image (subtractMean,
+//normalize) make the pass before them collect those statistics
+//and wait for it to finish.
+//
+//	LauraPipeline p(img);
+//	Mat out = p.convolve(laplacian).abs().threshold(20.0f).run();
+class LauraPipeline
+{
+	enum Kind
+	{
+		CONVOLVE, HITANDMISS, //Stencils.
+		ABS, SCALE, THRESHOLD, CLAMP, HISTOGRAM, TAP, //Pointwise.
+		SUBTRACTMEAN, NORMALIZE //Pointwise, need statistics.
+	};
+	struct Op
+	{
+		Kind kind;
+		float a;
+		float b;
+		Mat filter;
+		LauraHistogram* hist;
+		Mat* tap;
+	};
+	//Min, max, sum and count of the values a pass produced.
+	struct Stats
+	{
+		double min;
+		double max;
+		double sum;
+		double n;
+	};
+	//One stencil (or a copy, if there is none) with its fused ops.
+	struct Pass
+	{
+		LauraPipeline* owner;
+		void (*kernel) (const float** rows, Mat& filter, int width,
+			int channels, float* out);
+		Mat filter;
+		std::vector<Op> prologue; //On each input row as it loads.
+		std::vector<Op> epilogue; //On each output row.
+		bool collectStats;
+		Stats stats;
+		const Stats* source; //Statistics the prologue uses.
+		Mat in;
+		Mat out;
+		bool writes; //False if the pass only collects statistics.
+	};
+
+	Mat img;
+	std::vector<Op> ops;
+	std::deque<Pass> passes; //Deque, so pointers stay valid.
+	std::mutex lock; //Guards the merges of per band results.
+
+	//Per band state of a running pass. Defined in the .cpp.
+	struct Band;
+
+	LauraPipeline& record(Kind kind, float a, float b);
+	//Splits ops into passes.
+	void compile(int type);
+
+	//Task that runs one band of a pass.
+	static void passTask(int rowStart, int rowEnd, void* varargs);
+	//Applies ops to row i. Taps and histograms only see the
+	//row if count is true.
+	static void applyOps(const std::vector<Op>& ops, float* row, int i,
+		int cols, bool count, const Stats* source,
+		LauraHistogram* hists);
+	//Local, emptied copies of the histograms ops fills.
+	static void localHistograms(const std::vector<Op>& ops,
+		std::vector<LauraHistogram>& hists);
+	//Row functions for LauraConvolution::stencilStream.
+	static void loadFunc(float* row, int i, int cols, void* varargs);
+	static void storeFunc(float* row, int i, int cols, void* varargs);
+	static void copyRow(const float** rows, Mat& filter, int width,
+		int channels, float* out);
+public:
+	//Pipeline reading img (CV_32F or half, one channel).
+	LauraPipeline(Mat& img);
+	~LauraPipeline();
+
+	/**** Stencils ****/
+	//LauraConvolution::convolve.
+	LauraPipeline& convolve(Mat& filter);
+	//LauraConvolution::hitAndMiss.
+	LauraPipeline& hitAndMiss(Mat& filter);
+
+	/**** Pointwise ops ****/
+	LauraPipeline& abs();
+	//a*x + b.
+	LauraPipeline& scale(float a, float b);
+	//Same as LauraFilters::threshold: 255 above thresh, else 0.
+	LauraPipeline& threshold(float thresh);
+	//Clamps to [lo, hi].
+	LauraPipeline& clamp(float lo, float hi);
+	//Subtracts the mean of the image.
+	LauraPipeline& subtractMean();
+	//Stretches the image to span 0 to 255.
+	LauraPipeline& normalize();
+	//Adds the values in [mlo, mhi) at this point to hist.
+	LauraPipeline& histogram(LauraHistogram& hist, float mlo, float mhi);
+	//Copies the values at this point into out (made CV_32F).
+	LauraPipeline& tap(Mat& out);
+
+	//Runs the pipeline and returns the result as CV_32F.
+	Mat run();
+	//Same, with the result stored as type: CV_32F, CV_8U
+	//(rounded and saturated, like convertTo) or LauraHalf::TYPE.
+	Mat run(int type);
+};
+
+#endif //!defined __LAURAPIPELINE_H__
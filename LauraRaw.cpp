@@ -0,0 +1,178 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "LauraRaw.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//On disk header. See LauraRaw.h.
+struct LauraRawHeader
+{
+	char magic[4];
+	uint32_t version;
+	int32_t rows;
+	int32_t cols;
+	int32_t type;
+	uint32_t unused;
+	uint64_t stride;
+	uint64_t offset;
+	char pad[24];
+};
+
+#define LAURARAW_HEADER 64
+#define LAURARAW_ALIGN 64
+static_assert(LAURARAW_HEADER == sizeof(LauraRawHeader),
+	"raw image header must be 64 bytes");
+
+//Whether h describes an image that lies wholly within a file of
+//size bytes. Nothing in h is trusted: a crafted file must not give
+//a Mat that reaches past the mapping.
+static bool
+validHeader(const LauraRawHeader* h, uint64_t size)
+{
+	if (memcmp(h->magic, "LRAW", 4) || (1 != h->version) ||
+		(0 >= h->rows) || (0 >= h->cols))
+		return false;
+	//Plain OpenCV types only: a known depth, 1 to 4 channels and
+	//no other bits set.
+	int depth = CV_MAT_DEPTH(h->type);
+	int cn = CV_MAT_CN(h->type);
+	if ((0 > h->type) || (CV_64F < depth) || (4 < cn) ||
+		(CV_MAKETYPE(depth, cn) != h->type))
+		return false;
+	if ((LAURARAW_HEADER > h->offset) || (size < h->offset))
+		return false;
+
+	//offset + (rows - 1)*stride + rowBytes <= size, by division so
+	//that nothing wraps. cols and the element size are both small
+	//enough that their product fits in 64 bits.
+	uint64_t rowBytes = (uint64_t) h->cols*CV_ELEM_SIZE(h->type);
+	uint64_t avail = size - h->offset;
+	//cv::Mat throws on a stride that does not hold whole rows of
+	//whole elements.
+	if ((h->stride < rowBytes) ||
+		(0 != h->stride % CV_ELEM_SIZE1(h->type)) || (avail < rowBytes))
+		return false;
+	return (uint64_t) (h->rows - 1) <= (avail - rowBytes)/h->stride;
+}
+
+LauraRaw::LauraRaw()
+{
+
+}
+
+LauraRaw::~LauraRaw()
+{
+	for (size_t k = 0; k < mappings.size(); ++k)
+		munmap(mappings[k].addr, mappings[k].length);
+}
+
+bool
+LauraRaw::isRaw(const std::string& path)
+{
+	return (5 < path.size()) &&
+		(0 == path.compare(path.size() - 5, 5, ".lraw"));
+}
+
+void*
+LauraRaw::map(int fd, size_t length, bool shared)
+{
+	void* addr = mmap(NULL, length, PROT_READ | PROT_WRITE,
+		shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+	if (MAP_FAILED == addr)
+		return NULL;
+
+	Mapping m;
+	m.addr = addr;
+	m.length = length;
+	mappings.push_back(m);
+	return addr;
+}
+
+Mat
+LauraRaw::load(const std::string& path)
+{
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (0 > fd)
+		return Mat();
+
+	struct stat st;
+	void* addr = NULL;
+	if ((0 == fstat(fd, &st)) && (LAURARAW_HEADER <= st.st_size))
+		addr = map(fd, st.st_size, false);
+	close(fd); //The mapping stays.
+	if (!addr)
+		return Mat();
+
+	//Check the header before trusting it.
+	LauraRawHeader* h = (LauraRawHeader*) addr;
+	if (!validHeader(h, (uint64_t) st.st_size))
+		return Mat();
+
+	return Mat(h->rows, h->cols, h->type,
+		(char*) addr + h->offset, h->stride);
+}
+
+Mat
+LauraRaw::create(const std::string& path, int rows, int cols, int type)
+{
+	size_t rowBytes = (size_t) cols*CV_ELEM_SIZE(type);
+	size_t stride = (rowBytes + LAURARAW_ALIGN - 1)/
+		LAURARAW_ALIGN*LAURARAW_ALIGN;
+	size_t length = LAURARAW_HEADER + (size_t) rows*stride;
+
+	int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (0 > fd)
+		return Mat();
+	void* addr = NULL;
+	if (0 == ftruncate(fd, length))
+		addr = map(fd, length, true);
+	close(fd);
+	if (!addr)
+		return Mat();
+
+	LauraRawHeader* h = (LauraRawHeader*) addr;
+	memset(h, 0, sizeof(*h));
+	memcpy(h->magic, "LRAW", 4);
+	h->version = 1;
+	h->rows = rows;
+	h->cols = cols;
+	h->type = type;
+	h->stride = stride;
+	h->offset = LAURARAW_HEADER;
+
+	return Mat(rows, cols, type, (char*) addr + LAURARAW_HEADER,
+		stride);
+}
+
+bool
+LauraRaw::save(const std::string& path, Mat& img)
+{
+	LauraRaw raw;
+	Mat dst = raw.create(path, img.rows, img.cols, img.type());
+	if (!dst.data)
+		return false;
+	img.copyTo(dst);
+	return true;
+}
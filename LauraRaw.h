@@ -0,0 +1,70 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef __LAURARAW_H__
+#define __LAURARAW_H__
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+using cv::Mat;
+
+//Raw image files (.lraw), read and written through mmap.
+//A file is a 64 byte header followed by the rows, each padded
+//to a multiple of 64 bytes:
+//	char magic[4] = "LRAW"; uint32 version = 1;
+//	int32 rows; int32 cols; int32 type (OpenCV type);
+//	uint32 unused; uint64 stride (bytes per row);
+//	uint64 offset (of the first row); 24 unused bytes.
+//Images come back as Mat headers on the mapping, with no decode
+//and no copy. The mappings live as long as the LauraRaw that
+//made them, so it must outlive the Mats.
+class LauraRaw
+{
+	struct Mapping
+	{
+		void* addr;
+		size_t length;
+	};
+	std::vector<Mapping> mappings;
+
+	//Maps a file of length bytes; NULL on failure.
+	void* map(int fd, size_t length, bool shared);
+public:
+	LauraRaw();
+	~LauraRaw();
+
+	//Whether path names a raw image (ends in .lraw).
+	static bool isRaw(const std::string& path);
+
+	//Maps the image in path. Writes to the Mat go to private
+	//copies of the pages touched, not to the file.
+	//Returns an empty Mat if the file is missing or not raw.
+	Mat load(const std::string& path);
+	//Creates path as a rows x cols image of type, mapped shared:
+	//whatever is written to the returned Mat is the file.
+	//Returns an empty Mat on failure.
+	Mat create(const std::string& path, int rows, int cols, int type);
+
+	//Writes img to path. Returns false on failure.
+	static bool save(const std::string& path, Mat& img);
+};
+
+#endif //!defined __LAURARAW_H__
@@ -0,0 +1,110 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "LauraScaleSpace.h"
+#include "LauraConvolution.h"
+#include "LauraFilters.h"
+#include <cmath>
+
+LauraScaleSpace::LauraScaleSpace()
+{
+
+}
+
+LauraScaleSpace::~LauraScaleSpace()
+{
+
+}
+
+float
+LauraScaleSpace::levelSigma(float sigma0, float k, int i)
+{
+	return sigma0*pow(k, (float) i);
+}
+
+Mat
+LauraScaleSpace::cascadeKernel(float sigma)
+{
+	int halfsize = (int) ceil(3*sigma);
+	if (1 > halfsize) halfsize = 1;
+	Mat ret = LauraFilters::gaussian1D(2*halfsize + 1, sigma);
+
+	//Truncation loses a little mass; put it back so each
+	//level keeps the image's brightness and flat regions
+	//give exactly zero DoG.
+	float* k = ret.ptr<float>();
+	float sum = 0.0f;
+	for (int j = 0; j < ret.cols; ++j)
+		sum += k[j];
+	for (int j = 0; j < ret.cols; ++j)
+		k[j] /= sum;
+
+	return ret;
+}
+
+void
+LauraScaleSpace::gaussianCascade(Mat& img, float sigma0, float k,
+	int levels, std::vector<Mat>& gaussians)
+{
+	gaussians.clear();
+	Mat prev = img;
+	float prevSigma = 0.0f; //img is taken to be unblurred.
+	for (int i = 0; i < levels; ++i)
+	{
+		float sigma = levelSigma(sigma0, k, i);
+		float inc = sqrt(sigma*sigma - prevSigma*prevSigma);
+		Mat kx = cascadeKernel(inc);
+		Mat ky = kx.t();
+		Mat level = LauraConvolution::convolveSeparable(prev, kx, ky);
+		gaussians.push_back(level);
+
+		prev = level;
+		prevSigma = sigma;
+	}
+}
+
+void
+LauraScaleSpace::DoG(Mat& img, float sigma0, float k,
+	int levels, std::vector<Mat>& dogs)
+{
+	//One more Gaussian than DoGs.
+	std::vector<Mat> gaussians;
+	gaussianCascade(img, sigma0, k, levels + 1, gaussians);
+
+	dogs.clear();
+	for (int l = 0; l < levels; ++l)
+	{
+		float sigma = levelSigma(sigma0, k, l);
+		float norm = 1.0f/((k - 1.0f)*sigma*sigma);
+		Mat dog(img.rows, img.cols, CV_32F);
+		for (int i = 0; i < img.rows; ++i)
+		{
+			const float* g0 = gaussians[l].ptr<float>(i);
+			const float* g1 = gaussians[l + 1].ptr<float>(i);
+			float* d = dog.ptr<float>(i);
+			for (int j = 0; j < img.cols; ++j)
+				d[j] = norm*(g1[j] - g0[j]);
+		}
+		dogs.push_back(dog);
+
+		//This Gaussian is not needed any more.
+		gaussians[l].release();
+	}
+}
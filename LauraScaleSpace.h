@@ -0,0 +1,61 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef __LAURASCALESPACE_H__
+#define __LAURASCALESPACE_H__
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+using cv::Mat;
+
+//Gaussian and Difference-of-Gaussians scale spaces.
+//Every level is made with separable blurs, and each one is
+//blurred from the level before it, so n levels cost about
+//n separable passes instead of n dense LoG convolutions.
+class LauraScaleSpace
+{
+public:
+	LauraScaleSpace();
+	~LauraScaleSpace();
+
+	//Std. dev. of level i: sigma0*k^i.
+	static float levelSigma(float sigma0, float k, int i);
+
+	//Normalized 1D Gaussian (sums to 1) of std. dev. sigma,
+	//wide enough (+/- 3 sigma) for cascading.
+	static Mat cascadeKernel(float sigma);
+
+	//Fills gaussians with levels images, level i being img
+	//blurred to std. dev. sigma0*k^i. Level i is made from
+	//level i - 1 by blurring with the incremental std. dev.
+	//sqrt(sigma_i^2 - sigma_(i-1)^2).
+	static void gaussianCascade(Mat& img, float sigma0, float k,
+		int levels, std::vector<Mat>& gaussians);
+
+	//Fills dogs with levels Difference-of-Gaussian images.
+	//dogs[i] = (G(k*sigma_i) - G(sigma_i))/((k - 1)*sigma_i^2)
+	//approximates img convolved with LauraFilters::LoG at
+	//sigma_i = sigma0*k^i. Smaller k is more accurate;
+	//k = 1.6 is the usual compromise.
+	static void DoG(Mat& img, float sigma0, float k,
+		int levels, std::vector<Mat>& dogs);
+};
+
+#endif //!defined __LAURASCALESPACE_H__
@@ -0,0 +1,387 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "LauraServer.h"
+#include "LauraIngest.h"
+#include "LauraJobs.h"
+#include "LauraMemory.h"
+#include "LauraRaw.h"
+#include "LauraShard.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <errno.h>
+#include <sstream>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+//How many of the latest job times the percentiles are taken over.
+#define LAURASERVER_LATENCIES 4096
+//Longest request line accepted.
+#define LAURASERVER_LINE 4096
+
+struct LauraServer::Job
+{
+	std::string name;
+	LauraJobs::Params params;
+	std::string in;  //Path of the image, or empty.
+	std::string out; //Path to save the result to, or empty.
+	Mat img;         //The inline image, if in is empty.
+	Mat result;
+	std::string error; //Why there is no result.
+	std::string config; //The configuration a budgeted job ran.
+	std::chrono::steady_clock::time_point start;
+	double us; //Time from start to the result.
+	bool finished;
+};
+
+//Reads a line, without its newline.
+static bool
+readLine(int fd, std::string& line)
+{
+	line.clear();
+	char c;
+	while (LauraShard::readAll(fd, &c, 1))
+	{
+		if ('\n' == c)
+			return true;
+		if (LAURASERVER_LINE <= line.size())
+			return false;
+		line += c;
+	}
+	return false;
+}
+
+static bool
+writeLine(int fd, const std::string& line)
+{
+	return LauraShard::writeAll(fd, (line + "\n").c_str(),
+		line.size() + 1);
+}
+
+LauraServer::LauraServer(const std::string& path, int nworkers)
+	: path(path), nworkers(nworkers), listenFd(-1), stopping(false),
+	running(0), done(0), nextLatency(0), cache(NULL, 0, false)
+{
+	if (0 >= this->nworkers)
+		this->nworkers = (int) std::thread::hardware_concurrency();
+	if (1 > this->nworkers)
+		this->nworkers = 1;
+}
+
+LauraServer::~LauraServer()
+{
+	stop();
+}
+
+bool
+LauraServer::run()
+{
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (sizeof(addr.sun_path) <= path.size())
+		return false;
+	strcpy(addr.sun_path, path.c_str());
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (stopping)
+			return true;
+		unlink(path.c_str());
+		listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if ((0 > listenFd) ||
+			(0 != bind(listenFd, (sockaddr*) &addr, sizeof(addr))) ||
+			(0 != listen(listenFd, SOMAXCONN)))
+		{
+			if (0 <= listenFd)
+				close(listenFd);
+			listenFd = -1;
+			return false;
+		}
+	}
+
+	for (int w = 0; w < nworkers; ++w)
+		workers.push_back(std::thread(&LauraServer::work, this));
+
+	//Each connection gets a thread that reads its requests and
+	//waits for their results; the work itself is queued.
+	for (;;)
+	{
+		int fd = accept(listenFd, NULL, NULL);
+		std::lock_guard<std::mutex> guard(lock);
+		if (stopping)
+		{
+			if (0 <= fd)
+				close(fd);
+			break;
+		}
+		if (0 > fd)
+		{
+			if ((EINTR == errno) || (ECONNABORTED == errno))
+				continue;
+			break;
+		}
+		connections.insert(fd);
+		std::thread(&LauraServer::serve, this, fd).detach();
+	}
+
+	//Let the connections and then the workers finish.
+	std::unique_lock<std::mutex> guard(lock);
+	stopping = true;
+	for (std::set<int>::iterator it = connections.begin();
+		it != connections.end(); ++it)
+		shutdown(*it, SHUT_RDWR);
+	changed.notify_all();
+	while (!connections.empty())
+		changed.wait(guard);
+	guard.unlock();
+	for (size_t w = 0; w < workers.size(); ++w)
+		workers[w].join();
+	workers.clear();
+
+	guard.lock();
+	close(listenFd);
+	listenFd = -1;
+	unlink(path.c_str());
+	return true;
+}
+
+void
+LauraServer::stop()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	stopping = true;
+	//Wakes the accept() in run().
+	if (0 <= listenFd)
+		shutdown(listenFd, SHUT_RDWR);
+	changed.notify_all();
+}
+
+void
+LauraServer::work()
+{
+	LauraJobs::Workspace ws;
+	//The workers already keep the cores busy with a job each.
+	ws.setThreads(1);
+	std::unique_lock<std::mutex> guard(lock);
+	for (;;)
+	{
+		//Jobs already queued are finished, even when stopping.
+		while (!stopping && queue.empty())
+			changed.wait(guard);
+		if (queue.empty())
+			return;
+		Job* job = queue.front();
+		queue.pop_front();
+		running++;
+		guard.unlock();
+
+		try
+		{
+			Mat img = job->img;
+			int scale = (int) LauraJobs::param(job->params, "scale", 1);
+			LauraIngest ingest(LauraIngest::isScale(scale) ? scale : 1,
+				CV_32F);
+			if (!job->in.empty())
+				img = ingest.loadGray(job->in);
+			if (!LauraIngest::isScale(scale))
+				job->error = "bad scale";
+			else if (!img.data)
+				job->error = "cannot read " + job->in;
+			else
+			{
+				//A budget is for the whole request, so the time
+				//spent queued and loading comes off it.
+				LauraJobs::Params params = job->params;
+				float budget = LauraJobs::param(params, "budget", 0);
+				if (0 < budget)
+				{
+					double waited = std::chrono::duration<double,
+						std::milli>(std::chrono::steady_clock::now() -
+						job->start).count();
+					params["budget"] = std::max(budget - (float) waited,
+						0.001f);
+				}
+				job->result = LauraJobs::run(job->name, img, params, ws,
+					cache);
+				if (0 < budget)
+					job->config = ws.budget().report();
+				if (!job->result.data)
+					job->error = "no pipeline " + job->name;
+				else if (!job->out.empty() &&
+					!LauraRaw::save(job->out, job->result))
+					job->error = "cannot write " + job->out;
+			}
+		}
+		catch (const std::exception& e)
+		{
+			job->error = e.what();
+		}
+		job->us = std::chrono::duration<double, std::micro>(
+			std::chrono::steady_clock::now() - job->start).count();
+
+		guard.lock();
+		running--;
+		done++;
+		if (LAURASERVER_LATENCIES > latencies.size())
+			latencies.push_back(job->us);
+		else
+			latencies[nextLatency] = job->us;
+		nextLatency = (nextLatency + 1) % LAURASERVER_LATENCIES;
+		job->finished = true;
+		changed.notify_all();
+	}
+}
+
+void
+LauraServer::serve(int fd)
+{
+	std::string line;
+	while (readLine(fd, line) && request(fd, line))
+		;
+
+	std::lock_guard<std::mutex> guard(lock);
+	connections.erase(fd);
+	close(fd);
+	changed.notify_all();
+}
+
+bool
+LauraServer::request(int fd, const std::string& line)
+{
+	std::istringstream words(line);
+	std::string name;
+	words >> name;
+	if (name.empty())
+		return true;
+
+	char reply[256];
+	if ("stats" == name)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		double p50, p99;
+		percentiles(&p50, &p99);
+		LauraMemory::Usage mem = LauraMemory::total();
+		snprintf(reply, sizeof(reply),
+			"stats queue %d running %d done %ld p50 %.0f p99 %.0f"
+			" bytes %lu peak %lu hits %lu misses %lu",
+			(int) queue.size(), running, done, p50, p99,
+			(unsigned long) mem.current, (unsigned long) mem.peak,
+			cache.hits(), cache.misses());
+		return writeLine(fd, reply);
+	}
+
+	Job job;
+	job.name = name;
+	job.start = std::chrono::steady_clock::now();
+	job.us = 0;
+	job.finished = false;
+	std::string word;
+	while (words >> word)
+	{
+		size_t eq = word.find('=');
+		if (std::string::npos == eq)
+			return writeLine(fd, "error bad argument " + word);
+		std::string key = word.substr(0, eq);
+		std::string value = word.substr(eq + 1);
+		if ("in" == key)
+			job.in = value;
+		else if ("out" == key)
+			job.out = value;
+		else if ("inline" == key)
+		{
+			//The image follows the line, so a bad size leaves
+			//the connection out of step: close it.
+			int rows, cols;
+			if ((2 != sscanf(value.c_str(), "%dx%d", &rows, &cols)) ||
+				(0 >= rows) || (0 >= cols) ||
+				((int64_t) rows*cols > INT_MAX/4))
+			{
+				writeLine(fd, "error bad size " + value);
+				return false;
+			}
+			job.img.create(rows, cols, CV_32F);
+			if (!LauraShard::readAll(fd, job.img.data,
+				job.img.total()*sizeof(float)))
+				return false;
+		}
+		else
+			job.params[key] = (float) atof(value.c_str());
+	}
+	if (job.in.empty() && !job.img.data)
+		return writeLine(fd, "error no image");
+
+	submit(job);
+
+	if (!job.error.empty())
+		return writeLine(fd, "error " + job.error);
+	Mat& r = job.result;
+	size_t rowBytes = r.cols*r.elemSize();
+	size_t nbytes = job.out.empty() ? r.rows*rowBytes : 0;
+	snprintf(reply, sizeof(reply), "ok %d %d %d %lu %.0f",
+		r.rows, r.cols, r.type(), (unsigned long) nbytes, job.us);
+	if (!writeLine(fd, job.config.empty() ? std::string(reply) :
+		std::string(reply) + " " + job.config))
+		return false;
+	for (int i = 0; (0 < nbytes) && (i < r.rows); ++i)
+	{
+		if (!LauraShard::writeAll(fd, r.ptr(i), rowBytes))
+			return false;
+	}
+	return true;
+}
+
+void
+LauraServer::submit(Job& job)
+{
+	std::unique_lock<std::mutex> guard(lock);
+	//The workers may already have finished the queue and left.
+	if (stopping)
+	{
+		job.error = "stopping";
+		return;
+	}
+	queue.push_back(&job);
+	changed.notify_all();
+	while (!job.finished)
+		changed.wait(guard);
+}
+
+void
+LauraServer::percentiles(double* p50, double* p99)
+{
+	*p50 = 0;
+	*p99 = 0;
+	if (latencies.empty())
+		return;
+	std::vector<double> sorted(latencies);
+	size_t n = sorted.size();
+	std::nth_element(sorted.begin(), sorted.begin() + n/2, sorted.end());
+	*p50 = sorted[n/2];
+	size_t k = std::min(n - 1, (size_t) (0.99*n));
+	std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+	*p99 = sorted[k];
+}
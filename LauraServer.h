@@ -0,0 +1,115 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef __LAURASERVER_H__
+#define __LAURASERVER_H__
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "LauraCache.h"
+
+//Runs LauraJobs pipelines for other processes, listening on a Unix
+//domain socket. A request then costs only its pipeline, not a
+//process start, loading OpenCV, and cold filters and caches.
+//Jobs wait in one queue for a pool of worker threads, each with
+//its own LauraJobs::Workspace that it keeps between jobs.
+//
+//A connection may send any number of requests, one at a time:
+//	<pipeline> [key=value ...]\n
+//	in=<path>            the image (read as LauraIngest::loadGray,
+//	                     at 1/n the size with scale=n), or
+//	inline=<rows>x<cols> the image, rows*cols CV_32F values sent
+//	                     right after the line;
+//	out=<path.lraw>      saves the result there instead of
+//	                     sending it back;
+//	budget=<ms>          runs in the configuration expected to
+//	                     finish ms after the request was read
+//	                     (see LauraJobs::run);
+//	anything else        a pipeline parameter (a number).
+//which is answered with
+//	ok <rows> <cols> <type> <nbytes> <microseconds> [<config>]\n
+//and nbytes bytes of the result's rows, or with
+//	error <message>\n
+//The time is from the request being read to the result being
+//ready; config is there for budgeted requests, as
+//LauraBudget::report has it. "stats\n" is answered with
+//	stats queue <n> running <n> done <n> p50 <us> p99 <us>
+//		bytes <n> peak <n> hits <n> misses <n>\n
+//for the jobs waiting, the jobs running, the jobs finished, the
+//median and 99th percentile of their times, over the last
+//LAURASERVER_LATENCIES jobs, and the image memory held now and at
+//most (see LauraMemory), and the result cache's hits and misses.
+//Results are cached (see LauraCache) when $LAURA_CACHE names a
+//directory.
+class LauraServer
+{
+	//A request on its way through the queue. Defined in the .cpp.
+	struct Job;
+
+	std::string path;
+	int nworkers;
+	int listenFd;
+	std::vector<std::thread> workers;
+
+	std::mutex lock; //Guards everything below.
+	std::condition_variable changed;
+	std::deque<Job*> queue;
+	std::set<int> connections; //Open client sockets.
+	bool stopping;
+	int running;
+	long done;
+	std::vector<double> latencies; //Ring of recent job times (us).
+	size_t nextLatency;
+	LauraCache cache; //Shared by the workers; locks itself.
+
+	//What each worker thread runs.
+	void work();
+	//Answers requests on the client socket fd until it closes.
+	void serve(int fd);
+	//Reads and carries out one request. False once the
+	//connection should close.
+	bool request(int fd, const std::string& line);
+	//Queues job and waits for a worker to finish it.
+	//Fails the job with "stopping" once stop() has been called.
+	void submit(Job& job);
+	//Median and 99th percentile of the recent job times.
+	//Call with lock held.
+	void percentiles(double* p50, double* p99);
+public:
+	//Serves on the socket path (replacing any socket there)
+	//with nworkers worker threads (0: one per core).
+	LauraServer(const std::string& path, int nworkers);
+	//Stops, if need be, and waits for the workers.
+	~LauraServer();
+
+	//Accepts connections until stop(). Returns false if the
+	//socket could not be set up.
+	bool run();
+	//Makes run() return and closes the connections. May be
+	//called from any thread.
+	void stop();
+};
+
+#endif //!defined __LAURASERVER_H__
@@ -0,0 +1,846 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "LauraShard.h"
+#include "LauraConvolution.h"
+#include "LauraFilters.h"
+#include "LauraHalf.h"
+#include <assert.h>
+#include <algorithm>
+#include <climits>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+
+//Rows of the images made in segments are padded to this many
+//bytes, so shards never share a cache line.
+#define LAURASHARD_ALIGN 64
+
+//Rows rowStart to rowEnd - 1 of an image in a segment: the
+//segment's name and where the rows are in it.
+//An unused window has an empty name.
+struct LauraShard::Window
+{
+	char name[32];
+	uint64_t offset; //Of the first row, in bytes.
+	uint64_t step;
+	int32_t rows;
+	int32_t cols;
+	int32_t type;
+	int32_t unused;
+};
+
+//What the coordinator sends a worker, followed by npayload bytes.
+//The worker computes rows rowStart to rowEnd - 1 of its windows;
+//the others are only read.
+struct LauraShard::Request
+{
+	int32_t op;
+	int32_t n; //Filter rows (CONVOLVE), bins (HISTOGRAM).
+	int32_t rowStart;
+	int32_t rowEnd;
+	//lthresh and uthresh (LABEL);
+	//lo, hi, mlo and mhi (HISTOGRAM).
+	float a;
+	float b;
+	float c;
+	float d;
+	Window in1;
+	Window in2;
+	Window out1;
+	Window out2;
+	uint64_t npayload; //The filter (CONVOLVE), labels (PROMOTE).
+};
+
+//What a worker sends back, followed by npayload bytes.
+struct LauraShard::Reply
+{
+	int32_t status; //0 on success.
+	int32_t unused;
+	uint64_t npayload; //The packed histogram (HISTOGRAM).
+};
+
+//Union-find over the pixels of a shard. Roots are the smallest
+//index in their set.
+static int32_t
+findRoot(std::vector<int32_t>& parent, int32_t x)
+{
+	while (parent[x] != x)
+	{
+		parent[x] = parent[parent[x]];
+		x = parent[x];
+	}
+	return x;
+}
+
+static void
+unite(std::vector<int32_t>& parent, int32_t x, int32_t y)
+{
+	x = findRoot(parent, x);
+	y = findRoot(parent, y);
+	if (x < y) parent[y] = x;
+	else parent[x] = y;
+}
+
+//Same, over the components of all the shards, keyed by
+//shard << 32 | label.
+static int64_t
+findRoot(std::unordered_map<int64_t, int64_t>& parent, int64_t x)
+{
+	if (!parent.count(x))
+		parent[x] = x;
+	while (parent[x] != x)
+	{
+		parent[x] = parent[parent[x]];
+		x = parent[x];
+	}
+	return x;
+}
+
+LauraShard::LauraShard(int nworkers)
+	: counter(0)
+{
+	if (0 >= nworkers)
+		nworkers = (int) std::thread::hardware_concurrency();
+	if (1 > nworkers) nworkers = 1;
+
+	for (int k = 0; k < nworkers; ++k)
+	{
+		int fds[2];
+		if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+			break;
+		pid_t pid = fork();
+		if (0 == pid)
+		{
+			//The worker only keeps its own end.
+			close(fds[0]);
+			for (size_t w = 0; w < workers.size(); ++w)
+				close(workers[w].fd);
+			serve(fds[1]);
+			_exit(0);
+		}
+		close(fds[1]);
+		if (0 > pid)
+		{
+			close(fds[0]);
+			break;
+		}
+		Worker w;
+		w.pid = pid;
+		w.fd = fds[0];
+		workers.push_back(w);
+	}
+}
+
+LauraShard::~LauraShard()
+{
+	Request req;
+	memset(&req, 0, sizeof(req));
+	req.op = QUIT;
+	for (size_t k = 0; k < workers.size(); ++k)
+	{
+		writeAll(workers[k].fd, &req, sizeof(req));
+		close(workers[k].fd);
+		waitpid(workers[k].pid, NULL, 0);
+	}
+
+	for (size_t k = 0; k < segments.size(); ++k)
+	{
+		munmap(segments[k].addr, segments[k].length);
+		shm_unlink(segments[k].name.c_str());
+	}
+}
+
+int
+LauraShard::size() const
+{
+	return (int) workers.size();
+}
+
+Mat
+LauraShard::create(int rows, int cols, int type)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "/laura-%d-%d", (int) getpid(),
+		counter++);
+
+	size_t step = cols*CV_ELEM_SIZE(type);
+	step = (step + LAURASHARD_ALIGN - 1)/LAURASHARD_ALIGN*LAURASHARD_ALIGN;
+	size_t length = std::max(rows*step, (size_t) 1);
+
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (0 > fd)
+		return Mat();
+	void* addr = MAP_FAILED;
+	if (0 == ftruncate(fd, length))
+		addr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+			fd, 0);
+	close(fd);
+	if (MAP_FAILED == addr)
+	{
+		shm_unlink(name);
+		return Mat();
+	}
+
+	Segment s;
+	s.name = name;
+	s.addr = addr;
+	s.length = length;
+	segments.push_back(s);
+	return Mat(rows, cols, type, addr, step);
+}
+
+Mat
+LauraShard::share(Mat& img)
+{
+	Mat ret = create(img.rows, img.cols, img.type());
+	if (ret.data)
+		img.copyTo(ret);
+	return ret;
+}
+
+void
+LauraShard::release(Mat& img)
+{
+	Segment* s = find(img);
+	if (!s)
+		return;
+	munmap(s->addr, s->length);
+	shm_unlink(s->name.c_str());
+	segments.erase(segments.begin() + (s - &segments[0]));
+}
+
+LauraShard::Segment*
+LauraShard::find(const Mat& img)
+{
+	for (size_t k = 0; k < segments.size(); ++k)
+	{
+		const uchar* addr = (const uchar*) segments[k].addr;
+		if ((addr <= img.data) && (addr + segments[k].length > img.data))
+			return &segments[k];
+	}
+	return NULL;
+}
+
+Mat
+LauraShard::shared(Mat& img, std::vector<Mat>& copies)
+{
+	if (find(img))
+		return img;
+	copies.push_back(share(img));
+	return copies.back();
+}
+
+void
+LauraShard::window(const Mat& img, int rowStart, int rowEnd, Window* w)
+{
+	Segment* s = find(img);
+	assert(s);
+	memset(w, 0, sizeof(Window));
+	strncpy(w->name, s->name.c_str(), sizeof(w->name) - 1);
+	w->offset = img.ptr(rowStart) - (const uchar*) s->addr;
+	w->step = img.step[0];
+	w->rows = rowEnd - rowStart;
+	w->cols = img.cols;
+	w->type = img.type();
+}
+
+std::vector<Range>
+LauraShard::shards(int rows)
+{
+	int n = std::min((int) workers.size(), rows);
+	std::vector<Range> ret;
+	for (int k = 0; k < n; ++k)
+		ret.push_back(Range((int) ((int64_t) k*rows/n),
+			(int) ((int64_t) (k + 1)*rows/n)));
+	return ret;
+}
+
+bool
+LauraShard::send(int k, Request& req, const void* payload)
+{
+	return writeAll(workers[k].fd, &req, sizeof(req)) &&
+		writeAll(workers[k].fd, payload, req.npayload);
+}
+
+bool
+LauraShard::receive(int k, std::vector<char>* payload)
+{
+	Reply rep;
+	if (!readAll(workers[k].fd, &rep, sizeof(rep)))
+		return false;
+	std::vector<char> data(rep.npayload);
+	if (!readAll(workers[k].fd, data.data(), data.size()))
+		return false;
+	if (payload)
+		payload->swap(data);
+	return 0 == rep.status;
+}
+
+bool
+LauraShard::receiveAll(int n)
+{
+	//Read every reply, even after a failure, so none is
+	//left for the next request.
+	bool ok = true;
+	for (int k = 0; k < n; ++k)
+		ok = receive(k, NULL) && ok;
+	return ok;
+}
+
+Mat
+LauraShard::convolve(Mat& img, Mat& filter)
+{
+	return convolve(img, filter, CV_32F);
+}
+
+Mat
+LauraShard::convolve(Mat& img, Mat& filter, int type)
+{
+	//Half storage is one channel only.
+	if ((LauraHalf::TYPE == CV_MAKETYPE(CV_MAT_DEPTH(type), 1)) &&
+		(1 < img.channels()))
+		return Mat();
+	std::vector<Mat> copies;
+	Mat in = shared(img, copies);
+	Mat dst = create(img.rows, img.cols,
+		CV_MAKETYPE(CV_MAT_DEPTH(type), img.channels()));
+	Mat f;
+	filter.convertTo(f, CV_32F); //Continuous, to send as is.
+	int top = f.rows/2;
+	int bottom = f.rows - top - 1;
+
+	//Each worker gets its rows plus the halo above and below.
+	//Rows past the window are mirrored by convolveBand, but only
+	//rows the worker does not compute would read them.
+	bool ok = in.data && dst.data;
+	std::vector<Range> parts = shards(img.rows);
+	int sent = 0;
+	for (size_t k = 0; ok && (k < parts.size()); ++k)
+	{
+		int s0 = std::max(0, parts[k].start - top);
+		int s1 = std::min(img.rows, parts[k].end + bottom);
+		Request req;
+		memset(&req, 0, sizeof(req));
+		req.op = CONVOLVE;
+		req.n = f.rows;
+		req.rowStart = parts[k].start - s0;
+		req.rowEnd = parts[k].end - s0;
+		window(in, s0, s1, &req.in1);
+		window(dst, s0, s1, &req.out1);
+		req.npayload = f.total()*sizeof(float);
+		ok = send(k, req, f.data);
+		sent += ok;
+	}
+	ok = receiveAll(sent) && ok;
+
+	for (size_t k = 0; k < copies.size(); ++k)
+		release(copies[k]);
+	if (!ok)
+	{
+		release(dst);
+		return Mat();
+	}
+	return dst;
+}
+
+bool
+LauraShard::gradientMagAngle(Mat& gx, Mat& gy, Mat& mag, Mat& angle)
+{
+	std::vector<Mat> copies;
+	Mat x = shared(gx, copies);
+	Mat y = shared(gy, copies);
+	mag = create(gx.rows, gx.cols, CV_MAKETYPE(gx.depth(), 1));
+	angle = create(gx.rows, gx.cols, CV_MAKETYPE(gx.depth(), 1));
+
+	//Pointwise, so no halo.
+	bool ok = x.data && y.data && mag.data && angle.data;
+	std::vector<Range> parts = shards(gx.rows);
+	int sent = 0;
+	for (size_t k = 0; ok && (k < parts.size()); ++k)
+	{
+		Request req;
+		memset(&req, 0, sizeof(req));
+		req.op = GRADIENT;
+		req.rowStart = 0;
+		req.rowEnd = parts[k].size();
+		window(x, parts[k].start, parts[k].end, &req.in1);
+		window(y, parts[k].start, parts[k].end, &req.in2);
+		window(mag, parts[k].start, parts[k].end, &req.out1);
+		window(angle, parts[k].start, parts[k].end, &req.out2);
+		ok = send(k, req, NULL);
+		sent += ok;
+	}
+	ok = receiveAll(sent) && ok;
+
+	for (size_t k = 0; k < copies.size(); ++k)
+		release(copies[k]);
+	if (!ok)
+	{
+		release(mag);
+		release(angle);
+		mag = Mat();
+		angle = Mat();
+	}
+	return ok;
+}
+
+Mat
+LauraShard::nonmaximaSuppression3x3(Mat& mag, Mat& angle)
+{
+	std::vector<Mat> copies;
+	Mat m = shared(mag, copies);
+	Mat a = shared(angle, copies);
+	Mat dst = create(mag.rows, mag.cols, mag.type());
+
+	//One row of halo. The first and last rows of a window are
+	//only passed through if they are the image's.
+	bool ok = m.data && a.data && dst.data;
+	std::vector<Range> parts = shards(mag.rows);
+	int sent = 0;
+	for (size_t k = 0; ok && (k < parts.size()); ++k)
+	{
+		int s0 = std::max(0, parts[k].start - 1);
+		int s1 = std::min(mag.rows, parts[k].end + 1);
+		Request req;
+		memset(&req, 0, sizeof(req));
+		req.op = NONMAXIMA;
+		req.rowStart = parts[k].start - s0;
+		req.rowEnd = parts[k].end - s0;
+		window(m, s0, s1, &req.in1);
+		window(a, s0, s1, &req.in2);
+		window(dst, s0, s1, &req.out1);
+		ok = send(k, req, NULL);
+		sent += ok;
+	}
+	ok = receiveAll(sent) && ok;
+
+	for (size_t k = 0; k < copies.size(); ++k)
+		release(copies[k]);
+	if (!ok)
+	{
+		release(dst);
+		return Mat();
+	}
+	return dst;
+}
+
+bool
+LauraShard::histogram(Mat& img, LauraHistogram& hist, float mlo,
+	float mhi)
+{
+	std::vector<Mat> copies;
+	Mat in = shared(img, copies);
+	int nbins;
+	float lo, hi;
+	hist.range(&nbins, &lo, &hi);
+	hist.clear();
+
+	bool ok = (NULL != in.data);
+	std::vector<Range> parts = shards(img.rows);
+	int sent = 0;
+	for (size_t k = 0; ok && (k < parts.size()); ++k)
+	{
+		Request req;
+		memset(&req, 0, sizeof(req));
+		req.op = HISTOGRAM;
+		req.n = nbins;
+		req.rowStart = 0;
+		req.rowEnd = parts[k].size();
+		req.a = lo;
+		req.b = hi;
+		req.c = mlo;
+		req.d = mhi;
+		window(in, parts[k].start, parts[k].end, &req.in1);
+		ok = send(k, req, NULL);
+		sent += ok;
+	}
+
+	//Merge the shards' counts.
+	LauraHistogram part(nbins, lo, hi);
+	std::vector<char> packed;
+	for (int k = 0; k < sent; ++k)
+	{
+		if (receive(k, &packed) &&
+			((nbins + 3)*sizeof(double) == packed.size()))
+		{
+			part.unpack((const double*) packed.data());
+			hist.merge(part);
+		}
+		else
+			ok = false;
+	}
+
+	for (size_t k = 0; k < copies.size(); ++k)
+		release(copies[k]);
+	return ok;
+}
+
+bool
+LauraShard::correctedMeanStdDev(Mat& img, float* mean, float* stddev)
+{
+	//Same masking as LauraFilters::correctedMeanStdDev.
+	LauraHistogram hist(256, 0.0f, 256.0f);
+	bool ok = histogram(img, hist, 0.5f, 254.5f);
+	*mean = hist.mean();
+	*stddev = hist.stddev();
+	return ok;
+}
+
+Mat
+LauraShard::hysteresisThresholding(Mat& img, float lthresh,
+	float uthresh)
+{
+	std::vector<Mat> copies;
+	Mat in = shared(img, copies);
+	Mat labels = create(img.rows, img.cols, CV_32S);
+	Mat dst = create(img.rows, img.cols, CV_32F);
+
+	//Each worker finds the chains in its own rows.
+	bool ok = in.data && labels.data && dst.data;
+	std::vector<Range> parts = shards(img.rows);
+	int sent = 0;
+	for (size_t k = 0; ok && (k < parts.size()); ++k)
+	{
+		Request req;
+		memset(&req, 0, sizeof(req));
+		req.op = LABEL;
+		req.rowStart = 0;
+		req.rowEnd = parts[k].size();
+		req.a = lthresh;
+		req.b = uthresh;
+		window(in, parts[k].start, parts[k].end, &req.in1);
+		window(labels, parts[k].start, parts[k].end, &req.out1);
+		window(dst, parts[k].start, parts[k].end, &req.out2);
+		ok = send(k, req, NULL);
+		sent += ok;
+	}
+	ok = receiveAll(sent) && ok;
+
+	//Join the chains that meet across each shard boundary.
+	//A chain is on if any chain joined to it is.
+	std::unordered_map<int64_t, int64_t> parent;
+	std::vector<int64_t> on;
+	int cols = img.cols;
+	for (size_t k = 0; ok && (k + 1 < parts.size()); ++k)
+	{
+		int i = parts[k].end - 1;
+		const int32_t* la = labels.ptr<int32_t>(i);
+		const int32_t* lb = labels.ptr<int32_t>(i + 1);
+		const float* da = dst.ptr<float>(i);
+		const float* db = dst.ptr<float>(i + 1);
+		int64_t ka = (int64_t) k << 32;
+		int64_t kb = (int64_t) (k + 1) << 32;
+		for (int j = 0; j < cols; ++j)
+		{
+			if (la[j] && da[j]) on.push_back(ka | la[j]);
+			if (lb[j] && db[j]) on.push_back(kb | lb[j]);
+			if (!la[j]) continue;
+			for (int jj = std::max(0, j - 1);
+				jj <= std::min(cols - 1, j + 1); ++jj)
+			{
+				if (!lb[jj]) continue;
+				int64_t x = findRoot(parent, ka | la[j]);
+				int64_t y = findRoot(parent, kb | lb[jj]);
+				if (x != y) parent[std::max(x, y)] = std::min(x, y);
+			}
+		}
+	}
+	std::unordered_set<int64_t> onRoots;
+	for (size_t t = 0; t < on.size(); ++t)
+		onRoots.insert(findRoot(parent, on[t]));
+
+	//Each shard turns on its chains that are joined to an
+	//edge somewhere else.
+	std::vector<std::vector<int32_t> > promote(parts.size());
+	for (std::unordered_map<int64_t, int64_t>::iterator it =
+		parent.begin(); it != parent.end(); ++it)
+	{
+		if (onRoots.count(findRoot(parent, it->first)))
+			promote[it->first >> 32].push_back(
+				(int32_t) (it->first & 0xffffffff));
+	}
+	sent = 0;
+	for (size_t k = 0; ok && (k < parts.size()); ++k)
+	{
+		std::vector<int32_t>& list = promote[k];
+		std::sort(list.begin(), list.end());
+		Request req;
+		memset(&req, 0, sizeof(req));
+		req.op = PROMOTE;
+		req.rowStart = 0;
+		req.rowEnd = parts[k].size();
+		window(labels, parts[k].start, parts[k].end, &req.in1);
+		window(dst, parts[k].start, parts[k].end, &req.out1);
+		req.npayload = list.size()*sizeof(int32_t);
+		ok = send(k, req, list.data());
+		sent += ok;
+	}
+	ok = receiveAll(sent) && ok;
+
+	release(labels);
+	for (size_t k = 0; k < copies.size(); ++k)
+		release(copies[k]);
+	if (!ok)
+	{
+		release(dst);
+		return Mat();
+	}
+	return dst;
+}
+
+void
+LauraShard::serve(int fd)
+{
+	Request req;
+	while (readAll(fd, &req, sizeof(req)) && (QUIT != req.op))
+	{
+		std::vector<char> payload(req.npayload);
+		if (!readAll(fd, payload.data(), payload.size()))
+			break;
+
+		std::vector<char> data;
+		Reply rep;
+		memset(&rep, 0, sizeof(rep));
+		rep.status = work(req, payload, data) ? 0 : -1;
+		rep.npayload = data.size();
+		if (!writeAll(fd, &rep, sizeof(rep)) ||
+			!writeAll(fd, data.data(), data.size()))
+			break;
+	}
+	close(fd);
+}
+
+bool
+LauraShard::work(Request& req, std::vector<char>& payload,
+	std::vector<char>& reply)
+{
+	std::vector<Segment> maps;
+	Mat in1 = map(req.in1, maps);
+	Mat in2 = map(req.in2, maps);
+	Mat out1 = map(req.out1, maps);
+	Mat out2 = map(req.out2, maps);
+
+	bool ok = true;
+	if (!in1.data)
+		ok = false;
+	else if (CONVOLVE == req.op)
+	{
+		int n = (int) (payload.size()/sizeof(float));
+		ok = out1.data && (0 < req.n) && (0 == n % req.n);
+		if (ok)
+		{
+			Mat filter(req.n, n/req.n, CV_32F, payload.data());
+			LauraConvolution::convolveBand(in1, filter, out1,
+				req.rowStart, req.rowEnd);
+		}
+	}
+	else if (GRADIENT == req.op)
+	{
+		ok = in2.data && out1.data && out2.data;
+		if (ok)
+			LauraFilters::gradientMagAngle(in1, in2, out1, out2,
+				req.rowStart, req.rowEnd);
+	}
+	else if (NONMAXIMA == req.op)
+	{
+		ok = in2.data && out1.data;
+		if (ok)
+			LauraFilters::nonmaximaSuppression3x3(in1, in2, out1,
+				req.rowStart, req.rowEnd);
+	}
+	else if (HISTOGRAM == req.op)
+	{
+		ok = (0 < req.n);
+		if (ok)
+		{
+			Mat rows = in1.rowRange(req.rowStart, req.rowEnd);
+			Mat img = LauraHalf::toFloat(rows);
+			LauraHistogram hist(req.n, req.a, req.b);
+			hist.compute(img, req.c, req.d);
+			reply.resize((req.n + 3)*sizeof(double));
+			hist.pack((double*) reply.data());
+		}
+	}
+	else if (LABEL == req.op)
+	{
+		ok = out1.data && out2.data;
+		if (ok)
+		{
+			Mat img = in1.rowRange(req.rowStart, req.rowEnd);
+			Mat labels = out1.rowRange(req.rowStart, req.rowEnd);
+			Mat dst = out2.rowRange(req.rowStart, req.rowEnd);
+			label(img, req.a, req.b, labels, dst);
+		}
+	}
+	else if (PROMOTE == req.op)
+	{
+		ok = (NULL != out1.data);
+		const int32_t* list = (const int32_t*) payload.data();
+		const int32_t* end = list + payload.size()/sizeof(int32_t);
+		for (int i = req.rowStart; ok && (i < req.rowEnd); ++i)
+		{
+			const int32_t* l = in1.ptr<int32_t>(i);
+			float* d = out1.ptr<float>(i);
+			for (int j = 0; j < in1.cols; ++j)
+			{
+				if (l[j] && std::binary_search(list, end, l[j]))
+					d[j] = 255.0f;
+			}
+		}
+	}
+	else
+		ok = false;
+
+	for (size_t k = 0; k < maps.size(); ++k)
+		munmap(maps[k].addr, maps[k].length);
+	return ok;
+}
+
+Mat
+LauraShard::map(const Window& w, std::vector<Segment>& maps)
+{
+	if (!w.name[0] || (0 >= w.rows))
+		return Mat();
+
+	int fd = shm_open(w.name, O_RDWR, 0);
+	if (0 > fd)
+		return Mat();
+	//mmap wants the offset on a page boundary.
+	size_t page = (size_t) sysconf(_SC_PAGESIZE);
+	size_t base = w.offset/page*page;
+	size_t length = (w.offset - base) + (w.rows - 1)*w.step +
+		w.cols*CV_ELEM_SIZE(w.type);
+	void* addr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+		fd, base);
+	close(fd);
+	if (MAP_FAILED == addr)
+		return Mat();
+
+	Segment s;
+	s.name = w.name;
+	s.addr = addr;
+	s.length = length;
+	maps.push_back(s);
+	return Mat(w.rows, w.cols, w.type,
+		(uchar*) addr + (w.offset - base), w.step);
+}
+
+void
+LauraShard::label(Mat& img, float lthresh, float uthresh,
+	Mat& labels, Mat& dst)
+{
+	int rows = img.rows;
+	int cols = img.cols;
+	assert((int64_t) rows*cols < INT_MAX);
+
+	//Union the pixels above lthresh with their neighbours above
+	//and to the left. on marks the pixels above uthresh, and
+	//later the roots of the chains holding one.
+	std::vector<int32_t> parent((size_t) rows*cols, -1);
+	std::vector<char> on(parent.size(), 0);
+	Mat line(1, cols, CV_32F);
+	for (int i = 0; i < rows; ++i)
+	{
+		LauraHalf::loadRow(img, i, line.ptr<float>());
+		const float* row = line.ptr<float>();
+		for (int j = 0; j < cols; ++j)
+		{
+			if (!(lthresh < row[j]))
+				continue;
+			int32_t p = i*cols + j;
+			parent[p] = p;
+			on[p] = (uthresh < row[j]);
+			if (0 < j && (0 <= parent[p - 1]))
+				unite(parent, p, p - 1);
+			if (0 == i)
+				continue;
+			for (int jj = std::max(0, j - 1);
+				jj <= std::min(cols - 1, j + 1); ++jj)
+			{
+				int32_t q = (i - 1)*cols + jj;
+				if (0 <= parent[q])
+					unite(parent, p, q);
+			}
+		}
+	}
+	for (size_t p = 0; p < parent.size(); ++p)
+	{
+		if (on[p])
+			on[findRoot(parent, (int32_t) p)] = 1;
+	}
+
+	//Labels are the root's index + 1; 0 is background.
+	for (int i = 0; i < rows; ++i)
+	{
+		int32_t* l = labels.ptr<int32_t>(i);
+		float* d = dst.ptr<float>(i);
+		for (int j = 0; j < cols; ++j)
+		{
+			int32_t p = i*cols + j;
+			if (0 > parent[p])
+			{
+				l[j] = 0;
+				d[j] = 0.0f;
+				continue;
+			}
+			int32_t r = findRoot(parent, p);
+			l[j] = r + 1;
+			d[j] = on[r] ? 255.0f : 0.0f;
+		}
+	}
+}
+
+bool
+LauraShard::readAll(int fd, void* buf, size_t n)
+{
+	char* p = (char*) buf;
+	while (0 < n)
+	{
+		ssize_t r = ::recv(fd, p, n, 0);
+		if (0 >= r) return false;
+		p += r;
+		n -= r;
+	}
+	return true;
+}
+
+bool
+LauraShard::writeAll(int fd, const void* buf, size_t n)
+{
+	const char* p = (const char*) buf;
+	while (0 < n)
+	{
+		//No SIGPIPE if the other end has gone.
+		ssize_t r = ::send(fd, p, n, MSG_NOSIGNAL);
+		if (0 >= r) return false;
+		p += r;
+		n -= r;
+	}
+	return true;
+}
@@ -0,0 +1,174 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef __LAURASHARD_H__
+#define __LAURASHARD_H__
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+#include "LauraHistogram.h"
+using cv::Mat;
+using cv::Range;
+
+//Runs LauraConvolution and LauraFilters stages on very large
+//images in several worker processes, so they are not held back
+//by the memory bandwidth of one socket or one allocator.
+//Images live in POSIX shared memory segments. Each stage is cut
+//into shards of rows, one per worker. A worker is sent its shard
+//over a Unix domain socket as windows into the segments: the rows
+//it writes plus the halo rows its stencil reads. It maps the
+//windows itself and writes its rows straight into the result, so
+//nothing needs stitching except the stages that need the whole
+//image. Those (statistics, hysteresis connectivity) are done per
+//shard and merged here. Since a request names everything it
+//touches, the same protocol could serve workers on other machines
+//with the windows' bytes sent along.
+//
+//The workers are forked by the constructor, so make the LauraShard
+//before starting any threads. The images it makes live in its
+//segments, so it must outlive the Mats.
+//
+//	LauraShard shard(0);
+//	Mat img = shard.share(big);
+//	Mat smoothed = shard.convolve(img, gaussian);
+class LauraShard
+{
+	//What the workers can be asked to do.
+	enum Op
+	{
+		QUIT,
+		CONVOLVE,  //LauraConvolution::convolveBand.
+		GRADIENT,  //LauraFilters::gradientMagAngle.
+		NONMAXIMA, //LauraFilters::nonmaximaSuppression3x3.
+		HISTOGRAM, //Histogram of the shard, sent back packed.
+		LABEL,     //Hysteresis within the shard, with the
+		           //components labelled for stitching.
+		PROMOTE    //Turns on the components listed.
+	};
+	//Wire format. Defined in the .cpp.
+	struct Window;
+	struct Request;
+	struct Reply;
+	struct Segment
+	{
+		std::string name;
+		void* addr;
+		size_t length;
+	};
+	struct Worker
+	{
+		pid_t pid;
+		int fd; //Our end of its socket.
+	};
+
+	std::vector<Segment> segments;
+	std::vector<Worker> workers;
+	int counter; //For naming segments.
+
+	//The segment holding img's data, or NULL.
+	Segment* find(const Mat& img);
+	//img if it is in a segment, otherwise a shared copy, which
+	//is added to copies for releasing afterwards.
+	Mat shared(Mat& img, std::vector<Mat>& copies);
+	//Describes rows rowStart to rowEnd - 1 of img (in a segment).
+	void window(const Mat& img, int rowStart, int rowEnd, Window* w);
+	//Rows of each worker's shard of an image with rows rows.
+	std::vector<Range> shards(int rows);
+	//Sends req and its payload to worker k.
+	bool send(int k, Request& req, const void* payload);
+	//Waits for the reply of worker k. Its payload goes to
+	//payload, if not NULL.
+	bool receive(int k, std::vector<char>* payload);
+	//Waits for the replies of workers 0 to n - 1.
+	bool receiveAll(int n);
+
+	/**** The worker side ****/
+	//Serves requests on fd until told to quit.
+	static void serve(int fd);
+	//Carries out req. Anything to send back goes to reply.
+	static bool work(Request& req, std::vector<char>& payload,
+		std::vector<char>& reply);
+	//Maps the window w and returns it as a Mat. The mapping is
+	//added to maps. Returns an empty Mat for an unused window.
+	static Mat map(const Window& w, std::vector<Segment>& maps);
+	//Hysteresis within one shard (see hysteresisThresholding).
+	static void label(Mat& img, float lthresh, float uthresh,
+		Mat& labels, Mat& dst);
+public:
+	//Starts nworkers worker processes (0: one per core).
+	LauraShard(int nworkers);
+	//Stops the workers and removes the segments.
+	~LauraShard();
+
+	//Number of workers running.
+	int size() const;
+
+	/**** Shared images ****/
+	//A rows x cols image of type in a new segment.
+	//Returns an empty Mat on failure.
+	Mat create(int rows, int cols, int type);
+	//A copy of img in a new segment.
+	Mat share(Mat& img);
+	//Removes the segment holding img. Mats on it must not be
+	//used afterwards.
+	void release(Mat& img);
+
+	/**** Stages ****/
+	//Images not in a segment are copied into one first.
+	//Results are made in new segments; Mats come back empty
+	//(and bools false) if a worker failed.
+	//LauraConvolution::convolve, with the result as CV_32F.
+	Mat convolve(Mat& img, Mat& filter);
+	//Same, with the result stored as type (CV_32F or
+	//LauraHalf::TYPE; half only for one channel).
+	Mat convolve(Mat& img, Mat& filter, int type);
+	//LauraFilters::gradientMagAngle. mag and angle are made
+	//in segments, stored like gx.
+	bool gradientMagAngle(Mat& gx, Mat& gy, Mat& mag, Mat& angle);
+	//LauraFilters::nonmaximaSuppression3x3 with an angle image.
+	Mat nonmaximaSuppression3x3(Mat& mag, Mat& angle);
+	//hist.compute(img, mlo, mhi): each shard is counted by its
+	//worker and the counts are merged into hist.
+	bool histogram(Mat& img, LauraHistogram& hist, float mlo,
+		float mhi);
+	//LauraFilters::correctedMeanStdDev, from histogram().
+	bool correctedMeanStdDev(Mat& img, float* mean, float* stddev);
+	//Hysteresis thresholding: pixels above uthresh are edges,
+	//and so is every pixel above lthresh connected to one of
+	//them (8-connected) through pixels above lthresh.
+	//Unlike LauraFilters::hysteresisThresholding, which grows
+	//the edges in one pass over the image, whole chains are
+	//followed, as by LauraSparse::followEdges. Each worker labels the chains in its shard; the
+	//labels are joined across the shard boundaries here and the
+	//chains that reach an edge pixel in another shard are turned
+	//on by a second round of requests.
+	Mat hysteresisThresholding(Mat& img, float lthresh,
+		float uthresh);
+
+	/**** Sockets ****/
+	//Reads or writes exactly n bytes on the socket fd (also
+	//used by LauraServer). False if the other end has gone.
+	static bool readAll(int fd, void* buf, size_t n);
+	static bool writeAll(int fd, const void* buf, size_t n);
+};
+
+#endif //!defined __LAURASHARD_H__
@@ -0,0 +1,406 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "LauraSparse.h"
+#include "LauraBinary.h"
+#include "LauraConvolution.h"
+#include "LauraFilters.h"
+#include "LauraHalf.h"
+#include "LauraMemory.h"
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+#include <vector>
+
+namespace
+{
+//Number of nonzero values among the n at p.
+template <typename T>
+int
+countSet(const T* p, int n)
+{
+	int ret = 0;
+	for (int k = 0; k < n; ++k)
+		ret += (0 != p[k]);
+	return ret;
+}
+
+//Same, for halves (either zero).
+int
+countSetHalf(const unsigned short* p, int n)
+{
+	int ret = 0;
+	for (int k = 0; k < n; ++k)
+		ret += (0 != (p[k] & 0x7fff));
+	return ret;
+}
+}
+
+LauraSparse::Tiles::Tiles(int rows, int cols):
+	rows(rows), cols(cols),
+	tileRows((rows + TILE - 1)/TILE), tileCols((cols + TILE - 1)/TILE),
+	counts(tileRows*tileCols, 0)
+{
+
+}
+
+LauraSparse::Tiles::Tiles(Mat& img):
+	Tiles(img.rows, img.cols)
+{
+	assert(1 == img.channels());
+	for (int i = 0; i < rows; ++i)
+	{
+		int ti = i/TILE;
+		for (int tj = 0; tj < tileCols; ++tj)
+		{
+			int j0 = tj*TILE;
+			int n = std::min((int) TILE, cols - j0);
+			int set;
+			switch (img.depth())
+			{
+			case CV_8U:
+				set = countSet(img.ptr<uchar>(i) + j0, n);
+				break;
+			case CV_16U:
+				set = countSetHalf(img.ptr<unsigned short>(i) + j0, n);
+				break;
+			default:
+				set = countSet(img.ptr<float>(i) + j0, n);
+			}
+			add(ti, tj, set);
+		}
+	}
+}
+
+int
+LauraSparse::Tiles::tileRowCount() const
+{
+	return tileRows;
+}
+
+int
+LauraSparse::Tiles::tileColCount() const
+{
+	return tileCols;
+}
+
+void
+LauraSparse::Tiles::add(int ti, int tj, int n)
+{
+	counts[ti*tileCols + tj] += n;
+}
+
+int
+LauraSparse::Tiles::state(int ti, int tj) const
+{
+	int count = counts[ti*tileCols + tj];
+	int area = std::min((int) TILE, rows - ti*TILE)*
+		std::min((int) TILE, cols - tj*TILE);
+	if (0 == count)
+		return EMPTY;
+	return (area == count) ? FULL : MIXED;
+}
+
+bool
+LauraSparse::Tiles::uniform(int ti, int tj, int s) const
+{
+	for (int a = std::max(ti - 1, 0); a <= std::min(ti + 1, tileRows - 1); ++a)
+	{
+		for (int b = std::max(tj - 1, 0); b <= std::min(tj + 1, tileCols - 1);
+			++b)
+		{
+			if (s != state(a, b))
+				return false;
+		}
+	}
+	return true;
+}
+
+double
+LauraSparse::Tiles::fraction(int s) const
+{
+	if (counts.empty())
+		return 0;
+	long n = 0;
+	for (int ti = 0; ti < tileRows; ++ti)
+		for (int tj = 0; tj < tileCols; ++tj)
+			n += (s == state(ti, tj));
+	return (double) n/counts.size();
+}
+
+LauraSparse::LauraSparse()
+{
+
+}
+
+LauraSparse::~LauraSparse()
+{
+
+}
+
+Mat
+LauraSparse::threshold(Mat& img, float thresh, Tiles& tiles)
+{
+	assert(CV_32F == img.type());
+	Mat ret = LauraMemory::create(img.rows, img.cols, CV_32F);
+	for (int i = 0; i < img.rows; ++i)
+	{
+		const float* src = img.ptr<float>(i);
+		float* dst = ret.ptr<float>(i);
+		for (int tj = 0; tj < tiles.tileColCount(); ++tj)
+		{
+			int j1 = std::min((tj + 1)*TILE, img.cols);
+			int n = 0;
+			for (int j = tj*TILE; j < j1; ++j)
+			{
+				bool set = (thresh < src[j]);
+				dst[j] = set ? 255.0f : 0.0f;
+				n += set;
+			}
+			tiles.add(i/TILE, tj, n);
+		}
+	}
+	return ret;
+}
+
+Mat
+LauraSparse::nonmaximaSuppression3x3(Mat& mag, Mat& angle)
+{
+	Mat m = LauraHalf::toFloat(mag);
+	Mat a = LauraHalf::toFloat(angle);
+	int rows = m.rows;
+	int cols = m.cols;
+	Tiles tiles(m);
+	Mat ret = LauraMemory::create(rows, cols, CV_32F);
+	for (int i = 0; i < rows; ++i)
+	{
+		const float* row = m.ptr<float>(i);
+		float* out = ret.ptr<float>(i);
+		for (int tj = 0; tj < tiles.tileColCount(); ++tj)
+		{
+			int j0 = tj*TILE;
+			int j1 = std::min(j0 + TILE, cols);
+			//Copying an empty span is all it needs.
+			memcpy(out + j0, row + j0, (j1 - j0)*sizeof(float));
+			if (EMPTY == tiles.state(i/TILE, tj))
+				continue;
+
+			//Pixels on the boundary are passed through.
+			//nonmaximaRow leaves its first and last pixels
+			//alone, so it gets one more on either side.
+			if ((0 == i) || (rows - 1 == i))
+				continue;
+			int start = std::max(j0, 1) - 1;
+			int end = std::min(j1, cols - 1) + 1;
+			LauraFilters::nonmaximaRow(m.ptr<float>(i - 1) + start,
+				row + start, m.ptr<float>(i + 1) + start,
+				a.ptr<float>(i) + start, end - start, out + start);
+		}
+	}
+	return (LauraHalf::TYPE == mag.type()) ? LauraHalf::pack(ret) : ret;
+}
+
+Mat
+LauraSparse::nonmaximaSuppression3x3(Mat& mag)
+{
+	assert(CV_32F == mag.type());
+	int rows = mag.rows;
+	int cols = mag.cols;
+	Tiles tiles(mag);
+	Mat ret = LauraMemory::create(rows, cols, CV_32F);
+	for (int i = 0; i < rows; ++i)
+	{
+		const float* row = mag.ptr<float>(i);
+		float* out = ret.ptr<float>(i);
+		for (int tj = 0; tj < tiles.tileColCount(); ++tj)
+		{
+			int j0 = tj*TILE;
+			int j1 = std::min(j0 + TILE, cols);
+			memcpy(out + j0, row + j0, (j1 - j0)*sizeof(float));
+			if ((EMPTY == tiles.state(i/TILE, tj)) || (0 == i) ||
+				(rows - 1 == i))
+				continue;
+
+			//As LauraFilters: a local maximum along all four
+			//directions through the pixel.
+			const float* above = mag.ptr<float>(i - 1);
+			const float* below = mag.ptr<float>(i + 1);
+			for (int j = std::max(j0, 1); j < std::min(j1, cols - 1); ++j)
+			{
+				float p0 = row[j];
+				if (!p0) continue;
+				int count = 0;
+				count += LauraFilters::isLocalMax(p0, above[j-1], below[j+1]);
+				count += LauraFilters::isLocalMax(p0, row[j+1], row[j-1]);
+				count += LauraFilters::isLocalMax(p0, above[j+1], below[j-1]);
+				count += LauraFilters::isLocalMax(p0, above[j], below[j]);
+				if (count < 4)
+					out[j] = 0.0f;
+			}
+		}
+	}
+	return ret;
+}
+
+Mat
+LauraSparse::hysteresisThresholding(Mat& img, float lthresh,
+	float uthresh)
+{
+	int rows = img.rows;
+	int cols = img.cols;
+	Tiles utiles(rows, cols);
+	Tiles ltiles(rows, cols);
+	Mat ubin = threshold(img, uthresh, utiles);
+	Mat lbin = threshold(img, lthresh, ltiles);
+
+	//Row by row, as LauraFilters does, since pixels grown
+	//earlier in a row or above can grow their neighbors.
+	//Only pixels in lbin and not yet in ubin can change, so
+	//tiles empty in lbin or full in ubin (which only grows)
+	//are passed over.
+	for (int i = 1; i < rows - 1; ++i)
+	{
+		int ti = i/TILE;
+		const float* above = ubin.ptr<float>(i - 1);
+		float* row = ubin.ptr<float>(i);
+		const float* below = ubin.ptr<float>(i + 1);
+		const float* l = lbin.ptr<float>(i);
+		for (int tj = 0; tj < ltiles.tileColCount(); ++tj)
+		{
+			if ((EMPTY == ltiles.state(ti, tj)) ||
+				(FULL == utiles.state(ti, tj)))
+				continue;
+			int j1 = std::min((tj + 1)*TILE, cols - 1);
+			for (int j = std::max(tj*TILE, 1); j < j1; ++j)
+			{
+				if (!l[j] || row[j])
+					continue;
+				float intensitySum = above[j-1] + above[j] + above[j+1] +
+					row[j-1] + row[j+1] +
+					below[j-1] + below[j] + below[j+1];
+				if ((0 < intensitySum) && (5*255.0f > intensitySum))
+					row[j] = 255.0f;
+			}
+		}
+	}
+	return ubin;
+}
+
+Mat
+LauraSparse::followEdges(Mat& img, float lthresh, float uthresh)
+{
+	Mat src = LauraHalf::toFloat(img);
+	int rows = src.rows;
+	int cols = src.cols;
+	Mat ret = LauraMemory::create(rows, cols, CV_32F);
+	for (int i = 0; i < rows; ++i)
+		std::fill(ret.ptr<float>(i), ret.ptr<float>(i) + cols, 0.0f);
+
+	//Each edge pixel not yet reached starts a flood fill of its
+	//chain, with the pixels still to look around on stack.
+	std::vector<std::pair<int, int> > stack;
+	for (int i = 0; i < rows; ++i)
+	{
+		const float* row = src.ptr<float>(i);
+		float* out = ret.ptr<float>(i);
+		for (int j = 0; j < cols; ++j)
+		{
+			if (!((lthresh < row[j]) && (uthresh < row[j])) || out[j])
+				continue;
+			out[j] = 255.0f;
+			stack.push_back(std::make_pair(i, j));
+			while (!stack.empty())
+			{
+				int y = stack.back().first;
+				int x = stack.back().second;
+				stack.pop_back();
+				for (int yy = std::max(0, y - 1);
+					yy <= std::min(rows - 1, y + 1); ++yy)
+				{
+					const float* s = src.ptr<float>(yy);
+					float* d = ret.ptr<float>(yy);
+					for (int xx = std::max(0, x - 1);
+						xx <= std::min(cols - 1, x + 1); ++xx)
+					{
+						if ((lthresh < s[xx]) && !d[xx])
+						{
+							d[xx] = 255.0f;
+							stack.push_back(std::make_pair(yy, xx));
+						}
+					}
+				}
+			}
+		}
+	}
+	return ret;
+}
+
+Mat
+LauraSparse::hitAndMiss(Mat& img, Mat& filter)
+{
+	if ((3 != filter.rows) || (3 != filter.cols))
+		return LauraConvolution::hitAndMiss(img, filter);
+	assert(CV_32F == img.type());
+	int rows = img.rows;
+	int cols = img.cols;
+	uchar table[LauraBinary::TABLE_SIZE];
+	LauraBinary::hitAndMissTable(filter, table);
+	Tiles tiles(img);
+
+	Mat ret = LauraMemory::create(rows, cols, CV_32F);
+	for (int i = 0; i < rows; ++i)
+	{
+		int ti = i/TILE;
+		const float* p[3] = {
+			img.ptr<float>(LauraConvolution::mirrorIndex(i - 1, rows)),
+			img.ptr<float>(i),
+			img.ptr<float>(LauraConvolution::mirrorIndex(i + 1, rows))};
+		float* out = ret.ptr<float>(i);
+		for (int tj = 0; tj < tiles.tileColCount(); ++tj)
+		{
+			int j0 = tj*TILE;
+			int j1 = std::min(j0 + TILE, cols);
+
+			//Inside a uniform block every neighborhood is all
+			//0s or all 1s, so the whole tile has one value.
+			int s = tiles.state(ti, tj);
+			if ((MIXED != s) && tiles.uniform(ti, tj, s))
+			{
+				float v = table[(EMPTY == s) ? 0 : LauraBinary::TABLE_SIZE - 1];
+				std::fill(out + j0, out + j1, v);
+				continue;
+			}
+
+			//Slide the code along the span (see LauraBinary::code).
+			int c = 0;
+			for (int j = j0 - 1; j < j1 + 1; ++j)
+			{
+				int x = ((0 <= j) && (cols > j)) ? j :
+					LauraConvolution::mirrorIndex(j, cols);
+				c |= ((0 != p[0][x]) | ((0 != p[1][x]) << 1) |
+					((0 != p[2][x]) << 2)) << 6;
+				if (j > j0)
+					out[j - 1] = table[c];
+				c >>= 3;
+			}
+		}
+	}
+	return ret;
+}
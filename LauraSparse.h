@@ -0,0 +1,101 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef __LAURASPARSE_H__
+#define __LAURASPARSE_H__
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+using cv::Mat;
+
+//Versions of the stages that run on sparse images (nonmaxima
+//suppression, hysteresis, hit and miss), whose work follows the
+//content rather than the image size.
+//Each first builds (or is given) a coarse map of the image in
+//tiles of TILE x TILE pixels, each EMPTY (all 0), FULL (all
+//nonzero) or MIXED. Empty tiles are skipped entirely and uniform
+//ones are handled in bulk; only mixed tiles are looked at pixel
+//by pixel. Results are the same as the dense versions'.
+class LauraSparse
+{
+public:
+	enum { EMPTY = 0, MIXED = 1, FULL = 2 };
+	//Tile width and height, in pixels.
+	enum { TILE = 32 };
+
+	//Occupancy map of a rows x cols image: the number of
+	//nonzero pixels in each tile. The last row and column of
+	//tiles may be cut short by the image edges.
+	class Tiles
+	{
+		int rows;
+		int cols;
+		int tileRows;
+		int tileCols;
+		std::vector<int> counts;
+	public:
+		//All tiles empty; add() fills them in.
+		Tiles(int rows, int cols);
+		//The map of the nonzero pixels of img (CV_32F, half or
+		//CV_8U, one channel).
+		Tiles(Mat& img);
+
+		int tileRowCount() const;
+		int tileColCount() const;
+		//Counts n more nonzero pixels in tile (ti, tj).
+		void add(int ti, int tj, int n);
+		//EMPTY, FULL or MIXED.
+		int state(int ti, int tj) const;
+		//Whether tile (ti, tj) and the tiles around it all have
+		//state s. Tiles past the edges are left out.
+		bool uniform(int ti, int tj, int s) const;
+		//Fraction of the tiles with state s.
+		double fraction(int s) const;
+	};
+
+	LauraSparse();
+	~LauraSparse();
+
+	//LauraFilters::threshold, also returning the map of the
+	//result in tiles.
+	static Mat threshold(Mat& img, float thresh, Tiles& tiles);
+
+	//LauraFilters::nonmaximaSuppression3x3 with an angle image
+	//(mag and angle CV_32F or half; half is unpacked first).
+	static Mat nonmaximaSuppression3x3(Mat& mag, Mat& angle);
+	//LauraFilters::nonmaximaSuppression3x3 on blobs (CV_32F).
+	static Mat nonmaximaSuppression3x3(Mat& mag);
+	//LauraFilters::hysteresisThresholding (img CV_32F). Pixels
+	//are visited in the same order, so edges grow the same way.
+	static Mat hysteresisThresholding(Mat& img, float lthresh,
+		float uthresh);
+	//Hysteresis thresholding that follows whole chains (img
+	//CV_32F or half): pixels above uthresh are edges, and so is
+	//every pixel above lthresh 8-connected to one through pixels
+	//above lthresh. Same result as LauraShard's, in one process.
+	//Only the chains holding an edge pixel are visited.
+	static Mat followEdges(Mat& img, float lthresh, float uthresh);
+	//LauraConvolution::hitAndMiss of an image of 0s and 1s
+	//(CV_32F; any nonzero value counts as 1) with a 3x3 filter,
+	//by LauraBinary's tables. Other filters go to the engine.
+	static Mat hitAndMiss(Mat& img, Mat& filter);
+};
+
+#endif //!defined __LAURASPARSE_H__
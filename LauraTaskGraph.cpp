@@ -0,0 +1,373 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "LauraTaskGraph.h"
+#include "LauraConvolution.h"
+#include "LauraFilters.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+//Work-stealing pool for one run of a LauraTaskGraph.
+//Each worker pops its own newest task first (it just made its
+//inputs, so they are still in cache) and steals the oldest task
+//from another worker when it runs dry. Workers with nothing to
+//do sleep until a task is queued or the last one finishes.
+class LauraTaskPool
+{
+	struct Worker
+	{
+		std::mutex lock;
+		std::deque<int> queue;
+	};
+
+	LauraTaskGraph& graph;
+	std::vector<Worker> workers;
+	std::unique_ptr<std::atomic<int>[]> pending; //Unfinished deps.
+	std::atomic<int> remaining; //Tasks not yet finished.
+	std::atomic<int> queued; //Tasks ready in the queues.
+	std::mutex idleLock; //For idle only.
+	std::condition_variable idle;
+
+	void push(int w, int task)
+	{
+		{
+			std::lock_guard<std::mutex> guard(workers[w].lock);
+			workers[w].queue.push_back(task);
+		}
+		queued.fetch_add(1);
+		//Taking idleLock keeps a worker from missing the wakeup
+		//between seeing no task and sleeping.
+		std::lock_guard<std::mutex> guard(idleLock);
+		idle.notify_one();
+	}
+
+	//Sleeps until a task is queued or all have finished.
+	void wait()
+	{
+		std::unique_lock<std::mutex> guard(idleLock);
+		while ((0 == queued.load()) && (0 < remaining.load()))
+			idle.wait(guard);
+	}
+
+	//Own queue from the back, others from the front.
+	bool pop(int w, int* task)
+	{
+		int n = (int) workers.size();
+		for (int k = 0; k < n; ++k)
+		{
+			Worker& victim = workers[(w + k) % n];
+			std::lock_guard<std::mutex> guard(victim.lock);
+			if (victim.queue.empty()) continue;
+			if (0 == k)
+			{
+				*task = victim.queue.back();
+				victim.queue.pop_back();
+			}
+			else
+			{
+				*task = victim.queue.front();
+				victim.queue.pop_front();
+			}
+			queued.fetch_sub(1);
+			return true;
+		}
+		return false;
+	}
+public:
+	LauraTaskPool(LauraTaskGraph& graph, int nthreads)
+		: graph(graph), workers(nthreads),
+		  pending(new std::atomic<int>[graph.tasks.size()]),
+		  remaining((int) graph.tasks.size()), queued(0)
+	{
+		//Deal the tasks that are ready out round-robin.
+		int next = 0;
+		for (size_t t = 0; t < graph.tasks.size(); ++t)
+		{
+			pending[t] = graph.tasks[t].ndeps;
+			if (0 == graph.tasks[t].ndeps)
+			{
+				workers[next].queue.push_back((int) t);
+				next = (next + 1) % nthreads;
+				queued++;
+			}
+		}
+	}
+
+	void work(int w)
+	{
+		while (0 < remaining.load())
+		{
+			int t;
+			if (!pop(w, &t))
+			{
+				wait();
+				continue;
+			}
+
+			LauraTaskGraph::Task& task = graph.tasks[t];
+			(*task.func)(task.rowStart, task.rowEnd, task.varargs);
+
+			//Successors whose last input this was are ready.
+			for (size_t s = 0; s < task.successors.size(); ++s)
+			{
+				int succ = task.successors[s];
+				if (1 == pending[succ].fetch_sub(1))
+					push(w, succ);
+			}
+			if (1 == remaining.fetch_sub(1))
+			{
+				//The others may be asleep waiting for more.
+				std::lock_guard<std::mutex> guard(idleLock);
+				idle.notify_all();
+			}
+		}
+	}
+};
+
+LauraTaskGraph::LauraTaskGraph(int bandRows)
+	: bandRows(bandRows)
+{
+
+}
+
+LauraTaskGraph::~LauraTaskGraph()
+{
+
+}
+
+int
+LauraTaskGraph::addTask(
+	void (*func) (int rowStart, int rowEnd, void* varargs),
+	void* varargs, int rowStart, int rowEnd)
+{
+	Task task;
+	task.func = func;
+	task.varargs = varargs;
+	task.rowStart = rowStart;
+	task.rowEnd = rowEnd;
+	task.ndeps = 0;
+	tasks.push_back(task);
+	return (int) tasks.size() - 1;
+}
+
+void
+LauraTaskGraph::addDependency(int before, int after)
+{
+	tasks[before].successors.push_back(after);
+	tasks[after].ndeps++;
+}
+
+int
+LauraTaskGraph::addStage(int rows,
+	void (*func) (int rowStart, int rowEnd, void* varargs),
+	void* varargs, const std::vector<int>& inputs, int halo)
+{
+	int band = bandRows;
+	if (0 >= band)
+	{
+		//Several bands per core so stealing can balance the load,
+		//but not so thin that the halo dominates.
+		int cores = (int) std::thread::hardware_concurrency();
+		if (1 > cores) cores = 1;
+		band = rows/(4*cores);
+		if (16 > band) band = 16;
+	}
+
+	Stage stage;
+	for (int r0 = 0; r0 < rows; r0 += band)
+	{
+		int r1 = (rows < r0 + band) ? rows : r0 + band;
+		int t = addTask(func, varargs, r0, r1);
+		stage.tasks.push_back(t);
+
+		//Rows this band reads. Mirrored rows past the edges are
+		//copies of rows inside this range.
+		int need0 = (0 > r0 - halo) ? 0 : r0 - halo;
+		int need1 = (rows < r1 + halo) ? rows : r1 + halo;
+		for (size_t k = 0; k < inputs.size(); ++k)
+		{
+			if (0 > inputs[k]) continue;
+			Stage& in = stages[inputs[k]];
+			for (size_t b = 0; b < in.tasks.size(); ++b)
+			{
+				Task& src = tasks[in.tasks[b]];
+				if ((src.rowStart < need1) && (src.rowEnd > need0))
+					addDependency(in.tasks[b], t);
+			}
+		}
+	}
+
+	stages.push_back(stage);
+	return (int) stages.size() - 1;
+}
+
+int
+LauraTaskGraph::addConvolution(Mat& img, Mat& filter, Mat& dst,
+	int input)
+{
+	StageArgs a;
+	a.in1 = &img;
+	a.in2 = NULL;
+	a.out1 = &dst;
+	a.out2 = NULL;
+	a.filter = filter;
+	args.push_back(a);
+
+	std::vector<int> inputs(1, input);
+	int halo = (filter.rows > filter.cols) ? filter.rows : filter.cols;
+	return addStage(img.rows, convolutionTask, (void*) &args.back(),
+		inputs, halo/2);
+}
+
+int
+LauraTaskGraph::addSeparableConvolution(Mat& img, Mat& kx, Mat& ky,
+	Mat& dst, int input)
+{
+	StageArgs a;
+	a.in1 = &img;
+	a.in2 = NULL;
+	a.out1 = &dst;
+	a.out2 = NULL;
+	a.filter = kx;
+	a.filter2 = ky;
+	args.push_back(a);
+
+	std::vector<int> inputs(1, input);
+	return addStage(img.rows, separableTask, (void*) &args.back(),
+		inputs, ky.rows/2);
+}
+
+int
+LauraTaskGraph::addGradient(Mat& gx, Mat& gy, Mat& mag, Mat& angle,
+	int inputX, int inputY)
+{
+	StageArgs a;
+	a.in1 = &gx;
+	a.in2 = &gy;
+	a.out1 = &mag;
+	a.out2 = &angle;
+	args.push_back(a);
+
+	std::vector<int> inputs;
+	inputs.push_back(inputX);
+	inputs.push_back(inputY);
+	return addStage(gx.rows, gradientTask, (void*) &args.back(),
+		inputs, 0);
+}
+
+int
+LauraTaskGraph::addColorGradient(Mat& img, Mat& mag, Mat& angle,
+	int method, int input)
+{
+	StageArgs a;
+	a.in1 = &img;
+	a.in2 = NULL;
+	a.out1 = &mag;
+	a.out2 = &angle;
+	a.method = method;
+	args.push_back(a);
+
+	std::vector<int> inputs(1, input);
+	return addStage(img.rows, colorGradientTask, (void*) &args.back(),
+		inputs, 1);
+}
+
+int
+LauraTaskGraph::addNonmaxima(Mat& mag, Mat& angle, Mat& dst,
+	int input)
+{
+	StageArgs a;
+	a.in1 = &mag;
+	a.in2 = &angle;
+	a.out1 = &dst;
+	a.out2 = NULL;
+	args.push_back(a);
+
+	std::vector<int> inputs(1, input);
+	return addStage(mag.rows, nonmaximaTask, (void*) &args.back(),
+		inputs, 1);
+}
+
+void
+LauraTaskGraph::convolutionTask(int rowStart, int rowEnd,
+	void* varargs)
+{
+	StageArgs* a = (StageArgs*) varargs;
+	LauraConvolution::convolveBand(*a->in1, a->filter, *a->out1,
+		rowStart, rowEnd);
+}
+
+void
+LauraTaskGraph::separableTask(int rowStart, int rowEnd,
+	void* varargs)
+{
+	StageArgs* a = (StageArgs*) varargs;
+	LauraConvolution::convolveSeparableBand(*a->in1, a->filter,
+		a->filter2, *a->out1, rowStart, rowEnd);
+}
+
+void
+LauraTaskGraph::gradientTask(int rowStart, int rowEnd,
+	void* varargs)
+{
+	StageArgs* a = (StageArgs*) varargs;
+	LauraFilters::gradientMagAngle(*a->in1, *a->in2,
+		*a->out1, *a->out2, rowStart, rowEnd);
+}
+
+void
+LauraTaskGraph::nonmaximaTask(int rowStart, int rowEnd,
+	void* varargs)
+{
+	StageArgs* a = (StageArgs*) varargs;
+	LauraFilters::nonmaximaSuppression3x3(*a->in1, *a->in2,
+		*a->out1, rowStart, rowEnd);
+}
+
+void
+LauraTaskGraph::colorGradientTask(int rowStart, int rowEnd,
+	void* varargs)
+{
+	StageArgs* a = (StageArgs*) varargs;
+	LauraFilters::colorGradient(*a->in1, *a->out1, *a->out2,
+		a->method, rowStart, rowEnd);
+}
+
+void
+LauraTaskGraph::run(int nthreads)
+{
+	if (0 >= nthreads)
+		nthreads = (int) std::thread::hardware_concurrency();
+	if (1 > nthreads)
+		nthreads = 1;
+	if (tasks.empty())
+		return;
+
+	LauraTaskPool pool(*this, nthreads);
+	std::vector<std::thread> threads;
+	for (int w = 1; w < nthreads; ++w)
+		threads.push_back(std::thread(&LauraTaskPool::work, &pool, w));
+	pool.work(0); //This thread is worker 0.
+	for (size_t k = 0; k < threads.size(); ++k)
+		threads[k].join();
+}
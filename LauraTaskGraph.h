@@ -0,0 +1,124 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef __LAURATASKGRAPH_H__
+#define __LAURATASKGRAPH_H__
+
+#include <opencv2/opencv.hpp>
+#include <deque>
+#include <vector>
+using cv::Mat;
+
+//Runs pipeline stages as a graph of band tasks.
+//Each stage is split into bands of rows. A band only waits for
+//the bands of its input stages that hold its rows plus the halo
+//its filter needs, so downstream bands start while upstream
+//stages are still running, and independent stages (gx and gy)
+//run side by side. Tasks run on a work-stealing thread pool.
+class LauraTaskGraph
+{
+	struct Task
+	{
+		void (*func) (int rowStart, int rowEnd, void* varargs);
+		void* varargs;
+		int rowStart;
+		int rowEnd;
+		std::vector<int> successors;
+		int ndeps;
+	};
+	struct Stage
+	{
+		std::vector<int> tasks;
+	};
+	//What the built-in stages operate on.
+	struct StageArgs
+	{
+		Mat* in1;
+		Mat* in2;
+		Mat* out1;
+		Mat* out2;
+		Mat filter;
+		Mat filter2; //The column of a separable filter.
+		int method; //For colour gradients.
+	};
+
+	std::vector<Task> tasks;
+	std::vector<Stage> stages;
+	std::deque<StageArgs> args; //Deque, so pointers stay valid.
+	int bandRows;
+
+	//Task functions for the built-in stages.
+	static void convolutionTask(int rowStart, int rowEnd,
+		void* varargs);
+	static void separableTask(int rowStart, int rowEnd,
+		void* varargs);
+	static void gradientTask(int rowStart, int rowEnd,
+		void* varargs);
+	static void nonmaximaTask(int rowStart, int rowEnd,
+		void* varargs);
+	static void colorGradientTask(int rowStart, int rowEnd,
+		void* varargs);
+
+	//The thread pool that carries out run().
+	friend class LauraTaskPool;
+public:
+	//Stages are cut into bands of bandRows rows.
+	//0 picks a size that gives each core several bands.
+	LauraTaskGraph(int bandRows);
+	~LauraTaskGraph();
+
+	//Adds a task that calls func(rowStart, rowEnd, varargs).
+	//Returns its id.
+	int addTask(void (*func) (int rowStart, int rowEnd, void* varargs),
+		void* varargs, int rowStart, int rowEnd);
+	//Task after may not start until task before has finished.
+	void addDependency(int before, int after);
+
+	//Adds a stage that calls func on bands covering rows
+	//0 to rows - 1. Each band waits for the bands of the stages
+	//in inputs holding its rows plus halo rows above and below.
+	//Returns the stage id.
+	int addStage(int rows,
+		void (*func) (int rowStart, int rowEnd, void* varargs),
+		void* varargs, const std::vector<int>& inputs, int halo);
+
+	/**** Built-in stages. Outputs must be allocated. ****/
+	//LauraConvolution::convolveBand of img into dst.
+	//input is the stage producing img, or -1 if it is ready.
+	int addConvolution(Mat& img, Mat& filter, Mat& dst, int input);
+	//LauraConvolution::convolveSeparableBand of img with ky * kx
+	//into dst.
+	int addSeparableConvolution(Mat& img, Mat& kx, Mat& ky, Mat& dst,
+		int input);
+	//LauraFilters::gradientMagAngle.
+	int addGradient(Mat& gx, Mat& gy, Mat& mag, Mat& angle,
+		int inputX, int inputY);
+	//LauraFilters::colorGradient of img.
+	int addColorGradient(Mat& img, Mat& mag, Mat& angle, int method,
+		int input);
+	//LauraFilters::nonmaximaSuppression3x3 with an angle image.
+	int addNonmaxima(Mat& mag, Mat& angle, Mat& dst, int input);
+
+	//Runs every task on nthreads workers (0: one per core).
+	//Returns when all of them have finished.
+	void run(int nthreads);
+};
+
+#endif //!defined __LAURATASKGRAPH_H__
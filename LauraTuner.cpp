@@ -0,0 +1,315 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "LauraTuner.h"
+#include "LauraConvolution.h"
+#include "LauraTaskGraph.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+
+//Times each candidate this many times and keeps the best.
+#define TUNING_RUNS 3
+
+LauraTuner::LauraTuner(bool tune, const char* path)
+	: tune(tune), maxThreads(0), cpu(cpuModel())
+{
+	if (path)
+		this->path = path;
+	else if (getenv("LAURA_TUNING_CACHE"))
+		this->path = getenv("LAURA_TUNING_CACHE");
+	else if (getenv("HOME"))
+		this->path = std::string(getenv("HOME")) + "/.laura_tuning";
+	else
+		this->path = ".laura_tuning";
+	load();
+}
+
+LauraTuner::~LauraTuner()
+{
+
+}
+
+void
+LauraTuner::setThreads(int nthreads)
+{
+	maxThreads = nthreads;
+}
+
+std::string
+LauraTuner::cpuModel()
+{
+	std::string model = "unknown";
+	FILE* f = fopen("/proc/cpuinfo", "r");
+	if (!f)
+		return model;
+
+	char line[512];
+	while (fgets(line, sizeof(line), f))
+	{
+		if (strncmp(line, "model name", 10))
+			continue;
+		char* value = strchr(line, ':');
+		if (!value)
+			continue;
+		value += strspn(value + 1, " \t") + 1;
+		value[strcspn(value, "\n")] = '\0';
+		model = value;
+		break;
+	}
+	fclose(f);
+	return model;
+}
+
+std::string
+LauraTuner::signature(Mat& img, Mat& filter, bool separable, bool box)
+{
+	//Round the image size up to powers of two, so that a stream
+	//of slightly different sizes shares one entry.
+	int rows = 1;
+	int cols = 1;
+	while (rows < img.rows) rows *= 2;
+	while (cols < img.cols) cols *= 2;
+
+	char sig[128];
+	snprintf(sig, sizeof(sig), "%dx%d %dx%d %s", rows, cols,
+		filter.rows, filter.cols,
+		box ? "box" : (separable ? "separable" : "general"));
+	return sig;
+}
+
+void
+LauraTuner::load()
+{
+	FILE* f = fopen(path.c_str(), "r");
+	if (!f)
+		return;
+
+	//Lines are: cpu model <tab> signature <tab> choice.
+	//Later lines win.
+	char line[1024];
+	while (fgets(line, sizeof(line), f))
+	{
+		char* sig = strchr(line, '\t');
+		if (!sig)
+			continue;
+		*sig++ = '\0';
+		char* rest = strchr(sig, '\t');
+		if (!rest)
+			continue;
+		*rest++ = '\0';
+		if (cpu != line)
+			continue;
+
+		Choice choice;
+		if (3 == sscanf(rest, "%d %d %d", &choice.strategy,
+			&choice.bandRows, &choice.threads))
+			choices[sig] = choice;
+	}
+	fclose(f);
+}
+
+void
+LauraTuner::save(const std::string& sig, const Choice& choice)
+{
+	//The file is rewritten with this entry replacing any earlier
+	//one for the CPU and signature; other machines' entries stay.
+	std::string lines;
+	FILE* f = fopen(path.c_str(), "r");
+	if (f)
+	{
+		std::string prefix = cpu + "\t" + sig + "\t";
+		char line[1024];
+		while (fgets(line, sizeof(line), f))
+		{
+			if (0 != strncmp(line, prefix.c_str(), prefix.size()))
+				lines += line;
+		}
+		fclose(f);
+	}
+	char entry[64];
+	snprintf(entry, sizeof(entry), "%d %d %d\n", choice.strategy,
+		choice.bandRows, choice.threads);
+	lines += cpu + "\t" + sig + "\t" + entry;
+
+	//Written aside and renamed over, so readers never see half a
+	//file.
+	char tmp[32];
+	snprintf(tmp, sizeof(tmp), ".%d.tmp", (int) getpid());
+	std::string tmpPath = path + tmp;
+	f = fopen(tmpPath.c_str(), "w");
+	if (!f)
+		return; //Tuning again next time is all we lose.
+	bool ok = (lines.size() == fwrite(lines.data(), 1, lines.size(), f));
+	ok = (0 == fclose(f)) && ok;
+	if (!ok || (0 != rename(tmpPath.c_str(), path.c_str())))
+		remove(tmpPath.c_str());
+}
+
+Mat
+LauraTuner::convolve(Mat& img, Mat& filter)
+{
+	Mat kx, ky;
+	Choice choice = choose(img, filter);
+	if ((SEPARABLE == choice.strategy) &&
+		!LauraConvolution::separate(filter, kx, ky))
+		choice.strategy = DIRECT; //Cannot happen, but be safe.
+	return apply(choice, img, filter, kx, ky);
+}
+
+LauraTuner::Choice
+LauraTuner::choose(Mat& img, Mat& filter)
+{
+	Mat kx, ky;
+	bool separable = LauraConvolution::separate(filter, kx, ky);
+	bool box = true;
+	Mat f;
+	filter.convertTo(f, CV_32F);
+	for (int i = 0; i < f.rows; ++i)
+	{
+		for (int j = 0; j < f.cols; ++j)
+		{
+			if (f.ptr<float>(i)[j] != f.ptr<float>(0)[0])
+				box = false;
+		}
+	}
+
+	std::string sig = signature(img, filter, separable, box);
+	std::map<std::string, Choice>::iterator it = choices.find(sig);
+	if (choices.end() != it)
+		return it->second;
+
+	Choice choice;
+	choice.strategy = DIRECT;
+	choice.bandRows = 0;
+	choice.threads = 0;
+	if (!tune)
+		return choice;
+
+	choice = benchmark(img, filter, kx, ky, separable, box);
+	choices[sig] = choice;
+	save(sig, choice);
+	return choice;
+}
+
+Mat
+LauraTuner::apply(const Choice& choice, Mat& img, Mat& filter,
+	Mat& kx, Mat& ky)
+{
+	switch (choice.strategy)
+	{
+	case SEPARABLE:
+		return LauraConvolution::convolveSeparable(img, kx, ky);
+	case FFT:
+		return LauraConvolution::convolveFFT(img, filter);
+	case BOX:
+	{
+		Mat f;
+		filter.convertTo(f, CV_32F);
+		return LauraConvolution::convolveBox(img, filter.cols,
+			filter.rows, f.ptr<float>(0)[0]);
+	}
+	default:
+	{
+		Mat ret(img.rows, img.cols, CV_32F);
+		LauraTaskGraph graph(choice.bandRows);
+		graph.addConvolution(img, filter, ret, -1);
+		int threads = choice.threads;
+		if ((0 < maxThreads) && ((0 >= threads) || (threads > maxThreads)))
+			threads = maxThreads;
+		graph.run(threads);
+		return ret;
+	}
+	}
+}
+
+LauraTuner::Choice
+LauraTuner::benchmark(Mat& img, Mat& filter, Mat& kx, Mat& ky,
+	bool separable, bool box)
+{
+	std::vector<Choice> candidates;
+	Choice c;
+	c.bandRows = 0;
+	c.threads = 0;
+
+	//Direct, over a few band sizes and thread counts.
+	int cores = (int) std::thread::hardware_concurrency();
+	if (1 > cores) cores = 1;
+	int threads[] = {1, (cores + 1)/2, cores};
+	int bands[] = {0, 32, 128};
+	c.strategy = DIRECT;
+	for (int t = 0; t < 3; ++t)
+	{
+		if ((0 < t) && (threads[t] == threads[t - 1]))
+			continue;
+		for (int b = 0; b < 3; ++b)
+		{
+			if ((1 == threads[t]) && (0 < b))
+				continue; //Bands do not matter on one thread.
+			if (bands[b] >= img.rows)
+				continue;
+			c.threads = threads[t];
+			c.bandRows = bands[b];
+			candidates.push_back(c);
+		}
+	}
+	c.bandRows = 0;
+	c.threads = 0;
+	if (separable)
+	{
+		c.strategy = SEPARABLE;
+		candidates.push_back(c);
+	}
+	if (box)
+	{
+		c.strategy = BOX;
+		candidates.push_back(c);
+	}
+	if (9 <= filter.rows*filter.cols)
+	{
+		c.strategy = FFT;
+		candidates.push_back(c);
+	}
+
+	Choice best = candidates[0];
+	double bestTime = -1.0;
+	for (size_t k = 0; k < candidates.size(); ++k)
+	{
+		double time = -1.0;
+		for (int r = 0; r < TUNING_RUNS; ++r)
+		{
+			int64 start = cv::getTickCount();
+			apply(candidates[k], img, filter, kx, ky);
+			double t = (cv::getTickCount() - start)/
+				cv::getTickFrequency();
+			if ((0 > time) || (t < time))
+				time = t;
+		}
+		if ((0 > bestTime) || (time < bestTime))
+		{
+			bestTime = time;
+			best = candidates[k];
+		}
+	}
+
+	return best;
+}
@@ -0,0 +1,91 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef __LAURATUNER_H__
+#define __LAURATUNER_H__
+
+#include <opencv2/opencv.hpp>
+#include <map>
+#include <string>
+using cv::Mat;
+
+//Picks the fastest way to run a convolution on this machine.
+//The first convolution of each signature (image size rounded up
+//to powers of two, filter size and whether the filter is
+//separable or a box) times every strategy that applies on the
+//actual image and remembers the winner. Winners are saved in a
+//tuning cache file keyed by CPU model, so each server generation
+//tunes once and keeps its own answers.
+//Not thread safe; use one tuner per thread.
+class LauraTuner
+{
+public:
+	enum Strategy
+	{
+		DIRECT,    //LauraConvolution::convolveBand on a task graph.
+		SEPARABLE, //LauraConvolution::convolveSeparable.
+		FFT,       //LauraConvolution::convolveFFT.
+		BOX        //LauraConvolution::convolveBox.
+	};
+	struct Choice
+	{
+		int strategy;
+		int bandRows; //For DIRECT: LauraTaskGraph band size.
+		int threads;  //For DIRECT: worker threads.
+	};
+private:
+	bool tune;
+	int maxThreads;
+	std::string path;
+	std::string cpu;
+	std::map<std::string, Choice> choices; //By signature.
+
+	std::string signature(Mat& img, Mat& filter, bool separable,
+		bool box);
+	//Runs one strategy. kx, ky are only used by SEPARABLE.
+	Mat apply(const Choice& choice, Mat& img, Mat& filter,
+		Mat& kx, Mat& ky);
+	//Times every candidate on img and returns the fastest.
+	Choice benchmark(Mat& img, Mat& filter, Mat& kx, Mat& ky,
+		bool separable, bool box);
+	void load();
+	void save(const std::string& sig, const Choice& choice);
+public:
+	//If tune is false, signatures not in the cache use DIRECT
+	//with the automatic band size instead of being timed.
+	//path is the cache file; NULL picks $LAURA_TUNING_CACHE,
+	//or else ~/.laura_tuning.
+	LauraTuner(bool tune, const char* path);
+	~LauraTuner();
+
+	//Same result as LauraConvolution::convolve(img, filter,
+	//CV_32F), up to float round-off, by the fastest strategy.
+	Mat convolve(Mat& img, Mat& filter);
+	//The strategy convolve would use, tuning if need be.
+	Choice choose(Mat& img, Mat& filter);
+	//At most nthreads threads for DIRECT, whatever was tuned
+	//(0, the default: no limit).
+	void setThreads(int nthreads);
+
+	//CPU model name, from /proc/cpuinfo.
+	static std::string cpuModel();
+};
+
+#endif //!defined __LAURATUNER_H__
@@ -0,0 +1,680 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "LauraValidate.h"
+#include "LauraBinary.h"
+#include "LauraConvolution.h"
+#include "LauraFilters.h"
+#include "LauraHalf.h"
+#include "LauraPipeline.h"
+#include "LauraShard.h"
+#include "LauraSparse.h"
+#include "LauraTaskGraph.h"
+#include "LauraTuner.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+//Extra units in the last place allowed for half storage: one
+//half ulp is 2^13 float ulps, and rounding costs up to half that.
+#define HALF_ULPS (1 << 13)
+//Error of convolveFFT, as a fraction of the result's range.
+#define FFT_ERROR 1e-4f
+//Images in the batch variant.
+#define BATCH_IMAGES 4
+
+namespace
+{
+//Stores each row of a stencil in the Mat pointed to by varargs.
+void
+storeFunc(float* row, int i, int cols, void* varargs)
+{
+	LauraHalf::storeRow(row, *(Mat*) varargs, i);
+}
+
+//Largest minus smallest value of a CV_32F image.
+float
+range(Mat& img)
+{
+	float lo = 0.0f;
+	float hi = 0.0f;
+	for (int i = 0; i < img.rows; ++i)
+	{
+		const float* p = img.ptr<float>(i);
+		for (int j = 0; j < img.cols; ++j)
+		{
+			if (((0 == i) && (0 == j)) || (p[j] < lo)) lo = p[j];
+			if (((0 == i) && (0 == j)) || (p[j] > hi)) hi = p[j];
+		}
+	}
+	return hi - lo;
+}
+}
+
+LauraValidate::LauraValidate(Tolerance tol, LauraShard* shard)
+	: tol(tol), shard(shard), refSeconds(0), left(0), right(0),
+	top(0), bottom(0), exact(false), thresh(0)
+{
+
+}
+
+LauraValidate::~LauraValidate()
+{
+
+}
+
+double
+LauraValidate::elapsed(int64 start)
+{
+	return (cv::getTickCount() - start)/cv::getTickFrequency();
+}
+
+long long
+LauraValidate::ulps(float a, float b)
+{
+	if ((a != a) || (b != b)) //NaN.
+		return ((a != a) && (b != b)) ? 0 : LLONG_MAX;
+
+	//Reorder the bit patterns so that consecutive floats are
+	//consecutive integers, negative ones included.
+	int32_t ia, ib;
+	memcpy(&ia, &a, sizeof(ia));
+	memcpy(&ib, &b, sizeof(ib));
+	long long ka = (0 > ia) ? (long long) INT32_MIN - ia : ia;
+	long long kb = (0 > ib) ? (long long) INT32_MIN - ib : ib;
+	return (ka > kb) ? ka - kb : kb - ka;
+}
+
+bool
+LauraValidate::within(float a, float b, long long slackUlps,
+	float slackAbs) const
+{
+	if (fabs((double) a - b) <= tol.abs + slackAbs)
+		return true;
+	return ulps(a, b) <= tol.ulps + slackUlps;
+}
+
+float
+LauraValidate::minFunc(Mat& inhood, Mat& filter, Range xidx,
+	Range yidx, void* varargs)
+{
+	float ret = inhood.at<float>(0, 0);
+	for (int i = 0; i < inhood.rows; ++i)
+	{
+		const float* p = inhood.ptr<float>(i);
+		for (int j = 0; j < inhood.cols; ++j)
+			if (p[j] < ret) ret = p[j];
+	}
+	return ret;
+}
+
+float
+LauraValidate::maxFunc(Mat& inhood, Mat& filter, Range xidx,
+	Range yidx, void* varargs)
+{
+	float ret = inhood.at<float>(0, 0);
+	for (int i = 0; i < inhood.rows; ++i)
+	{
+		const float* p = inhood.ptr<float>(i);
+		for (int j = 0; j < inhood.cols; ++j)
+			if (p[j] > ret) ret = p[j];
+	}
+	return ret;
+}
+
+float
+LauraValidate::rankFunc(Mat& inhood, Mat& filter, Range xidx,
+	Range yidx, void* varargs)
+{
+	int rank = *(int*) varargs;
+	std::vector<float> values;
+	for (int i = 0; i < inhood.rows; ++i)
+	{
+		const float* p = inhood.ptr<float>(i);
+		values.insert(values.end(), p, p + inhood.cols);
+	}
+	std::nth_element(values.begin(), values.begin() + rank,
+		values.end());
+	return values[rank];
+}
+
+void
+LauraValidate::begin(const std::string& name, Mat& ref, double seconds,
+	Mat& filter, bool exact)
+{
+	op = name;
+	this->ref = ref;
+	refSeconds = seconds;
+	this->exact = exact;
+	values = Mat();
+	thresh = 0;
+	//The pixels that read mirrored samples, as in
+	//convolutionEngine.
+	left = filter.cols/2;
+	right = filter.cols - left - 1;
+	top = filter.rows/2;
+	bottom = filter.rows - top - 1;
+}
+
+void
+LauraValidate::check(const std::string& variant, Mat out,
+	double seconds, long long slackUlps, float slackAbs)
+{
+	Result r;
+	r.op = op;
+	r.variant = variant;
+	r.exact = exact;
+	r.interiorFailures = 0;
+	r.borderFailures = 0;
+	r.interiorAbs = 0;
+	r.borderAbs = 0;
+	r.interiorUlps = 0;
+	r.borderUlps = 0;
+	r.seconds = seconds;
+	r.refSeconds = refSeconds;
+
+	if (!out.data || (out.rows != ref.rows) || (out.cols != ref.cols) ||
+		(1 != out.channels()))
+	{
+		r.interiorFailures = (long) ref.rows*ref.cols;
+		checks.push_back(r);
+		return;
+	}
+
+	Mat res = LauraHalf::toFloat(out);
+	for (int i = 0; i < ref.rows; ++i)
+	{
+		const float* a = ref.ptr<float>(i);
+		const float* b = res.ptr<float>(i);
+		bool edgeRow = (top > i) || (ref.rows - bottom <= i);
+		for (int j = 0; j < ref.cols; ++j)
+		{
+			bool ok;
+			if (!exact)
+				ok = within(a[j], b[j], slackUlps, slackAbs);
+			else if (values.data && (a[j] != b[j]))
+				//A thresholded value too close to call.
+				ok = within(values.ptr<float>(i)[j], thresh, 0, 0);
+			else
+				ok = (a[j] == b[j]) || ((a[j] != a[j]) && (b[j] != b[j]));
+
+			double d = fabs((double) a[j] - b[j]);
+			long long u = ulps(a[j], b[j]);
+			if (edgeRow || (left > j) || (ref.cols - right <= j))
+			{
+				if (!ok) r.borderFailures++;
+				if (d > r.borderAbs) r.borderAbs = d;
+				if (u > r.borderUlps) r.borderUlps = u;
+			}
+			else
+			{
+				if (!ok) r.interiorFailures++;
+				if (d > r.interiorAbs) r.interiorAbs = d;
+				if (u > r.interiorUlps) r.interiorUlps = u;
+			}
+		}
+	}
+	checks.push_back(r);
+}
+
+void
+LauraValidate::convolution(Mat& img, Mat& filter, const std::string& name)
+{
+	//One channel, so this is convolutionEngine with convFunc.
+	int64 start = cv::getTickCount();
+	Mat ref = LauraConvolution::convolve(img, filter);
+	begin(name, ref, elapsed(start), filter, false);
+
+	start = cv::getTickCount();
+	Mat out = LauraConvolution::convolve(img, filter, CV_32F);
+	check("stencilStream", out, elapsed(start), 0, 0);
+
+	start = cv::getTickCount();
+	out = LauraConvolution::convolve(img, filter, LauraHalf::TYPE);
+	check("half", out, elapsed(start), HALF_ULPS, 0);
+
+	start = cv::getTickCount();
+	out.create(img.rows, img.cols, CV_32F);
+	LauraTaskGraph graph(0);
+	graph.addConvolution(img, filter, out, -1);
+	graph.run(0);
+	check("task graph", out, elapsed(start), 0, 0);
+
+	start = cv::getTickCount();
+	LauraPipeline pipeline(img);
+	out = pipeline.convolve(filter).run();
+	check("pipeline", out, elapsed(start), 0, 0);
+
+	std::vector<Mat> imgs(BATCH_IMAGES, img);
+	start = cv::getTickCount();
+	std::vector<Mat> outs = LauraConvolution::convolve(imgs, filter);
+	check("batch", outs.back(), elapsed(start)/BATCH_IMAGES, 0, 0);
+
+	Mat kx, ky;
+	if (LauraConvolution::separate(filter, kx, ky))
+	{
+		start = cv::getTickCount();
+		out = LauraConvolution::convolveSeparable(img, kx, ky);
+		check("separable", out, elapsed(start), 0, 0);
+
+		start = cv::getTickCount();
+		out.create(img.rows, img.cols, CV_32F);
+		LauraTaskGraph sgraph(0);
+		sgraph.addSeparableConvolution(img, kx, ky, out, -1);
+		sgraph.run(0);
+		check("separable graph", out, elapsed(start), 0, 0);
+	}
+
+	Mat f;
+	filter.convertTo(f, CV_32F);
+	bool box = true;
+	for (int i = 0; i < f.rows; ++i)
+		for (int j = 0; j < f.cols; ++j)
+			box = box && (f.ptr<float>(i)[j] == f.ptr<float>(0)[0]);
+	if (box)
+	{
+		start = cv::getTickCount();
+		out = LauraConvolution::convolveBox(img, f.cols, f.rows,
+			f.ptr<float>(0)[0]);
+		check("box", out, elapsed(start), 0, 0);
+	}
+
+	float fftSlack = FFT_ERROR*range(ref);
+	start = cv::getTickCount();
+	out = LauraConvolution::convolveFFT(img, filter);
+	check("FFT", out, elapsed(start), 0, fftSlack);
+
+	//Only reads the tuning cache, so validating tunes nothing.
+	LauraTuner tuner(false, NULL);
+	LauraTuner::Choice choice = tuner.choose(img, filter);
+	const char* strategies[] = {"direct", "separable", "FFT", "box"};
+	start = cv::getTickCount();
+	out = tuner.convolve(img, filter);
+	check(std::string("tuner (") + strategies[choice.strategy] + ")",
+		out, elapsed(start), 0,
+		(LauraTuner::FFT == choice.strategy) ? fftSlack : 0);
+
+	if (shard)
+	{
+		Mat simg = shard->share(img);
+		start = cv::getTickCount();
+		out = shard->convolve(simg, filter);
+		check("shard", out, elapsed(start), 0, 0);
+		if (out.data)
+			shard->release(out);
+		shard->release(simg);
+	}
+}
+
+void
+LauraValidate::hitAndMiss(Mat& img, Mat& filter, const std::string& name)
+{
+	int64 start = cv::getTickCount();
+	Mat ref = LauraConvolution::hitAndMiss(img, filter);
+	begin(name, ref, elapsed(start), filter, true);
+
+	start = cv::getTickCount();
+	Mat out(img.rows, img.cols, CV_32F);
+	LauraConvolution::stencilStream(img, filter, 0, img.rows,
+		LauraConvolution::hitAndMissRow, NULL, storeFunc, (void*) &out);
+	check("stencilStream", out, elapsed(start), 0, 0);
+
+	start = cv::getTickCount();
+	LauraPipeline pipeline(img);
+	out = pipeline.hitAndMiss(filter).run();
+	check("pipeline", out, elapsed(start), 0, 0);
+
+	if ((3 == filter.rows) && (3 == filter.cols))
+	{
+		start = cv::getTickCount();
+		out = LauraBinary::hitAndMiss(img, filter);
+		check("LUT", out, elapsed(start), 0, 0);
+
+		start = cv::getTickCount();
+		out = LauraSparse::hitAndMiss(img, filter);
+		check("sparse", out, elapsed(start), 0, 0);
+	}
+}
+
+void
+LauraValidate::morphology(Mat& img, int width, int height)
+{
+	Mat filter = Mat::ones(height, width, CV_32F);
+	char size[32];
+	snprintf(size, sizeof(size), " %dx%d", width, height);
+
+	for (int d = 0; d < 2; ++d)
+	{
+		bool dilate = (1 == d);
+		int64 start = cv::getTickCount();
+		Mat ref = LauraConvolution::convolutionEngine(img, filter, NULL,
+			dilate ? maxFunc : minFunc);
+		begin(std::string(dilate ? "dilate" : "erode") + size, ref,
+			elapsed(start), filter, true);
+
+		start = cv::getTickCount();
+		Mat out = dilate ? LauraConvolution::dilate(img, width, height) :
+			LauraConvolution::erode(img, width, height);
+		check("van Herk", out, elapsed(start), 0, 0);
+
+		if ((1 == height) || (1 == width))
+		{
+			int length = (1 == height) ? width : height;
+			int direction = (1 == height) ?
+				LauraConvolution::LINE_HORIZONTAL :
+				LauraConvolution::LINE_VERTICAL;
+			start = cv::getTickCount();
+			out = dilate ?
+				LauraConvolution::dilateLine(img, length, direction) :
+				LauraConvolution::erodeLine(img, length, direction);
+			check("line", out, elapsed(start), 0, 0);
+		}
+		if (dilate && (width == height))
+		{
+			start = cv::getTickCount();
+			out = LauraConvolution::maxFilter(img, width);
+			check("maxFilter", out, elapsed(start), 0, 0);
+		}
+	}
+}
+
+void
+LauraValidate::rankFilter(Mat& img, int size, int rank)
+{
+	//Integers, so the CV_8U path sees the same image.
+	Mat bytes, ints;
+	img.convertTo(bytes, CV_8U);
+	bytes.convertTo(ints, CV_32F);
+	Mat filter = Mat::ones(size, size, CV_32F);
+	char name[32];
+	if (size*size/2 == rank)
+		snprintf(name, sizeof(name), "median %dx%d", size, size);
+	else
+		snprintf(name, sizeof(name), "rank %d of %dx%d", rank, size, size);
+
+	int64 start = cv::getTickCount();
+	Mat ref = LauraConvolution::convolutionEngine(ints, filter,
+		(void*) &rank, rankFunc);
+	begin(name, ref, elapsed(start), filter, true);
+
+	start = cv::getTickCount();
+	Mat out = LauraFilters::rankFilter(ints, size, rank);
+	check((5 >= size) ? "network" : "sort", out, elapsed(start), 0, 0);
+
+	start = cv::getTickCount();
+	out = LauraFilters::rankFilter(bytes, size, rank);
+	double seconds = elapsed(start);
+	out.convertTo(out, CV_32F);
+	check("histogram", out, seconds, 0, 0);
+}
+
+void
+LauraValidate::threshold(Mat& img, Mat& filter, float thresh,
+	const std::string& name)
+{
+	int64 start = cv::getTickCount();
+	Mat filtered = LauraConvolution::convolve(img, filter);
+	Mat ref = LauraFilters::threshold(filtered, thresh);
+	begin(name, ref, elapsed(start), filter, true);
+	values = filtered;
+	this->thresh = thresh;
+
+	start = cv::getTickCount();
+	Mat out = LauraConvolution::convolve(img, filter, CV_32F);
+	out = LauraFilters::threshold(out, thresh);
+	check("stencilStream", out, elapsed(start), 0, 0);
+
+	start = cv::getTickCount();
+	LauraPipeline pipeline(img);
+	out = pipeline.convolve(filter).threshold(thresh).run();
+	check("pipeline", out, elapsed(start), 0, 0);
+}
+
+void
+LauraValidate::gradient(Mat& img)
+{
+	Mat gx = LauraFilters::gx3x3();
+	Mat gy = LauraFilters::gy3x3();
+
+	int64 start = cv::getTickCount();
+	Mat dx = LauraConvolution::convolve(img, gx);
+	Mat dy = LauraConvolution::convolve(img, gy);
+	Mat ref(img.rows, img.cols, CV_32F);
+	for (int i = 0; i < img.rows; ++i)
+	{
+		const float* x = dx.ptr<float>(i);
+		const float* y = dy.ptr<float>(i);
+		float* m = ref.ptr<float>(i);
+		for (int j = 0; j < img.cols; ++j)
+			m[j] = sqrt(x[j]*x[j] + y[j]*y[j]);
+	}
+	begin("gradient magnitude", ref, elapsed(start), gx, false);
+
+	Mat mag, angle;
+	start = cv::getTickCount();
+	dx = LauraConvolution::convolve(img, gx, CV_32F);
+	dy = LauraConvolution::convolve(img, gy, CV_32F);
+	LauraFilters::gradientMagAngle(dx, dy, mag, angle);
+	check("stencilStream", mag, elapsed(start), 0, 0);
+
+	start = cv::getTickCount();
+	dx = LauraConvolution::convolve(img, gx, LauraHalf::TYPE);
+	dy = LauraConvolution::convolve(img, gy, LauraHalf::TYPE);
+	mag = Mat();
+	angle = Mat();
+	LauraFilters::gradientMagAngle(dx, dy, mag, angle);
+	check("half", mag, elapsed(start), 2*HALF_ULPS, 0);
+
+	start = cv::getTickCount();
+	mag = Mat();
+	angle = Mat();
+	LauraFilters::colorGradient(img, mag, angle,
+		LauraFilters::COLOR_MAX_CHANNEL);
+	check("colorGradient", mag, elapsed(start), 0, 0);
+
+	start = cv::getTickCount();
+	dx.create(img.rows, img.cols, CV_32F);
+	dy.create(img.rows, img.cols, CV_32F);
+	mag.create(img.rows, img.cols, CV_32F);
+	angle.create(img.rows, img.cols, CV_32F);
+	LauraTaskGraph graph(0);
+	int sx = graph.addConvolution(img, gx, dx, -1);
+	int sy = graph.addConvolution(img, gy, dy, -1);
+	graph.addGradient(dx, dy, mag, angle, sx, sy);
+	graph.run(0);
+	check("task graph", mag, elapsed(start), 0, 0);
+
+	if (shard)
+	{
+		Mat simg = shard->share(img);
+		start = cv::getTickCount();
+		Mat sdx = shard->convolve(simg, gx);
+		Mat sdy = shard->convolve(simg, gy);
+		Mat smag, sangle;
+		shard->gradientMagAngle(sdx, sdy, smag, sangle);
+		check("shard", smag, elapsed(start), 0, 0);
+		Mat* segments[] = {&simg, &sdx, &sdy, &smag, &sangle};
+		for (int k = 0; k < 5; ++k)
+			if (segments[k]->data)
+				shard->release(*segments[k]);
+	}
+}
+
+void
+LauraValidate::sparse(Mat& img)
+{
+	Mat gx = LauraFilters::gx3x3();
+	Mat gy = LauraFilters::gy3x3();
+	Mat dx = LauraConvolution::convolve(img, gx, CV_32F);
+	Mat dy = LauraConvolution::convolve(img, gy, CV_32F);
+	Mat mag, angle;
+	LauraFilters::gradientMagAngle(dx, dy, mag, angle);
+	//Only gradients over mean + 2 std. dev. are kept.
+	cv::Scalar mean, stddev;
+	cv::meanStdDev(mag, mean, stddev);
+	float cut = (float) (mean[0] + 2*stddev[0]);
+	for (int i = 0; i < mag.rows; ++i)
+	{
+		float* m = mag.ptr<float>(i);
+		for (int j = 0; j < mag.cols; ++j)
+			if (cut >= m[j])
+				m[j] = 0.0f;
+	}
+	Mat window = Mat::ones(3, 3, CV_32F);
+
+	int64 start = cv::getTickCount();
+	Mat ref = LauraFilters::nonmaximaSuppression3x3(mag, angle);
+	begin("nonmaxima", ref, elapsed(start), window, true);
+	start = cv::getTickCount();
+	Mat out = LauraSparse::nonmaximaSuppression3x3(mag, angle);
+	check("sparse", out, elapsed(start), 0, 0);
+
+	start = cv::getTickCount();
+	ref = LauraFilters::nonmaximaSuppression3x3(mag);
+	begin("nonmaxima blobs", ref, elapsed(start), window, true);
+	start = cv::getTickCount();
+	out = LauraSparse::nonmaximaSuppression3x3(mag);
+	check("sparse", out, elapsed(start), 0, 0);
+
+	Mat thinned = LauraFilters::nonmaximaSuppression3x3(mag, angle);
+	start = cv::getTickCount();
+	ref = LauraFilters::hysteresisThresholding(thinned, cut, 2*cut);
+	begin("hysteresis", ref, elapsed(start), window, true);
+	start = cv::getTickCount();
+	out = LauraSparse::hysteresisThresholding(thinned, cut, 2*cut);
+	check("sparse", out, elapsed(start), 0, 0);
+
+	//Chain following, as Canny does with or without shards.
+	start = cv::getTickCount();
+	ref = LauraSparse::followEdges(thinned, cut, 2*cut);
+	begin("hysteresis chains", ref, elapsed(start), window, true);
+	if (shard)
+	{
+		start = cv::getTickCount();
+		out = shard->hysteresisThresholding(thinned, cut, 2*cut);
+		check("shard", out, elapsed(start), 0, 0);
+		if (out.data)
+			shard->release(out);
+	}
+}
+
+void
+LauraValidate::run(Mat& img)
+{
+	//The apps' filters, a box and one that is not separable.
+	Mat box = Mat::ones(7, 7, CV_32F)/49.0f;
+	Mat gaussian = LauraFilters::gaussian(7, 7, 1.0f);
+	Mat gx = LauraFilters::gx3x3();
+	Mat general(5, 5, CV_32F);
+	for (int i = 0; i < 5; ++i)
+		for (int j = 0; j < 5; ++j)
+			general.ptr<float>(i)[j] = (float) ((7*i + 3*j*j) % 5 - 2);
+	struct { Mat filter; const char* name; } filters[] = {
+		{gaussian, "gaussian 7x7"},
+		{LauraFilters::gaussian(15, 15, 3.0f), "gaussian 15x15"},
+		{LauraFilters::LoG(9, 1.4f), "LoG 9x9"},
+		{LauraFilters::laplacian(), "laplacian"},
+		{gx, "gx3x3"},
+		{LauraFilters::compose(gaussian, gx), "gaussian 7x7 * gx3x3"},
+		{box, "box 7x7"},
+		{general, "general 5x5"}
+	};
+	for (size_t k = 0; k < sizeof(filters)/sizeof(filters[0]); ++k)
+		convolution(img, filters[k].filter, filters[k].name);
+
+	Mat lap = LauraFilters::laplacian();
+	threshold(img, lap, 20.0f, "laplacian > 20");
+
+	//Hit and miss on a binary image: isolated pixels, as
+	//removeSP finds them, and a corner with blanks (2).
+	Mat bin = LauraFilters::threshold(img, 127.0f)/255.0f;
+	Mat isolated = Mat::zeros(3, 3, CV_32F);
+	isolated.at<float>(1, 1) = 1.0f;
+	Mat corner = (cv::Mat_<float>(3, 3) <<
+		2, 1, 2,
+		0, 1, 1,
+		0, 0, 2);
+	hitAndMiss(bin, isolated, "hitAndMiss isolated");
+	hitAndMiss(bin, corner, "hitAndMiss corner");
+
+	morphology(img, 5, 5);
+	morphology(img, 9, 1);
+	morphology(img, 1, 9);
+
+	rankFilter(img, 3, 4);
+	rankFilter(img, 5, 12);
+	rankFilter(img, 5, 3);
+	rankFilter(img, 9, 40);
+
+	gradient(img);
+	sparse(img);
+}
+
+const std::vector<LauraValidate::Result>&
+LauraValidate::results() const
+{
+	return checks;
+}
+
+bool
+LauraValidate::passed(const Result& r)
+{
+	return (0 == r.interiorFailures) && (0 == r.borderFailures);
+}
+
+bool
+LauraValidate::passed() const
+{
+	for (size_t k = 0; k < checks.size(); ++k)
+		if (!passed(checks[k]))
+			return false;
+	return true;
+}
+
+void
+LauraValidate::report(std::ostream& out) const
+{
+	char line[256];
+	snprintf(line, sizeof(line), "%-22s %-18s %-4s %10s %8s %10s %8s %8s %8s",
+		"operation", "variant", "", "max abs", "ulps", "border", "ulps",
+		"failed", "speedup");
+	out << line << std::endl;
+
+	int npassed = 0;
+	for (size_t k = 0; k < checks.size(); ++k)
+	{
+		const Result& r = checks[k];
+		if (passed(r))
+			npassed++;
+		double speedup = (0 < r.seconds) ? r.refSeconds/r.seconds : 0;
+		snprintf(line, sizeof(line),
+			"%-22s %-18s %-4s %10.3g %8lld %10.3g %8lld %8ld %7.1fx",
+			r.op.c_str(), r.variant.c_str(), passed(r) ? "ok" : "FAIL",
+			r.interiorAbs, r.interiorUlps, r.borderAbs, r.borderUlps,
+			r.interiorFailures + r.borderFailures, speedup);
+		out << line << std::endl;
+	}
+	out << npassed << " of " << checks.size() << " checks passed"
+		<< " (tolerance " << tol.ulps << " ulps or " << tol.abs
+		<< "; masks, min/max and rank exact)" << std::endl;
+}
@@ -0,0 +1,159 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#ifndef __LAURAVALIDATE_H__
+#define __LAURAVALIDATE_H__
+
+#include <opencv2/opencv.hpp>
+#include <ostream>
+#include <string>
+#include <vector>
+using cv::Mat;
+using cv::Range;
+
+class LauraShard;
+
+//Differential validation of the fast paths.
+//Each operation runs once through the scalar
+//LauraConvolution::convolutionEngine, the reference, and then
+//through every fast variant that computes the same thing
+//(stencilStream, task graph, pipeline, batch, half storage,
+//separable, box, FFT, tuner and, if given a shard, worker
+//processes). Every output is compared pixel by pixel with the
+//reference and timed against it.
+//Sums (convolutions, gradients) pass within a tolerance. Binary
+//masks, min/max and rank filters must match exactly. Pixels within the
+//filter's reach of an edge, which read mirrored samples, are
+//checked and reported apart from the interior, so a padding bug
+//shows up on its own.
+//
+//	LauraValidate v(tol, NULL);
+//	v.run(img);
+//	v.report(std::cout);
+class LauraValidate
+{
+public:
+	//A value passes if it is within abs of the reference or
+	//within ulps units in the last place (as floats).
+	struct Tolerance
+	{
+		int ulps;
+		float abs;
+	};
+	//One variant of one operation.
+	struct Result
+	{
+		std::string op;      //What was computed.
+		std::string variant; //Which path computed it.
+		bool exact;          //Whether it had to match exactly.
+		long interiorFailures;
+		long borderFailures;
+		double interiorAbs;  //Largest differences found.
+		double borderAbs;
+		long long interiorUlps;
+		long long borderUlps;
+		double seconds;      //Time of the variant...
+		double refSeconds;   //...and of the reference.
+	};
+private:
+	Tolerance tol;
+	LauraShard* shard;
+	std::vector<Result> checks;
+
+	//The operation being checked.
+	std::string op;
+	Mat ref;
+	double refSeconds;
+	int left, right, top, bottom; //Border widths.
+	bool exact;
+	//For thresholded masks: the values before the threshold.
+	//Pixels whose value is within tolerance of thresh may
+	//come out either way.
+	Mat values;
+	float thresh;
+
+	//Starts checking op name, whose reference result ref took
+	//seconds. The border is what filter reads past the edges.
+	void begin(const std::string& name, Mat& ref, double seconds,
+		Mat& filter, bool exact);
+	//Compares out (CV_32F or half) with the reference and
+	//records it. Sums may also be off by slackUlps and slackAbs
+	//beyond the tolerance, for variants that round more.
+	void check(const std::string& variant, Mat out, double seconds,
+		long long slackUlps, float slackAbs);
+	//Whether a and b agree within tol, widened by the slack.
+	bool within(float a, float b, long long slackUlps,
+		float slackAbs) const;
+
+	//Functions for the engine: min and max over the filter's
+	//window, for the morphology.
+	static float minFunc(Mat& inhood, Mat& filter, Range xidx,
+		Range yidx, void* varargs);
+	static float maxFunc(Mat& inhood, Mat& filter, Range xidx,
+		Range yidx, void* varargs);
+	//Value of rank *(int*) varargs in the window, for the rank
+	//filters.
+	static float rankFunc(Mat& inhood, Mat& filter, Range xidx,
+		Range yidx, void* varargs);
+	//Seconds since start (from cv::getTickCount).
+	static double elapsed(int64 start);
+public:
+	//shard, if not NULL, adds the multi-process variants.
+	LauraValidate(Tolerance tol, LauraShard* shard);
+	~LauraValidate();
+
+	/**** Operations ****/
+	//img is CV_32F with one channel.
+	//Convolution with filter (at least 3 wide or tall; the
+	//engine swaps smaller filters for a mean filter).
+	void convolution(Mat& img, Mat& filter, const std::string& name);
+	//Hit and miss of the binary (0 and 1) image img.
+	void hitAndMiss(Mat& img, Mat& filter, const std::string& name);
+	//Erosion and dilation by a width x height rectangle.
+	void morphology(Mat& img, int width, int height);
+	//Value of rank rank in each size x size neighborhood, of img
+	//rounded to integers, as CV_32F and as CV_8U.
+	void rankFilter(Mat& img, int size, int rank);
+	//LauraFilters::threshold of the convolution with filter.
+	void threshold(Mat& img, Mat& filter, float thresh,
+		const std::string& name);
+	//Sobel gradient magnitude.
+	void gradient(Mat& img);
+	//Nonmaxima suppression and hysteresis, as Canny and Harris
+	//use them, on the strongest gradients of img only, so that
+	//most of the image is empty.
+	void sparse(Mat& img);
+	//All of the above, with the filters the apps use.
+	void run(Mat& img);
+
+	/**** Results ****/
+	const std::vector<Result>& results() const;
+	//Whether every check so far passed.
+	bool passed() const;
+	static bool passed(const Result& r);
+	//One line per check: errors, failures and speedup.
+	void report(std::ostream& out) const;
+
+	//Distance between a and b in units in the last place:
+	//the number of floats between them.
+	static long long ulps(float a, float b);
+};
+
+#endif //!defined __LAURAVALIDATE_H__
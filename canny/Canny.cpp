@@ -19,10 +19,22 @@
 //SOFTWARE.
 
 #include <opencv2/opencv.hpp>
+#include <cstdlib>
 #include <string>
 #include <iostream>
+#include <memory>
+#include "../LauraBinary.h"
 #include "../LauraConvolution.h"
+#include "../LauraCounters.h"
 #include "../LauraFilters.h"
+#include "../LauraHalf.h"
+#include "../LauraIngest.h"
+#include "../LauraJobs.h"
+#include "../LauraMemory.h"
+#include "../LauraRaw.h"
+#include "../LauraShard.h"
+#include "../LauraSparse.h"
+#include "../LauraTaskGraph.h"
 
 using cv::Mat;
 using cv::namedWindow;
@@ -34,58 +46,202 @@ using std::cout;
 using std::endl;
 using std::string;
 
+void toDisplay(int rowStart, int rowEnd, void* varargs);
+
 int
 main(int argc, char** argv) {
 	//Read image from command line.
 	string fname;
-	if (argc != 2) { //user did something wrong, correct them and exit
-		cout << "Format: ./Canny [filename]." << endl;
-		return 0;
+	//--half stores the intermediate images in half precision.
+	bool half = false;
+	//--color finds the edges of all colour channels at once.
+	bool color = false;
+	//--thin thins the edges to one pixel wide lines.
+	bool thin = false;
+	//--scale n (2, 4 or 8) works at 1/n of the image size.
+	int scale = 1;
+	//--shards n runs the stages in n worker processes, for
+	//images too big for one.
+	int shards = 0;
+	//--budget ms picks the kernel and working size that are
+	//expected to finish in ms (gray only, no shards).
+	float budget = 0;
+	//An optional .lraw file receives the result.
+	string outname;
+	bool ok = (argc >= 2);
+	for (int a = 2; a < argc; ++a)
+	{
+		if (string(argv[a]) == "--half")
+			half = true;
+		else if (string(argv[a]) == "--color")
+			color = true;
+		else if (string(argv[a]) == "--thin")
+			thin = true;
+		else if ((string(argv[a]) == "--shards") && (a + 1 < argc))
+			shards = atoi(argv[++a]);
+		else if ((string(argv[a]) == "--budget") && (a + 1 < argc))
+		{
+			budget = (float) atof(argv[++a]);
+			ok = ok && (0 < budget);
+		}
+		else if ((string(argv[a]) == "--scale") && (a + 1 < argc))
+		{
+			scale = atoi(argv[++a]);
+			ok = ok && LauraIngest::isScale(scale);
+		}
+		else if (LauraRaw::isRaw(argv[a]))
+			outname = argv[a];
+		else
+			ok = false;
 	}
-	else {
-		fname = argv[1]; //grab filename
+	ok = ok && !((0 < budget) && (color || (0 < shards)));
+	if (!ok) { //user did something wrong, correct them and exit
+		cout << "Format: ./Canny [filename] [--half] [--color] [--thin] [--scale n] [--shards n] [--budget ms] [output.lraw]." << endl;
+		return 0;
 	}
-	Mat img = imread(fname);
+	//$LAURA_MEMORY_REPORT prints the memory each stage held.
+	LauraMemory::reportAtExit();
+	//$LAURA_COUNTERS prints the hardware counters of each stage.
+	LauraCounters::reportAtExit();
+	//The workers are forked, so start them before any threads.
+	//They stop, and their segments go, however main returns.
+	std::unique_ptr<LauraShard> shard;
+	if (0 < shards)
+		shard.reset(new LauraShard(shards));
+	fname = argv[1]; //grab filename
+	//Raw (.lraw) images are mapped straight in, no decode;
+	//others are decoded straight to gray (unless --color) at the
+	//working size.
+	LauraIngest ingest(scale, CV_32F);
+	Mat img = color ? ingest.loadColor(fname) : ingest.loadGray(fname);
 	if (!img.data) return -1; //Snippet from opencv 2.1 doc intro to make sure it loaded properly.
 
-	//Convert to grayscale
-	cv::cvtColor(img, img, CV_RGB2GRAY);
-	//Convert to float
-	img.convertTo(img, CV_32F);
+	//In budget mode the server's pipeline runs instead, timed
+	//once in its cheapest configuration to have costs to go on.
+	if (0 < budget)
+	{
+		LauraJobs::Workspace ws;
+		LauraJobs::Params params;
+		params["half"] = half;
+		params["thin"] = thin;
+		params["budget"] = budget;
+		LauraJobs::calibrate("canny", img, ws);
+		Mat edges = LauraJobs::run("canny", img, params, ws);
+		cout << ws.budget().report() << endl;
+		if (!outname.empty())
+			LauraRaw::save(outname, edges);
+		edges.convertTo(edges, CV_8U);
+		namedWindow("threshed", CV_WINDOW_AUTOSIZE);
+		imshow("threshed", edges);
+		waitKey(0);
+		return 0;
+	}
 
-	//Gaussian filter.
-	Mat gfilt = LauraFilters::gaussian(7, 7, 1.0f);
-	Mat img2 = LauraConvolution::convolve(
-		img, gfilt);
+	//Storage type for the intermediate images.
+	int itype = half ? LauraHalf::TYPE : CV_32F;
 
-	//Gradient images.
+	//Filters.
+	Mat gfilt = LauraFilters::gaussian(7, 7, 1.0f);
 	Mat dxfilt = LauraFilters::gx3x3();
 	Mat dyfilt = LauraFilters::gy3x3();
-	Mat dximg = LauraConvolution::convolve(
-		img2, dxfilt);
-	Mat dyimg = LauraConvolution::convolve(
-		img2, dyfilt);
-	
-	//Compute magnitude image.
-	Mat mag;
-	cv::magnitude(dximg, dyimg, mag);
-	//Compute angle image.
-	Mat angimg;
-	cv::phase(dximg, dyimg, angimg, true);
-
-	//Carry out nonmaxima suppression.
-	Mat thinned = LauraFilters::
-		nonmaximaSuppression3x3(mag, angimg);
+
+	//Intermediate images, charged to the stages that make them.
+	//With shards the workers make them in their segments instead.
+	int rows = img.rows;
+	int cols = img.cols;
+	Mat img2, dximg, dyimg, mag, angimg, thinned;
+	if (!shard)
+	{
+		//Gray images go straight to the gradients (see below),
+		//with no smoothed image.
+		if (color)
+		{
+			LauraMemory::Stage stage("smooth");
+			img2 = LauraMemory::create(rows, cols,
+				CV_MAKETYPE(CV_32F, img.channels()));
+		}
+		{
+			LauraMemory::Stage stage("gradient");
+			dximg = LauraMemory::create(rows, cols, itype);
+			dyimg = LauraMemory::create(rows, cols, itype);
+			mag = LauraMemory::create(rows, cols, itype);
+			angimg = LauraMemory::create(rows, cols, itype);
+		}
+		{
+			LauraMemory::Stage stage("nonmaxima");
+			thinned = LauraMemory::create(rows, cols, itype);
+		}
+	}
+
+	//Gaussian filter, gradient images, magnitude and angle
+	//images, and nonmaxima suppression as one task graph.
+	//The gradients run side by side and every stage starts
+	//on the bands whose inputs are ready.
+	if (shard)
+	{
+		LauraCounters::Stage counters("smooth to nonmaxima",
+			(double) img.total());
+		//The same stages, each split between the workers.
+		//In colour the gradients keep all the channels and
+		//gradientMagAngle combines them (Di Zenzo).
+		int ctype = color ? CV_32F : itype;
+		img2 = shard->convolve(img, gfilt, ctype);
+		dximg = shard->convolve(img2, dxfilt, ctype);
+		dyimg = shard->convolve(img2, dyfilt, ctype);
+		shard->gradientMagAngle(dximg, dyimg, mag, angimg);
+		thinned = shard->nonmaximaSuppression3x3(mag, angimg);
+		if (!thinned.data) return -1;
+	}
+	else
+	{
+		LauraCounters::Stage counters("smooth to nonmaxima",
+			(double) img.total());
+		LauraTaskGraph graph(0);
+		int mstage;
+		if (color)
+		{
+			//In colour, all the channels are smoothed in one pass
+			//and the gradient comes straight from them (Di Zenzo).
+			int gstage = graph.addConvolution(img, gfilt, img2, -1);
+			mstage = graph.addColorGradient(img2, mag, angimg,
+				LauraFilters::COLOR_DI_ZENZO, gstage);
+		}
+		else
+		{
+			//The Gaussian and Sobel filters composed, so each
+			//gradient is one separable pass over img.
+			Mat kxdx, kydx, kxdy, kydy;
+			LauraFilters::compose(gfilt, dxfilt, kxdx, kydx);
+			LauraFilters::compose(gfilt, dyfilt, kxdy, kydy);
+			int xstage = graph.addSeparableConvolution(img, kxdx, kydx,
+				dximg, -1);
+			int ystage = graph.addSeparableConvolution(img, kxdy, kydy,
+				dyimg, -1);
+			mstage = graph.addGradient(dximg, dyimg, mag, angimg,
+				xstage, ystage);
+		}
+		graph.addNonmaxima(mag, angimg, thinned, mstage);
+		graph.run(0);
+	}
+
 	//Make sure values are clamped to 
 	//between 0 and 255.
+	thinned = LauraHalf::toFloat(thinned);
 	thinned.convertTo(thinned, CV_8U);
 	thinned.convertTo(thinned, CV_32F);
 
 	//Hysteresis thresholding.
 	//Auto-compute the threshold.
 	float tmean, tstd;
-	LauraFilters::correctedMeanStdDev(
-		thinned, &tmean, &tstd);
+	if (shard)
+	{
+		//Counted per shard and merged.
+		thinned = shard->share(thinned);
+		shard->correctedMeanStdDev(thinned, &tmean, &tstd);
+	}
+	else
+		LauraFilters::correctedMeanStdDev(
+			thinned, &tmean, &tstd);
 	float kl = 1.5f;
 	float ku = 0.7f;
 	float lthresh = tmean - (kl*tstd);
@@ -96,28 +252,46 @@ main(int argc, char** argv) {
 	cout << "std = " << tstd << endl;
 	cout << "lthresh = " << lthresh << endl;
 	cout << "uthresh = " << uthresh << endl;
-	Mat lthreshed = LauraFilters::threshold(
-		thinned, lthresh);
-	Mat uthreshed = LauraFilters::threshold(
-		thinned, uthresh);
-	Mat threshed = LauraFilters::hysteresisThresholding(
-		thinned, lthresh, uthresh);
+	Mat lthreshed, uthreshed, threshed;
+	{
+		LauraMemory::Stage stage("hysteresis");
+		LauraCounters::Stage counters("hysteresis", (double) img.total());
+		lthreshed = LauraFilters::threshold(thinned, lthresh);
+		uthreshed = LauraFilters::threshold(thinned, uthresh);
+		//Whole chains are followed, across the shard boundaries
+		//with shards, so both ways give the same edges.
+		threshed = shard ?
+			shard->hysteresisThresholding(thinned, lthresh, uthresh) :
+			LauraSparse::followEdges(thinned, lthresh, uthresh);
+	}
+	if (thin)
+	{
+		LauraMemory::Stage stage("thinning");
+		LauraCounters::Stage counters("thinning", (double) img.total());
+		threshed = LauraBinary::thin(threshed);
+	}
 	
+	//Write the result out, if asked.
+	if (!outname.empty())
+		LauraRaw::save(outname, threshed);
+
 	//Convert back to uchar for display.
-	img.convertTo(img, CV_8U);
-	img2.convertTo(img2, CV_8U);
-	mag.convertTo(mag, CV_8U);
-	angimg.convertTo(angimg, CV_8U);
-	thinned.convertTo(thinned, CV_8U);
-	lthreshed.convertTo(lthreshed, CV_8U);
-	uthreshed.convertTo(uthreshed, CV_8U);
-	threshed.convertTo(threshed, CV_8U);
+	//The conversions are independent of each other.
+	Mat* display[] = {&img, &img2, &mag, &angimg, &thinned,
+		&lthreshed, &uthreshed, &threshed};
+	LauraTaskGraph convert(0);
+	for (int k = 0; k < 8; ++k)
+		convert.addTask(toDisplay, (void*) display[k], 0, 0);
+	convert.run(0);
 
 	//Show image
 	namedWindow(fname, CV_WINDOW_AUTOSIZE);
 	imshow(fname, img);
-	namedWindow("img2", CV_WINDOW_AUTOSIZE);
-	imshow("img2", img2);
+	if (img2.data)
+	{
+		namedWindow("img2", CV_WINDOW_AUTOSIZE);
+		imshow("img2", img2);
+	}
 	namedWindow("mag", CV_WINDOW_AUTOSIZE);
 	imshow("mag", mag);
 	namedWindow("angimg", CV_WINDOW_AUTOSIZE);
@@ -134,3 +308,11 @@ main(int argc, char** argv) {
 
 	return 0;
 }
+
+//Task that converts the image pointed to by varargs
+//(CV_32F or half) to uchar for display.
+void toDisplay(int rowStart, int rowEnd, void* varargs)
+{
+	Mat* img = (Mat*) varargs;
+	LauraHalf::toFloat(*img).convertTo(*img, CV_8U);
+}
@@ -19,10 +19,19 @@
 //SOFTWARE.
 
 #include <opencv2/opencv.hpp>
+#include <cstdlib>
 #include <string>
 #include <iostream>
+#include <cfloat>
+#include "../LauraBinary.h"
 #include "../LauraConvolution.h"
+#include "../LauraCounters.h"
 #include "../LauraFilters.h"
+#include "../LauraHistogram.h"
+#include "../LauraIngest.h"
+#include "../LauraJobs.h"
+#include "../LauraPipeline.h"
+#include "../LauraRaw.h"
 
 using cv::Mat;
 using cv::namedWindow;
@@ -35,60 +44,92 @@ using std::endl;
 using std::string;
 using std::vector;
 
-Mat removeSP(Mat& img);
-
 int
 main(int argc, char** argv) {
 	//Read image from command line.
 	string fname;
-	if (argc != 2) { //user did something wrong, correct them and exit
-		cout << "Format: ./lapLine [filename]." << endl;
-		return 0;
+	//--thin thins the lines to one pixel wide.
+	bool thinLines = false;
+	//--scale n (2, 4 or 8) works at 1/n of the image size.
+	int scale = 1;
+	//--median n median filters the image over n x n (n odd)
+	//first, for gray salt and pepper noise.
+	int median = 0;
+	//An optional .lraw file receives the result.
+	string outname;
+	bool ok = (argc >= 2);
+	for (int a = 2; a < argc; ++a)
+	{
+		if (string(argv[a]) == "--thin")
+			thinLines = true;
+		else if ((string(argv[a]) == "--scale") && (a + 1 < argc))
+		{
+			scale = atoi(argv[++a]);
+			ok = ok && LauraIngest::isScale(scale);
+		}
+		else if ((string(argv[a]) == "--median") && (a + 1 < argc))
+		{
+			median = atoi(argv[++a]);
+			ok = ok && (1 < median) && (1 == median % 2);
+		}
+		else if (LauraRaw::isRaw(argv[a]))
+			outname = argv[a];
+		else
+			ok = false;
 	}
-	else {
-		fname = argv[1]; //grab filename
+	if (!ok) { //user did something wrong, correct them and exit
+		cout << "Format: ./lapLine [filename] [--thin] [--scale n] [--median n] [output.lraw]." << endl;
+		return 0;
 	}
-	Mat img = imread(fname);
+	//$LAURA_COUNTERS prints the hardware counters of each stage.
+	LauraCounters::reportAtExit();
+	fname = argv[1]; //grab filename
+	//Raw (.lraw) images are mapped straight in, no decode;
+	//others are decoded straight to gray at the working size.
+	LauraIngest ingest(scale, CV_32F);
+	Mat img = ingest.loadGray(fname);
 	if (!img.data) return -1; //Snippet from opencv 2.1 doc intro to make sure it loaded properly.
 
-	//Convert to grayscale
-	cv::cvtColor(img, img, CV_RGB2GRAY);
-	//Convert to float
-	img.convertTo(img, CV_32F);
-
-	//Remove salt and pepper noise.
-	Mat filtered = removeSP(img);
+	//The whole chain is recorded first and run as a few fused
+	//passes, so the pointwise steps cost no extra image passes.
+	//Remove salt and pepper noise: gray impulses by median, if
+	//asked, and then isolated pixels by hit and miss.
+	Mat filtered, lapimg;
+	Mat denoised = (0 < median) ? LauraJobs::median(img, median) : img;
+	LauraPipeline lines(denoised);
+	LauraJobs::removeSP(lines);
+	lines.tap(filtered);
 
 	/*** Get 1 pixel lines on fg or bg ***/
 	//Apply the laplacian.
 	Mat laplacian = LauraFilters::laplacian();
-	Mat lapimg = LauraConvolution::convolve(
-		filtered, laplacian);
-	
+	lines.convolve(laplacian).tap(lapimg);
+
 	//Take absolute value image.
-	Mat absimg = cv::abs(lapimg);
+	//Find mean and std. dev. on the way for dynamic thresholding,
+	//ignoring the pixels that would round to 0 in CV_8U.
+	LauraHistogram hist(256, 0.0f, 256.0f);
+	Mat absimg = lines.abs().histogram(hist, 0.5f, FLT_MAX).run();
 
-	//Dynamic thresholding
-	//Find mean and median, ignoring the 0's
-	//Using the image as its own mask works for ignoring 0's,
-	//as long as it is converted to CV_8U
-	cv::Scalar amean, astd;
-	Mat mask = absimg;
-	absimg.convertTo(mask, CV_8U);
-	cv::meanStdDev(absimg, amean, astd, mask);
 	//Threshold absimg to thin the lines.
-	Mat thinned = LauraFilters::threshold(
-		absimg, amean(0) + astd(0));
-
 	//Remove salt and pepper noise.
-	thinned = removeSP(thinned);
+	LauraPipeline thin(absimg);
+	thin.threshold(hist.mean() + hist.stddev());
+	LauraJobs::removeSP(thin);
+	Mat thinned = thin.run(CV_8U);
+	//Down to one pixel wide, by lookup table.
+	if (thinLines)
+		thinned = LauraBinary::thin(thinned);
+
+	//Write the result out, if asked.
+	if (!outname.empty())
+		LauraRaw::save(outname, thinned);
 
 	//Convert back to uchar for display.
 	img.convertTo(img, CV_8U);
 	filtered.convertTo(filtered, CV_8U);
 	lapimg.convertTo(lapimg, CV_8U);
 	absimg.convertTo(absimg, CV_8U);
-	thinned.convertTo(thinned, CV_8U);
 
 	//Show image
 	namedWindow(fname, CV_WINDOW_AUTOSIZE);
@@ -105,38 +146,3 @@ main(int argc, char** argv) {
 
 	return 0;
 }
-
-
-//Filter to remove Salt & Pepper noise
-Mat removeSP(Mat& img)
-{
-	Mat bw = img.clone();
-	bw *= 1/255.0f;
-	Mat pepper = (cv::Mat_<float>(5, 5)
-		<< 1, 1, 1, 1, 1,
-		   1, 2, 2, 2, 1,
-		   1, 2, 0, 2, 1,
-		   1, 2, 2, 2, 1,
-		   1, 1, 1, 1, 1);
-	Mat salt = (cv::Mat_<float>(5, 5)
-		<< 0, 0, 0, 0, 0,
-		   0, 2, 2, 2, 0,
-		   0, 2, 1, 2, 0,
-		   0, 2, 2, 2, 0,
-		   0, 0, 0, 0, 0);
-	Mat filtered = LauraConvolution::
-		hitAndMiss(bw, salt);
-	filtered = LauraConvolution::
-		hitAndMiss(filtered, pepper);
-	pepper = (cv::Mat_<float>(3, 3)
-		<< 1, 1, 1, 1, 0, 1, 1, 1, 1);
-	salt = (cv::Mat_<float>(3, 3)
-		<< 0, 0, 0, 0, 1, 0, 0, 0, 0);
-	filtered = LauraConvolution::
-		hitAndMiss(filtered, salt);
-	filtered = LauraConvolution::
-		hitAndMiss(filtered, pepper);
-	filtered = filtered * 255.0f;
-
-	return filtered;
-}
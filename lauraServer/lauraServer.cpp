@@ -0,0 +1,134 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <iostream>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include "../LauraCounters.h"
+#include "../LauraServer.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+int sendRequest(const string& path, const string& line);
+
+//Serves the pipelines (see LauraServer.h) until SIGINT or SIGTERM.
+//With --send, sends one request line instead and prints the reply.
+int
+main(int argc, char** argv) {
+	string path = "/tmp/laura.sock";
+	int workers = 0;
+	string line;
+	bool ok = true;
+	for (int a = 1; a < argc; ++a)
+	{
+		if ((string(argv[a]) == "--workers") && (a + 1 < argc))
+			workers = atoi(argv[++a]);
+		else if ((string(argv[a]) == "--send") && (a + 1 < argc))
+			line = argv[++a];
+		else if ('-' != argv[a][0])
+			path = argv[a];
+		else
+			ok = false;
+	}
+	if (!ok) { //user did something wrong, correct them and exit
+		cout << "Format: ./lauraServer [socket] [--workers n]" << endl;
+		cout << "    or: ./lauraServer [socket] --send \"canny in=x.png out=y.lraw\"" << endl;
+		return 0;
+	}
+	if (!line.empty())
+		return sendRequest(path, line);
+	//$LAURA_COUNTERS prints the hardware counters of each
+	//pipeline when the server stops.
+	LauraCounters::reportAtExit();
+
+	//The signals are taken by a thread of their own, which stops
+	//the server; no other thread sees them.
+	sigset_t sigs;
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGINT);
+	sigaddset(&sigs, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+	LauraServer server(path, workers);
+	std::thread waiter([&]() {
+		int sig;
+		sigwait(&sigs, &sig);
+		server.stop();
+	});
+	waiter.detach();
+
+	cout << "Serving on " << path << endl;
+	if (!server.run())
+	{
+		cout << "Cannot listen on " << path << endl;
+		return -1;
+	}
+	return 0;
+}
+
+//Sends line to the server on path and prints the reply line.
+//The result's bytes, if any, are skipped.
+int sendRequest(const string& path, const string& line)
+{
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if ((0 > fd) || (0 != connect(fd, (sockaddr*) &addr, sizeof(addr))))
+	{
+		cout << "Cannot connect to " << path << endl;
+		return -1;
+	}
+
+	string request = line + "\n";
+	if (write(fd, request.c_str(), request.size()) !=
+		(ssize_t) request.size())
+		return -1;
+	string reply;
+	char c;
+	while ((1 == read(fd, &c, 1)) && ('\n' != c))
+		reply += c;
+	cout << reply << endl;
+
+	unsigned long nbytes = 0;
+	char buf[65536];
+	if (1 == sscanf(reply.c_str(), "ok %*d %*d %*d %lu", &nbytes))
+	{
+		while (0 < nbytes)
+		{
+			ssize_t r = read(fd, buf,
+				(nbytes < sizeof(buf)) ? nbytes : sizeof(buf));
+			if (0 >= r) break;
+			nbytes -= r;
+		}
+	}
+	close(fd);
+	return (0 == reply.compare(0, 2, "ok")) ? 0 : -1;
+}
@@ -19,10 +19,19 @@
 //SOFTWARE.
 
 #include <opencv2/opencv.hpp>
+#include <cstdlib>
 #include <string>
 #include <iostream>
+#include <vector>
+#include <cfloat>
 #include "../LauraConvolution.h"
+#include "../LauraCounters.h"
 #include "../LauraFilters.h"
+#include "../LauraHistogram.h"
+#include "../LauraIngest.h"
+#include "../LauraJobs.h"
+#include "../LauraRaw.h"
+#include "../LauraScaleSpace.h"
 
 using cv::Mat;
 using cv::namedWindow;
@@ -38,35 +47,95 @@ int
 main(int argc, char** argv) {
 	//Read image from command line.
 	string fname;
-	if (argc != 2) { //user did something wrong, correct them and exit
-		cout << "Format: ./logEdge [filename]." << endl;
-		return 0;
+	//--dog approximates the LoG with a Difference of Gaussians.
+	bool dog = false;
+	//--scale n (2, 4 or 8) works at 1/n of the image size.
+	int scale = 1;
+	//--budget ms picks the LoG size and working size that are
+	//expected to finish in ms (LoG only).
+	float budget = 0;
+	//An optional .lraw file receives the result.
+	string outname;
+	bool ok = (argc >= 2);
+	for (int a = 2; a < argc; ++a)
+	{
+		if (string(argv[a]) == "--dog")
+			dog = true;
+		else if ((string(argv[a]) == "--scale") && (a + 1 < argc))
+		{
+			scale = atoi(argv[++a]);
+			ok = ok && LauraIngest::isScale(scale);
+		}
+		else if ((string(argv[a]) == "--budget") && (a + 1 < argc))
+		{
+			budget = (float) atof(argv[++a]);
+			ok = ok && (0 < budget);
+		}
+		else if (LauraRaw::isRaw(argv[a]))
+			outname = argv[a];
+		else
+			ok = false;
 	}
-	else {
-		fname = argv[1]; //grab filename
+	ok = ok && !(dog && (0 < budget));
+	if (!ok) { //user did something wrong, correct them and exit
+		cout << "Format: ./logEdge [filename] [--dog] [--scale n] [--budget ms] [output.lraw]." << endl;
+		return 0;
 	}
-	Mat img = imread(fname);
+	//$LAURA_COUNTERS prints the hardware counters of each stage.
+	LauraCounters::reportAtExit();
+	fname = argv[1]; //grab filename
+	//Raw (.lraw) images are mapped straight in, no decode;
+	//others are decoded straight to gray at the working size.
+	LauraIngest ingest(scale, CV_32F);
+	Mat img = ingest.loadGray(fname);
 	if (!img.data) return -1; //Snippet from opencv 2.1 doc intro to make sure it loaded properly.
 
-	//Convert to grayscale
-	cv::cvtColor(img, img, CV_RGB2GRAY);
-	//Convert to float
-	img.convertTo(img, CV_32F);
+	//In budget mode the server's pipeline runs instead, timed
+	//once in its cheapest configuration to have costs to go on.
+	if (0 < budget)
+	{
+		LauraJobs::Workspace ws;
+		LauraJobs::Params params;
+		params["budget"] = budget;
+		LauraJobs::calibrate("logEdge", img, ws);
+		Mat edges = LauraJobs::run("logEdge", img, params, ws);
+		cout << ws.budget().report() << endl;
+		if (!outname.empty())
+			LauraRaw::save(outname, edges);
+		edges.convertTo(edges, CV_8U);
+		namedWindow("edges", CV_WINDOW_AUTOSIZE);
+		imshow("edges", edges);
+		waitKey(0);
+		return 0;
+	}
+
+	//LoG filter and zero-crossings.
+	//The mean of the response is subtracted from img2.
+	Mat img2, bedge;
+	float lmean, lstd;
+	if (dog)
+	{
+		//Separable blurs instead of the 13x13 LoG.
+		std::vector<Mat> dogs;
+		LauraScaleSpace::DoG(img, 2.0f, 1.6f, 1, dogs);
+		img2 = dogs[0];
+		LauraHistogram hist(512, -256.0f, 256.0f);
+		hist.compute(img2, -FLT_MAX, FLT_MAX);
+		lmean = hist.mean();
+		lstd = hist.stddev();
+		bedge = LauraFilters::zeroCrossCentered(img2, lmean, lstd);
+	}
+	else
+	{
+		bedge = LauraFilters::LoGEdge(img, 13, 2.0f,
+			img2, &lmean, &lstd);
+	}
+	cout << "Mean: " << lmean << endl;
+	cout << "Std: " << lstd << endl;
 
-	//LoG filter.
-	Mat logfilt = LauraFilters::LoG(13, 2.0f);
-	Mat img2 = LauraConvolution::convolve(
-		img, logfilt);
-	double min, max;
-	cv::minMaxLoc(img2, &min, &max);
-	cv::Scalar lmean = mean(img2);
-	cout << "Min: " << min << endl;
-	cout << "Max: " << max << endl;
-	cout << "Mean: " << lmean(0) << endl;
-	cv::add(img2, -lmean, img2);
-	
-	//Binary edge image.
-	Mat bedge = LauraFilters::zeroCross3x3(img2);
+	//Write the result out, if asked.
+	if (!outname.empty())
+		LauraRaw::save(outname, bedge);
 
 	//Convert back to uchar for display.
 	img.convertTo(img, CV_8U);
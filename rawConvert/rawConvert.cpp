@@ -0,0 +1,59 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <iostream>
+#include "../LauraIngest.h"
+#include "../LauraRaw.h"
+
+using cv::Mat;
+
+using std::cout;
+using std::endl;
+using std::string;
+
+//Decodes images once into raw grayscale CV_32F files,
+//which the other programs then map in with no decode.
+int
+main(int argc, char** argv) {
+	if ((argc < 3) || (argc % 2 == 0)) { //user did something wrong, correct them and exit
+		cout << "Format: ./rawConvert [filename] [output.lraw] ..." << endl;
+		return 0;
+	}
+
+	for (int a = 1; a + 1 < argc; a += 2)
+	{
+		LauraIngest ingest(1, CV_32F);
+		Mat img = ingest.loadGray(argv[a]);
+		if (!img.data)
+		{
+			cout << "Cannot read " << argv[a] << "." << endl;
+			return -1;
+		}
+		if (!LauraRaw::save(argv[a + 1], img))
+		{
+			cout << "Cannot write " << argv[a + 1] << "." << endl;
+			return -1;
+		}
+	}
+
+	return 0;
+}
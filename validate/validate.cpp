@@ -0,0 +1,116 @@
+//Copyright 2013 Laura Ekstrand <laura@jlekstrand.net>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files (the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions:
+//
+//The above copyright notice and this permission notice shall be included in
+//all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include <opencv2/opencv.hpp>
+#include <cstdlib>
+#include <string>
+#include <iostream>
+#include <stdio.h>
+#include "../LauraIngest.h"
+#include "../LauraShard.h"
+#include "../LauraValidate.h"
+
+using cv::Mat;
+
+using std::cout;
+using std::endl;
+using std::string;
+
+Mat testImage(int rows, int cols);
+
+//Checks every fast path against the reference engine (see
+//LauraValidate.h) on an image, or on a made-up one, and prints
+//the errors and speedups. Exits with 1 if any check failed.
+int
+main(int argc, char** argv) {
+	string fname;
+	int rows = 256;
+	int cols = 256;
+	LauraValidate::Tolerance tol;
+	tol.ulps = 64;
+	tol.abs = 1e-3f;
+	int shards = 0;
+	bool ok = true;
+	for (int a = 1; a < argc; ++a)
+	{
+		if ((string(argv[a]) == "--size") && (a + 1 < argc))
+			ok = ok && (2 == sscanf(argv[++a], "%dx%d", &rows, &cols)) &&
+				(3 <= rows) && (3 <= cols);
+		else if ((string(argv[a]) == "--ulps") && (a + 1 < argc))
+			tol.ulps = atoi(argv[++a]);
+		else if ((string(argv[a]) == "--abs") && (a + 1 < argc))
+			tol.abs = (float) atof(argv[++a]);
+		else if ((string(argv[a]) == "--shards") && (a + 1 < argc))
+			shards = atoi(argv[++a]);
+		else if ('-' != argv[a][0])
+			fname = argv[a];
+		else
+			ok = false;
+	}
+	if (!ok) { //user did something wrong, correct them and exit
+		cout << "Format: ./validate [filename] [--size RxC] [--ulps n] [--abs x] [--shards n]" << endl;
+		return 0;
+	}
+	//The workers are forked, so start them before any threads.
+	LauraShard* shard = NULL;
+	if (0 < shards)
+		shard = new LauraShard(shards);
+
+	Mat img;
+	if (fname.empty())
+		img = testImage(rows, cols);
+	else
+	{
+		LauraIngest ingest(1, CV_32F);
+		img = ingest.loadGray(fname);
+		if (!img.data) return -1;
+	}
+
+	LauraValidate validate(tol, shard);
+	validate.run(img);
+	validate.report(cout);
+
+	delete shard;
+	return validate.passed() ? 0 : 1;
+}
+
+//A rows x cols image in 0 to 255 with ramps, flat blocks, hard
+//edges and noise, so that every path sees each kind of content,
+//at the borders too.
+Mat testImage(int rows, int cols)
+{
+	Mat img(rows, cols, CV_32F);
+	unsigned int seed = 12345;
+	for (int i = 0; i < rows; ++i)
+	{
+		float* p = img.ptr<float>(i);
+		for (int j = 0; j < cols; ++j)
+		{
+			seed = seed*1103515245u + 12345u;
+			float noise = (float) ((seed >> 16) % 32) - 16.0f;
+			float ramp = 255.0f*j/cols;
+			bool block = ((i/16 + j/16) % 3) == 0;
+			float v = block ? 200.0f : ramp;
+			v += ((i/8) % 2) ? noise : 0.0f;
+			p[j] = (v < 0.0f) ? 0.0f : ((v > 255.0f) ? 255.0f : v);
+		}
+	}
+	return img;
+}